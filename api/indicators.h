@@ -12,6 +12,24 @@
  */
 typedef struct indicator_ctx indicator_ctx_t;
 
+/** Size of cache line, contexts allocated by the server never share it */
+#define INDICATOR_CACHE_LINE_SIZE 64
+
+/**
+ * Scratch arena for temporaries
+ *
+ * Every thread which calls indicator functions has its own arena, so it is
+ * used without locks. The server resets the arena when the thread starts to
+ * process another session, allocations are not freed one by one. Use
+ * indicator_scratch_mark() and indicator_scratch_rewind() to reuse memory of
+ * temporaries within one call.
+ */
+typedef struct indicator_scratch_s {
+    uint8_t *base;
+    size_t   size;
+    size_t   used;
+} indicator_scratch_t;
+
 /**
  * Indicator arguments
  *
@@ -22,8 +40,50 @@ typedef struct indicator_arg_s {
     indicator_ctx_t *ctx;
     const uint8_t   *data;
     const size_t     size;
+    indicator_scratch_t *scratch;  /* arena of the calling thread, NULL - not provided */
+    const uint8_t   *derived;      /* output of preprocessor for data, NULL - not provided */
+    size_t           derived_size;
 } indicator_arg_t;
 
+/**
+ * Allocate memory from scratch arena
+ *
+ * Memory is aligned to cache line and is not initialized.
+ *
+ * @param[in]   scratch     arena from indicator_arg_t.
+ * @param[in]   size        size of memory.
+ * @returns     Pointer to memory or NULL if arena is exhausted or not provided.
+ */
+static inline void *indicator_scratch_alloc(indicator_scratch_t *scratch, size_t size)
+{
+    size_t offset;
+    if (scratch == NULL)
+    {
+        return NULL;
+    }
+    offset = (scratch->used + INDICATOR_CACHE_LINE_SIZE - 1) & ~((size_t)INDICATOR_CACHE_LINE_SIZE - 1);
+    if (offset > scratch->size || size > scratch->size - offset)
+    {
+        return NULL;
+    }
+    scratch->used = offset + size;
+    return scratch->base + offset;
+}
+
+/** Current position of arena, memory allocated after it is released by rewind */
+static inline size_t indicator_scratch_mark(const indicator_scratch_t *scratch)
+{
+    return (scratch != NULL) ? scratch->used : 0;
+}
+
+static inline void indicator_scratch_rewind(indicator_scratch_t *scratch, size_t mark)
+{
+    if (scratch != NULL && mark <= scratch->used)
+    {
+        scratch->used = mark;
+    }
+}
+
 /**
  * Indicator function
  *
@@ -73,6 +133,19 @@ typedef void (*indicator_ctx_free_t)(indicator_ctx_t *);
  */
 typedef uint64_t (*indicator_ctx_extract_t)(const indicator_ctx_t *);
 
+/**
+ * Layout of indicator context
+ *
+ * Library declares it by get_indicators_ctx_layouts() to get contexts
+ * allocated by the server instead of ctx_allocator. Memory is aligned to
+ * `alignment` and padded to whole cache lines, so contexts updated by
+ * different threads do not share a cache line.
+ */
+typedef struct indicator_ctx_layout_s {
+    size_t size;       /* size of struct indicator_ctx */
+    size_t alignment;  /* power of two, 0 - cache line, use page size to get own pages */
+} indicator_ctx_layout_t;
+
 typedef struct indicators_handlers_s {
     indicator_ctx_alloc_t   ctx_allocator;
     indicator_ctx_init_t    ctx_initializer;
@@ -100,5 +173,53 @@ indicators_handlers_t *get_indicators_handlers(void);
  */
 size_t get_indicators_count(void);
 
+/**
+ * Preprocessing of data shared by all indicators
+ *
+ * Library declares it by get_indicators_preprocessor() when every indicator
+ * needs the same preparation of data (parsing frames, downsampling, summaries
+ * of frames). Preprocessor is called once for data of every indicator call,
+ * before the indicators, and its output is passed to all of them in
+ * indicator_arg_t `derived`. It has no context, so output must depend only on
+ * the data. Indicators must work without derived data too, e.g. with tools
+ * which do not support preprocessing.
+ */
+typedef struct indicators_preprocessor_s {
+    /**
+     * Maximal size of output for data of `size` bytes
+     */
+    size_t (*derived_size)(size_t size);
+    /**
+     * Preprocess data
+     *
+     * @param[in]   data        data for indicators.
+     * @param[in]   size        size of data.
+     * @param[out]  derived     buffer of derived_size(size) bytes.
+     * @param[in]   scratch     arena of the calling thread, NULL - not provided.
+     * @returns     Size of output.
+     */
+    size_t (*preprocess)(const uint8_t *data, size_t size, uint8_t *derived, indicator_scratch_t *scratch);
+} indicators_preprocessor_t;
+
+/**
+ * Get preprocessor of data
+ *
+ * This function is optional, without it indicators get raw data only.
+ *
+ * @returns     Pointer to preprocessor.
+ */
+const indicators_preprocessor_t *get_indicators_preprocessor(void);
+
+/**
+ * Get layouts of indicators contexts
+ *
+ * This function is optional. If library exports it, contexts are allocated and
+ * freed by the server, so ctx_allocator and ctx_free of handlers could be
+ * NULL. ctx_initializer is called as before.
+ *
+ * @returns     Pointer to array of layouts, one per indicator.
+ */
+const indicator_ctx_layout_t *get_indicators_ctx_layouts(void);
+
 
 #endif
@@ -0,0 +1,72 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Vectorized primitives for indicators
+ *
+ * Library `indicator_kernels` is linked statically to indicators library. The
+ * best implementation supported by CPU is selected by CPUID on load, every
+ * implementation gives the same results as the scalar one. Functions have no
+ * state and could be called from any thread.
+ */
+
+typedef enum kernels_isa_e {
+    KERNELS_ISA_SCALAR = 0,
+    KERNELS_ISA_SSE2,
+    KERNELS_ISA_AVX2,
+    KERNELS_ISA_AVX512,
+    KERNELS_ISA_COUNT
+} kernels_isa_t;
+
+/**
+ * Add count of every byte value to histogram
+ *
+ * Histogram is not cleared, so it could be accumulated over frames. Scatter
+ * of counters is not vectorized, every implementation uses the scalar one with
+ * several tables to hide dependencies between equal bytes.
+ *
+ * @param[in]   data    bytes.
+ * @param[in]   size    count of bytes.
+ * @param[out]  hist    256 counters.
+ */
+void kernels_histogram(const uint8_t *data, size_t size, uint64_t hist[256]);
+
+/** Sum of bytes */
+uint64_t kernels_sum(const uint8_t *data, size_t size);
+
+/**
+ * Minimum and maximum of bytes
+ *
+ * For empty data min is 255 and max is 0.
+ */
+void kernels_min_max(const uint8_t *data, size_t size, uint8_t *min, uint8_t *max);
+
+/** Absolute difference of every pair of bytes, out could be equal to a or b */
+void kernels_abs_diff(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t size);
+
+/** Sum of absolute differences of two frames */
+uint64_t kernels_abs_diff_sum(const uint8_t *a, const uint8_t *b, size_t size);
+
+/** Count of set bits */
+uint64_t kernels_popcount(const uint8_t *data, size_t size);
+
+/** Count of bytes greater than threshold */
+uint64_t kernels_count_above(const uint8_t *data, size_t size, uint8_t threshold);
+
+/** Implementation used by kernels */
+kernels_isa_t kernels_get_isa(void);
+const char *kernels_isa_name(kernels_isa_t isa);
+
+/**
+ * Use another implementation
+ *
+ * It is for tests and benchmarks, call it when no other thread uses kernels.
+ *
+ * @returns     Zero if CPU supports the implementation
+ */
+int kernels_set_isa(kernels_isa_t isa);
+
+#endif
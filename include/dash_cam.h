@@ -6,14 +6,48 @@
 #define HEADER_MAGIC 0xDEADBEEF
 #define HEADER_VERSION 1
 
+/* Message types, zero keeps compatibility with dash cams which zero header */
+#define MESSAGE_TYPE_DATA    0 // video file from dash cam
+#define MESSAGE_TYPE_RESULT  1 // final indicators values for dash cam
+#define MESSAGE_TYPE_INTERIM 2 // indicators values for part of file
+#define MESSAGE_TYPE_ACK     3 // file of async session is stored, job_id is set
+#define MESSAGE_TYPE_FETCH   4 // request of results of job_id from dash cam, no payload
+
+/* Flags requested by dash cam in data message */
+#define MESSAGE_FLAG_PROGRESSIVE (1 << 0) // send interim results while uploading
+#define MESSAGE_FLAG_ASYNC       (1 << 1) // acknowledge file and compute it in background,
+                                          // results are fetched later by job_id
+
+/* Status of results message */
+#define MESSAGE_STATUS_OK      0 // all file processed, payload is uint64_t value per indicator
+#define MESSAGE_STATUS_PARTIAL 1 // deadline expired, payload is uint64_t value and
+                                 // uint64_t processed bytes per indicator
+#define MESSAGE_STATUS_BUSY    2 // session was not accepted, no payload. Retry after
+                                 // retry_after seconds
+#define MESSAGE_STATUS_TOO_LARGE 3 // session was not accepted, file never fits into
+                                   // server memory. No payload
+#define MESSAGE_STATUS_PENDING   4 // job is not computed yet, retry after retry_after
+                                   // seconds. No payload
+#define MESSAGE_STATUS_NOT_FOUND 5 // results of job_id are unknown. No payload
+#define MESSAGE_STATUS_BAD_CRC   6 // crc32 of received payload does not match. No payload
+
 struct messageHeader_s
 {
     uint32_t magic;           // magic for identifying header
     uint32_t version;         // version of header. Useful if header format changed
     uint32_t size;            // size of whole transmitted data
     uint32_t frame_size;      // size of one payload chunk
-    uint32_t crc32; // TODO   // hash calculated for header + payload
-    uint8_t  reserved[32];    // zeroed. Useful for future versions
+    uint32_t crc32;           // CRC-32 of payload, 0 - not checked. Server checks it
+                              // for async sessions and returns it in acknowledge
+    uint8_t  type;            // type of message (MESSAGE_TYPE_*)
+    uint8_t  flags;           // options requested by dash cam (MESSAGE_FLAG_*)
+    uint8_t  status;          // status of results (MESSAGE_STATUS_*)
+    uint8_t  sampling;        // results calculated for every Nth block of frames, 0 or 1 - all frames
+    uint32_t offset;          // file bytes covered by interim or partial results
+    uint16_t retry_after;     // seconds before next attempt for busy status
+    uint64_t job_id;          // id of async job in acknowledge, fetch and its results
+    uint32_t library_id;      // CRC-32 of indicators library which computed results, 0 - unknown
+    uint8_t  reserved[10];    // zeroed. Useful for future versions
 } __attribute__ ((__packed__));
 typedef struct messageHeader_s messageHeader_t;
 
@@ -0,0 +1,33 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+
+/*
+ * Recorded session file
+ *
+ * recordHeader_t is followed by recordChunk_t and data of every read of
+ * session socket, the first chunk is messageHeader_t. All fields are in
+ * network byte order.
+ */
+#define RECORD_MAGIC 0x44435243 // "DCRC"
+#define RECORD_VERSION 1
+#define RECORD_FILE_SUFFIX ".rec"
+
+struct recordHeader_s
+{
+    uint32_t magic;           // magic for identifying recorded session
+    uint32_t version;         // version of record format
+    uint32_t start_sec;       // unix time of connection accept
+    uint32_t start_usec;
+} __attribute__ ((__packed__));
+typedef struct recordHeader_s recordHeader_t;
+
+struct recordChunk_s
+{
+    uint32_t delay_us;        // time since previous read, the first one since accept
+    uint32_t size;            // size of data received by this read
+} __attribute__ ((__packed__));
+typedef struct recordChunk_s recordChunk_t;
+
+#endif // RECORD_H
@@ -0,0 +1,111 @@
+#include "kernels.h"
+#include "kernels_impl.h"
+
+static const char *isa_names[KERNELS_ISA_COUNT] = {"scalar", "sse2", "avx2", "avx512"};
+
+static const kernels_table_t *tables[KERNELS_ISA_COUNT] = {
+    &kernels_scalar_table,
+#ifdef KERNELS_X86
+    &kernels_sse2_table,
+    &kernels_avx2_table,
+    &kernels_avx512_table,
+#endif
+};
+
+static const kernels_table_t *table = &kernels_scalar_table;
+static kernels_isa_t current_isa = KERNELS_ISA_SCALAR;
+
+/* CPUID bits and XGETBV state of OS are checked by compiler runtime */
+static int is_supported(kernels_isa_t isa)
+{
+    if (isa >= KERNELS_ISA_COUNT || tables[isa] == NULL)
+    {
+        return 0;
+    }
+#ifdef KERNELS_X86
+    switch (isa)
+    {
+    case KERNELS_ISA_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case KERNELS_ISA_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case KERNELS_ISA_AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    default:
+        break;
+    }
+#endif
+    return 1;
+}
+
+/* The best implementation is selected when library is loaded, before any kernel is called */
+__attribute__((constructor)) static void select_isa(void)
+{
+    int isa;
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+#endif
+    for (isa = KERNELS_ISA_COUNT - 1; isa > KERNELS_ISA_SCALAR; isa--)
+    {
+        if (kernels_set_isa((kernels_isa_t)isa) == 0)
+        {
+            break;
+        }
+    }
+}
+
+int kernels_set_isa(kernels_isa_t isa)
+{
+    if (!is_supported(isa))
+    {
+        return -1;
+    }
+    table       = tables[isa];
+    current_isa = isa;
+    return 0;
+}
+
+kernels_isa_t kernels_get_isa(void)
+{
+    return current_isa;
+}
+
+const char *kernels_isa_name(kernels_isa_t isa)
+{
+    return (isa < KERNELS_ISA_COUNT) ? isa_names[isa] : "unknown";
+}
+
+void kernels_histogram(const uint8_t *data, size_t size, uint64_t hist[256])
+{
+    table->histogram(data, size, hist);
+}
+
+uint64_t kernels_sum(const uint8_t *data, size_t size)
+{
+    return table->sum(data, size);
+}
+
+void kernels_min_max(const uint8_t *data, size_t size, uint8_t *min, uint8_t *max)
+{
+    table->min_max(data, size, min, max);
+}
+
+void kernels_abs_diff(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t size)
+{
+    table->abs_diff(a, b, out, size);
+}
+
+uint64_t kernels_abs_diff_sum(const uint8_t *a, const uint8_t *b, size_t size)
+{
+    return table->abs_diff_sum(a, b, size);
+}
+
+uint64_t kernels_popcount(const uint8_t *data, size_t size)
+{
+    return table->popcount(data, size);
+}
+
+uint64_t kernels_count_above(const uint8_t *data, size_t size, uint8_t threshold)
+{
+    return table->count_above(data, size, threshold);
+}
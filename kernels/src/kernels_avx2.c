@@ -0,0 +1,121 @@
+#include <immintrin.h>
+
+#include "kernels_impl.h"
+
+#define WIDTH 32
+
+static uint64_t reduce_add(__m256i acc)
+{
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    return (uint64_t)_mm_cvtsi128_si64(sum) + (uint64_t)_mm_cvtsi128_si64(_mm_srli_si128(sum, 8));
+}
+
+static uint64_t avx2_sum(const uint8_t *data, size_t size)
+{
+    size_t i;
+    __m256i acc = _mm256_setzero_si256();
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(data + i)),
+                                                    _mm256_setzero_si256()));
+    }
+    return reduce_add(acc) + kernels_scalar_sum(data + i, size - i);
+}
+
+static void avx2_min_max(const uint8_t *data, size_t size, uint8_t *min, uint8_t *max)
+{
+    size_t i;
+    uint8_t lanes[2][WIDTH], lo, hi;
+    __m256i vmin = _mm256_set1_epi8((char)UINT8_MAX);
+    __m256i vmax = _mm256_setzero_si256();
+
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        vmin = _mm256_min_epu8(vmin, v);
+        vmax = _mm256_max_epu8(vmax, v);
+    }
+    _mm256_storeu_si256((__m256i *)lanes[0], vmin);
+    _mm256_storeu_si256((__m256i *)lanes[1], vmax);
+    kernels_scalar_min_max(data + i, size - i, min, max);
+    kernels_scalar_min_max(lanes[0], WIDTH, &lo, &hi);
+    *min = (lo < *min) ? lo : *min;
+    kernels_scalar_min_max(lanes[1], WIDTH, &lo, &hi);
+    *max = (hi > *max) ? hi : *max;
+}
+
+static void avx2_abs_diff(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t size)
+{
+    size_t i;
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        _mm256_storeu_si256((__m256i *)(out + i),
+                            _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va)));
+    }
+    kernels_scalar_abs_diff(a + i, b + i, out + i, size - i);
+}
+
+static uint64_t avx2_abs_diff_sum(const uint8_t *a, const uint8_t *b, size_t size)
+{
+    size_t i;
+    __m256i acc = _mm256_setzero_si256();
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                                    _mm256_loadu_si256((const __m256i *)(b + i))));
+    }
+    return reduce_add(acc) + kernels_scalar_abs_diff_sum(a + i, b + i, size - i);
+}
+
+/* Bits of every nibble are taken from table by byte shuffle */
+static uint64_t avx2_popcount(const uint8_t *data, size_t size)
+{
+    size_t i;
+    __m256i acc = _mm256_setzero_si256();
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i bits = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(v, low)),
+                                       _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bits, _mm256_setzero_si256()));
+    }
+    return reduce_add(acc) + kernels_scalar_popcount(data + i, size - i);
+}
+
+static uint64_t avx2_count_above(const uint8_t *data, size_t size, uint8_t threshold)
+{
+    size_t i, k;
+    __m256i acc = _mm256_setzero_si256();
+    /* unsigned comparison by signed one with flipped sign bits */
+    const __m256i sign = _mm256_set1_epi8((char)0x80);
+    const __m256i limit = _mm256_set1_epi8((char)(threshold ^ 0x80));
+
+    for (i = 0; i + WIDTH <= size; i += k)
+    {
+        /* comparison gives -1 for matched byte, byte counters are summed before they overflow */
+        __m256i counters = _mm256_setzero_si256();
+        for (k = 0; k < WIDTH * UINT8_MAX && i + k + WIDTH <= size; k += WIDTH)
+        {
+            __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(data + i + k)), sign);
+            counters = _mm256_sub_epi8(counters, _mm256_cmpgt_epi8(v, limit));
+        }
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(counters, _mm256_setzero_si256()));
+    }
+    return reduce_add(acc) + kernels_scalar_count_above(data + i, size - i, threshold);
+}
+
+const kernels_table_t kernels_avx2_table = {
+    .histogram    = kernels_scalar_histogram,
+    .sum          = avx2_sum,
+    .min_max      = avx2_min_max,
+    .abs_diff     = avx2_abs_diff,
+    .abs_diff_sum = avx2_abs_diff_sum,
+    .popcount     = avx2_popcount,
+    .count_above  = avx2_count_above,
+};
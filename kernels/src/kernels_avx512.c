@@ -0,0 +1,102 @@
+#include <immintrin.h>
+
+#include "kernels_impl.h"
+
+#define WIDTH 64
+
+static uint64_t avx512_sum(const uint8_t *data, size_t size)
+{
+    size_t i;
+    __m512i acc = _mm512_setzero_si512();
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(_mm512_loadu_si512(data + i), _mm512_setzero_si512()));
+    }
+    return (uint64_t)_mm512_reduce_add_epi64(acc) + kernels_scalar_sum(data + i, size - i);
+}
+
+static void avx512_min_max(const uint8_t *data, size_t size, uint8_t *min, uint8_t *max)
+{
+    size_t i;
+    uint8_t lanes[2][WIDTH], lo, hi;
+    __m512i vmin = _mm512_set1_epi8((char)UINT8_MAX);
+    __m512i vmax = _mm512_setzero_si512();
+
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        __m512i v = _mm512_loadu_si512(data + i);
+        vmin = _mm512_min_epu8(vmin, v);
+        vmax = _mm512_max_epu8(vmax, v);
+    }
+    _mm512_storeu_si512(lanes[0], vmin);
+    _mm512_storeu_si512(lanes[1], vmax);
+    kernels_scalar_min_max(data + i, size - i, min, max);
+    kernels_scalar_min_max(lanes[0], WIDTH, &lo, &hi);
+    *min = (lo < *min) ? lo : *min;
+    kernels_scalar_min_max(lanes[1], WIDTH, &lo, &hi);
+    *max = (hi > *max) ? hi : *max;
+}
+
+static void avx512_abs_diff(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t size)
+{
+    size_t i;
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        __m512i va = _mm512_loadu_si512(a + i);
+        __m512i vb = _mm512_loadu_si512(b + i);
+        _mm512_storeu_si512(out + i, _mm512_or_si512(_mm512_subs_epu8(va, vb), _mm512_subs_epu8(vb, va)));
+    }
+    kernels_scalar_abs_diff(a + i, b + i, out + i, size - i);
+}
+
+static uint64_t avx512_abs_diff_sum(const uint8_t *a, const uint8_t *b, size_t size)
+{
+    size_t i;
+    __m512i acc = _mm512_setzero_si512();
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)));
+    }
+    return (uint64_t)_mm512_reduce_add_epi64(acc) + kernels_scalar_abs_diff_sum(a + i, b + i, size - i);
+}
+
+/* Bits of every nibble are taken from table by byte shuffle, VPOPCNTB needs BITALG */
+static uint64_t avx512_popcount(const uint8_t *data, size_t size)
+{
+    size_t i;
+    __m512i acc = _mm512_setzero_si512();
+    const __m512i table = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+    const __m512i low = _mm512_set1_epi8(0x0f);
+
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        __m512i v = _mm512_loadu_si512(data + i);
+        __m512i bits = _mm512_add_epi8(_mm512_shuffle_epi8(table, _mm512_and_si512(v, low)),
+                                       _mm512_shuffle_epi8(table, _mm512_and_si512(_mm512_srli_epi16(v, 4), low)));
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(bits, _mm512_setzero_si512()));
+    }
+    return (uint64_t)_mm512_reduce_add_epi64(acc) + kernels_scalar_popcount(data + i, size - i);
+}
+
+static uint64_t avx512_count_above(const uint8_t *data, size_t size, uint8_t threshold)
+{
+    size_t i;
+    uint64_t count = 0;
+    const __m512i limit = _mm512_set1_epi8((char)threshold);
+
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        count += (uint64_t)__builtin_popcountll(_mm512_cmpgt_epu8_mask(_mm512_loadu_si512(data + i), limit));
+    }
+    return count + kernels_scalar_count_above(data + i, size - i, threshold);
+}
+
+const kernels_table_t kernels_avx512_table = {
+    .histogram    = kernels_scalar_histogram,
+    .sum          = avx512_sum,
+    .min_max      = avx512_min_max,
+    .abs_diff     = avx512_abs_diff,
+    .abs_diff_sum = avx512_abs_diff_sum,
+    .popcount     = avx512_popcount,
+    .count_above  = avx512_count_above,
+};
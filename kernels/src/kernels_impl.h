@@ -0,0 +1,34 @@
+#ifndef KERNELS_IMPL_H_
+#define KERNELS_IMPL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Implementation of all kernels for one instruction set */
+typedef struct kernels_table_s {
+    void     (*histogram)(const uint8_t *data, size_t size, uint64_t hist[256]);
+    uint64_t (*sum)(const uint8_t *data, size_t size);
+    void     (*min_max)(const uint8_t *data, size_t size, uint8_t *min, uint8_t *max);
+    void     (*abs_diff)(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t size);
+    uint64_t (*abs_diff_sum)(const uint8_t *a, const uint8_t *b, size_t size);
+    uint64_t (*popcount)(const uint8_t *data, size_t size);
+    uint64_t (*count_above)(const uint8_t *data, size_t size, uint8_t threshold);
+} kernels_table_t;
+
+extern const kernels_table_t kernels_scalar_table;
+#ifdef KERNELS_X86
+extern const kernels_table_t kernels_sse2_table;
+extern const kernels_table_t kernels_avx2_table;
+extern const kernels_table_t kernels_avx512_table;
+#endif
+
+/* Scalar kernels, vector ones process tails by them */
+void     kernels_scalar_histogram(const uint8_t *data, size_t size, uint64_t hist[256]);
+uint64_t kernels_scalar_sum(const uint8_t *data, size_t size);
+void     kernels_scalar_min_max(const uint8_t *data, size_t size, uint8_t *min, uint8_t *max);
+void     kernels_scalar_abs_diff(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t size);
+uint64_t kernels_scalar_abs_diff_sum(const uint8_t *a, const uint8_t *b, size_t size);
+uint64_t kernels_scalar_popcount(const uint8_t *data, size_t size);
+uint64_t kernels_scalar_count_above(const uint8_t *data, size_t size, uint8_t threshold);
+
+#endif /* KERNELS_IMPL_H_ */
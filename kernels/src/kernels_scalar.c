@@ -0,0 +1,129 @@
+#include <string.h>
+
+#include "kernels_impl.h"
+
+#define HISTOGRAM_TABLES 4
+#define HISTOGRAM_SMALL 64                        /* smaller data is counted to histogram directly */
+#define HISTOGRAM_BLOCK ((size_t) (1024 * 1024 * 1024)) /* 32-bit counters do not overflow */
+
+/* Equal bytes in a row wait for the same counter, so neighbours are counted in different tables */
+void kernels_scalar_histogram(const uint8_t *data, size_t size, uint64_t hist[256])
+{
+    uint32_t tables[HISTOGRAM_TABLES][256];
+    size_t i, k, block;
+
+    if (size < HISTOGRAM_SMALL)
+    {
+        for (i = 0; i < size; i++)
+        {
+            hist[data[i]]++;
+        }
+        return;
+    }
+    while (size != 0)
+    {
+        block = (size < HISTOGRAM_BLOCK) ? size : HISTOGRAM_BLOCK;
+        memset(tables, 0x00, sizeof(tables));
+        for (i = 0; i + HISTOGRAM_TABLES <= block; i += HISTOGRAM_TABLES)
+        {
+            tables[0][data[i]]++;
+            tables[1][data[i + 1]]++;
+            tables[2][data[i + 2]]++;
+            tables[3][data[i + 3]]++;
+        }
+        for (; i < block; i++)
+        {
+            tables[0][data[i]]++;
+        }
+        for (k = 0; k < 256; k++)
+        {
+            hist[k] += (uint64_t)tables[0][k] + tables[1][k] + tables[2][k] + tables[3][k];
+        }
+        data += block;
+        size -= block;
+    }
+}
+
+uint64_t kernels_scalar_sum(const uint8_t *data, size_t size)
+{
+    size_t i;
+    uint64_t sum = 0;
+    for (i = 0; i < size; i++)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
+
+void kernels_scalar_min_max(const uint8_t *data, size_t size, uint8_t *min, uint8_t *max)
+{
+    size_t i;
+    uint8_t lo = UINT8_MAX, hi = 0;
+    for (i = 0; i < size; i++)
+    {
+        lo = (data[i] < lo) ? data[i] : lo;
+        hi = (data[i] > hi) ? data[i] : hi;
+    }
+    *min = lo;
+    *max = hi;
+}
+
+void kernels_scalar_abs_diff(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+        int diff = a[i] - b[i];
+        out[i] = (uint8_t)((diff < 0) ? -diff : diff);
+    }
+}
+
+uint64_t kernels_scalar_abs_diff_sum(const uint8_t *a, const uint8_t *b, size_t size)
+{
+    size_t i;
+    uint64_t sum = 0;
+    for (i = 0; i < size; i++)
+    {
+        int diff = a[i] - b[i];
+        sum += (uint64_t)((diff < 0) ? -diff : diff);
+    }
+    return sum;
+}
+
+uint64_t kernels_scalar_popcount(const uint8_t *data, size_t size)
+{
+    size_t i;
+    uint64_t word, count = 0;
+    for (i = 0; i + sizeof(word) <= size; i += sizeof(word))
+    {
+        /* data could be unaligned */
+        memcpy(&word, data + i, sizeof(word));
+        count += (uint64_t)__builtin_popcountll(word);
+    }
+    for (; i < size; i++)
+    {
+        count += (uint64_t)__builtin_popcount(data[i]);
+    }
+    return count;
+}
+
+uint64_t kernels_scalar_count_above(const uint8_t *data, size_t size, uint8_t threshold)
+{
+    size_t i;
+    uint64_t count = 0;
+    for (i = 0; i < size; i++)
+    {
+        count += (data[i] > threshold);
+    }
+    return count;
+}
+
+const kernels_table_t kernels_scalar_table = {
+    .histogram    = kernels_scalar_histogram,
+    .sum          = kernels_scalar_sum,
+    .min_max      = kernels_scalar_min_max,
+    .abs_diff     = kernels_scalar_abs_diff,
+    .abs_diff_sum = kernels_scalar_abs_diff_sum,
+    .popcount     = kernels_scalar_popcount,
+    .count_above  = kernels_scalar_count_above,
+};
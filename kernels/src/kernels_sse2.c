@@ -0,0 +1,120 @@
+#include <emmintrin.h>
+
+#include "kernels_impl.h"
+
+#define WIDTH 16
+
+static uint64_t reduce_add(__m128i acc)
+{
+    return (uint64_t)_mm_cvtsi128_si64(acc) + (uint64_t)_mm_cvtsi128_si64(_mm_srli_si128(acc, 8));
+}
+
+static uint64_t sse2_sum(const uint8_t *data, size_t size)
+{
+    size_t i;
+    __m128i acc = _mm_setzero_si128();
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(data + i)), _mm_setzero_si128()));
+    }
+    return reduce_add(acc) + kernels_scalar_sum(data + i, size - i);
+}
+
+static void sse2_min_max(const uint8_t *data, size_t size, uint8_t *min, uint8_t *max)
+{
+    size_t i;
+    uint8_t lanes[2][WIDTH], lo, hi;
+    __m128i vmin = _mm_set1_epi8((char)UINT8_MAX);
+    __m128i vmax = _mm_setzero_si128();
+
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        vmin = _mm_min_epu8(vmin, v);
+        vmax = _mm_max_epu8(vmax, v);
+    }
+    _mm_storeu_si128((__m128i *)lanes[0], vmin);
+    _mm_storeu_si128((__m128i *)lanes[1], vmax);
+    kernels_scalar_min_max(data + i, size - i, min, max);
+    kernels_scalar_min_max(lanes[0], WIDTH, &lo, &hi);
+    *min = (lo < *min) ? lo : *min;
+    kernels_scalar_min_max(lanes[1], WIDTH, &lo, &hi);
+    *max = (hi > *max) ? hi : *max;
+}
+
+static void sse2_abs_diff(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t size)
+{
+    size_t i;
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        /* saturated subtraction is zero in one of directions */
+        _mm_storeu_si128((__m128i *)(out + i), _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va)));
+    }
+    kernels_scalar_abs_diff(a + i, b + i, out + i, size - i);
+}
+
+static uint64_t sse2_abs_diff_sum(const uint8_t *a, const uint8_t *b, size_t size)
+{
+    size_t i;
+    __m128i acc = _mm_setzero_si128();
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                              _mm_loadu_si128((const __m128i *)(b + i))));
+    }
+    return reduce_add(acc) + kernels_scalar_abs_diff_sum(a + i, b + i, size - i);
+}
+
+/* SSE2 has no byte shuffle, bits are counted by shifts and masks in every byte */
+static uint64_t sse2_popcount(const uint8_t *data, size_t size)
+{
+    size_t i;
+    __m128i acc = _mm_setzero_si128();
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+
+    for (i = 0; i + WIDTH <= size; i += WIDTH)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+        v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+        v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+    return reduce_add(acc) + kernels_scalar_popcount(data + i, size - i);
+}
+
+static uint64_t sse2_count_above(const uint8_t *data, size_t size, uint8_t threshold)
+{
+    size_t i, k;
+    __m128i acc = _mm_setzero_si128();
+    /* unsigned comparison by signed one with flipped sign bits */
+    const __m128i sign = _mm_set1_epi8((char)0x80);
+    const __m128i limit = _mm_set1_epi8((char)(threshold ^ 0x80));
+
+    for (i = 0; i + WIDTH <= size; i += k)
+    {
+        /* comparison gives -1 for matched byte, byte counters are summed before they overflow */
+        __m128i counters = _mm_setzero_si128();
+        for (k = 0; k < WIDTH * UINT8_MAX && i + k + WIDTH <= size; k += WIDTH)
+        {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(data + i + k)), sign);
+            counters = _mm_sub_epi8(counters, _mm_cmpgt_epi8(v, limit));
+        }
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(counters, _mm_setzero_si128()));
+    }
+    return reduce_add(acc) + kernels_scalar_count_above(data + i, size - i, threshold);
+}
+
+const kernels_table_t kernels_sse2_table = {
+    .histogram    = kernels_scalar_histogram,
+    .sum          = sse2_sum,
+    .min_max      = sse2_min_max,
+    .abs_diff     = sse2_abs_diff,
+    .abs_diff_sum = sse2_abs_diff_sum,
+    .popcount     = sse2_popcount,
+    .count_above  = sse2_count_above,
+};
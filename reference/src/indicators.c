@@ -0,0 +1,290 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "indicators.h"
+#include "kernels.h"
+
+/*
+ * Reference indicators with real work for performance measurements
+ *
+ * Data is split to frames of FRAME_SIZE bytes regardless of chunks, bytes of a
+ * frame which is split between calls are kept in ctx. So values depend only on
+ * data, not on chunk sizes or count of threads. The last incomplete frame is
+ * not counted.
+ *
+ * Histograms of frames are shared by three indicators, so they are built once
+ * by preprocessor for frames aligned to the start of data. Indicator uses them
+ * when no part of frame is pending, otherwise it builds histograms itself.
+ */
+
+#define FRAME_SIZE 4096
+#define WINDOW     4     /* frames compared with the current one by motion indicator */
+#define PAGE_SIZE  4096
+
+/* Histogram of frame built by preprocessor, counts of frame fit in 16 bits */
+typedef uint16_t frame_hist_t[256];
+
+/* Derived histogram is NULL if frame was not preprocessed */
+typedef void (*frame_func_t)(indicator_ctx_t *ctx, const uint8_t *frame, const uint16_t *derived);
+
+/**
+ * Indicator context
+ *
+ * Frame assembly is common, state of every indicator is in union.
+ */
+struct indicator_ctx {
+    /** Frames processed by the indicator */
+    uint64_t frames;
+    /** Current value of the indicator */
+    uint64_t value;
+    /** Bytes of frame split between calls */
+    size_t   pending_size;
+    uint8_t  pending[FRAME_SIZE];
+    union {
+        /** Motion: the last frames, frame N is in window[N % WINDOW] */
+        uint8_t  window[WINDOW][FRAME_SIZE];
+        /** Scene change: histogram of the previous frame */
+        uint64_t hist[256];
+    } state;
+};
+
+/* Split data to whole frames, frame split between calls is collected in ctx */
+static void process_frames(const indicator_arg_t *arg, frame_func_t func)
+{
+    size_t part;
+    indicator_ctx_t *ctx = arg->ctx;
+    const uint8_t *data = arg->data;
+    size_t size = arg->size;
+    const frame_hist_t *derived = NULL;
+
+    if (ctx->pending_size == 0 && arg->derived != NULL &&
+        arg->derived_size >= size / FRAME_SIZE * sizeof(frame_hist_t))
+    {
+        derived = (const frame_hist_t *)(const void *)arg->derived;
+    }
+
+    if (ctx->pending_size != 0)
+    {
+        part = FRAME_SIZE - ctx->pending_size;
+        part = (size < part) ? size : part;
+        memcpy(ctx->pending + ctx->pending_size, data, part);
+        ctx->pending_size += part;
+        data += part;
+        size -= part;
+        if (ctx->pending_size < FRAME_SIZE)
+        {
+            return;
+        }
+        func(ctx, ctx->pending, NULL);
+        ctx->frames++;
+        ctx->pending_size = 0;
+    }
+    for (; size >= FRAME_SIZE; data += FRAME_SIZE, size -= FRAME_SIZE)
+    {
+        func(ctx, data, (derived != NULL) ? *derived++ : NULL);
+        ctx->frames++;
+    }
+    memcpy(ctx->pending, data, size);
+    ctx->pending_size = size;
+}
+
+/* Histogram of frame from preprocessor or built from frame */
+static void frame_histogram(const uint8_t *frame, const uint16_t *derived, uint64_t hist[256])
+{
+    size_t i;
+
+    if (derived != NULL)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            hist[i] = derived[i];
+        }
+        return;
+    }
+    memset(hist, 0x00, sizeof(uint64_t) * 256);
+    kernels_histogram(frame, FRAME_SIZE, hist);
+}
+
+/* Sum of absolute differences with every of WINDOW previous frames */
+static void motion_frame(indicator_ctx_t *ctx, const uint8_t *frame, const uint16_t *derived)
+{
+    uint64_t i;
+    uint64_t previous = (ctx->frames < WINDOW) ? ctx->frames : WINDOW;
+
+    for (i = 1; i <= previous; i++)
+    {
+        ctx->value += kernels_abs_diff_sum(frame, ctx->state.window[(ctx->frames - i) % WINDOW], FRAME_SIZE);
+    }
+    memcpy(ctx->state.window[ctx->frames % WINDOW], frame, FRAME_SIZE);
+    (void)derived;
+}
+
+/* L1 distance between histograms of neighbour frames */
+static void scene_change_frame(indicator_ctx_t *ctx, const uint8_t *frame, const uint16_t *derived)
+{
+    size_t i;
+    uint64_t hist[256];
+
+    frame_histogram(frame, derived, hist);
+    if (ctx->frames != 0)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            uint64_t previous = ctx->state.hist[i];
+            ctx->value += (hist[i] > previous) ? hist[i] - previous : previous - hist[i];
+        }
+    }
+    memcpy(ctx->state.hist, hist, sizeof(hist));
+}
+
+/* Shannon entropy of bytes of frame in millibits per byte */
+static void entropy_frame(indicator_ctx_t *ctx, const uint8_t *frame, const uint16_t *derived)
+{
+    size_t i;
+    uint64_t hist[256];
+    double entropy = 0.0;
+
+    frame_histogram(frame, derived, hist);
+    for (i = 0; i < 256; i++)
+    {
+        if (hist[i] != 0)
+        {
+            double p = (double)hist[i] / FRAME_SIZE;
+            entropy -= p * log2(p);
+        }
+    }
+    ctx->value += (uint64_t)llround(entropy * 1000.0);
+}
+
+/* Range of bytes of frame with count of bright bytes */
+static void contrast_frame(indicator_ctx_t *ctx, const uint8_t *frame, const uint16_t *derived)
+{
+    size_t i, min, max;
+    uint64_t above = 0;
+
+    if (derived == NULL)
+    {
+        uint8_t frame_min, frame_max;
+        kernels_min_max(frame, FRAME_SIZE, &frame_min, &frame_max);
+        ctx->value += (uint64_t)(frame_max - frame_min) + kernels_count_above(frame, FRAME_SIZE, 200);
+        return;
+    }
+    /* frame is not empty, so both loops stop on a byte of frame */
+    for (min = 0; derived[min] == 0; min++);
+    for (max = 255; derived[max] == 0; max--);
+    for (i = 201; i < 256; i++)
+    {
+        above += derived[i];
+    }
+    ctx->value += (uint64_t)(max - min) + above;
+}
+
+static void motion(indicator_arg_t *arg)
+{
+    process_frames(arg, motion_frame);
+}
+
+static void scene_change(indicator_arg_t *arg)
+{
+    process_frames(arg, scene_change_frame);
+}
+
+static void entropy(indicator_arg_t *arg)
+{
+    process_frames(arg, entropy_frame);
+}
+
+static void contrast(indicator_arg_t *arg)
+{
+    process_frames(arg, contrast_frame);
+}
+
+static size_t preprocess_size(size_t size)
+{
+    return size / FRAME_SIZE * sizeof(frame_hist_t);
+}
+
+/* Histograms of whole frames from the start of data */
+static size_t preprocess(const uint8_t *data, size_t size, uint8_t *derived, indicator_scratch_t *scratch)
+{
+    size_t i;
+    uint64_t hist[256];
+    frame_hist_t *out = (frame_hist_t *)(void *)derived;
+
+    for (; size >= FRAME_SIZE; data += FRAME_SIZE, size -= FRAME_SIZE, out++)
+    {
+        memset(hist, 0x00, sizeof(hist));
+        kernels_histogram(data, FRAME_SIZE, hist);
+        for (i = 0; i < 256; i++)
+        {
+            (*out)[i] = (uint16_t)hist[i];
+        }
+    }
+    (void)scratch;
+    return (size_t)((uint8_t *)out - derived);
+}
+
+static const indicators_preprocessor_t preprocessor = {&preprocess_size, &preprocess};
+
+/* Contexts are allocated by the server, allocator is kept for tools which do not support layouts */
+static indicator_ctx_t *indicator_alloc(void)
+{
+    void *ctx;
+    return (posix_memalign(&ctx, PAGE_SIZE, sizeof(indicator_ctx_t)) == 0) ? ctx : NULL;
+}
+
+static void indicator_free(indicator_ctx_t *ctx)
+{
+    free(ctx);
+}
+
+static void indicator_init(indicator_ctx_t *ctx)
+{
+    /* frames of window are written before they are read */
+    memset(ctx, 0x00, offsetof(indicator_ctx_t, state));
+    memset(&ctx->state.hist, 0x00, sizeof(ctx->state.hist));
+}
+
+static uint64_t indicator_extract(const indicator_ctx_t *ctx)
+{
+    return ctx->value;
+}
+
+static indicators_handlers_t indicators_handlers[] =
+{
+    {&indicator_alloc, &indicator_init, &indicator_free, &motion,       &indicator_extract},
+    {&indicator_alloc, &indicator_init, &indicator_free, &scene_change, &indicator_extract},
+    {&indicator_alloc, &indicator_init, &indicator_free, &entropy,      &indicator_extract},
+    {&indicator_alloc, &indicator_init, &indicator_free, &contrast,     &indicator_extract},
+};
+
+/* Every context has own pages */
+static const indicator_ctx_layout_t ctx_layouts[] =
+{
+    {sizeof(indicator_ctx_t), PAGE_SIZE},
+    {sizeof(indicator_ctx_t), PAGE_SIZE},
+    {sizeof(indicator_ctx_t), PAGE_SIZE},
+    {sizeof(indicator_ctx_t), PAGE_SIZE},
+};
+
+indicators_handlers_t *get_indicators_handlers(void)
+{
+    return indicators_handlers;
+}
+
+size_t get_indicators_count(void)
+{
+    return sizeof(indicators_handlers)/sizeof(indicators_handlers[0]);
+}
+
+const indicator_ctx_layout_t *get_indicators_ctx_layouts(void)
+{
+    return ctx_layouts;
+}
+
+const indicators_preprocessor_t *get_indicators_preprocessor(void)
+{
+    return &preprocessor;
+}
@@ -0,0 +1,50 @@
+#include <stdatomic.h>
+
+#include "log.h"
+#include "admission.h"
+
+static atomic_size_t max_inflight = 0;
+static atomic_size_t inflight = 0;
+
+void admission_init(size_t max_inflight_bytes)
+{
+    atomic_store(&max_inflight, max_inflight_bytes);
+    atomic_store(&inflight, 0);
+}
+
+void admission_set_limit(size_t max_inflight_bytes)
+{
+    /* admitted sessions are not dropped, new ones wait till they fit */
+    atomic_store(&max_inflight, max_inflight_bytes);
+}
+
+size_t admission_get_limit(void)
+{
+    return atomic_load(&max_inflight);
+}
+
+bool admission_acquire(size_t file_size)
+{
+    size_t current = atomic_load(&inflight);
+    do
+    {
+        if (current + file_size > atomic_load(&max_inflight))
+        {
+            logger(DEBUG, "In-flight bytes limit is reached (%lu + %lu > %lu)", current, file_size,
+                   atomic_load(&max_inflight));
+            return false;
+        }
+    }
+    while (!atomic_compare_exchange_weak(&inflight, &current, current + file_size));
+    return true;
+}
+
+void admission_release(size_t file_size)
+{
+    atomic_fetch_sub(&inflight, file_size);
+}
+
+size_t admission_get_inflight_bytes(void)
+{
+    return atomic_load(&inflight);
+}
@@ -0,0 +1,27 @@
+#ifndef ADMISSION_H_
+#define ADMISSION_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Init admission controller
+ *
+ * @param[in]   max_inflight_bytes  limit for sum of files sizes of admitted sessions.
+ */
+void admission_init(size_t max_inflight_bytes);
+/* Change limit at runtime */
+void admission_set_limit(size_t max_inflight_bytes);
+size_t admission_get_limit(void);
+
+/**
+ * Admit session with file of given size
+ *
+ * @returns     true if file fits into in-flight limit, it must be released by
+ *              admission_release() after session finished.
+ */
+bool admission_acquire(size_t file_size);
+void admission_release(size_t file_size);
+size_t admission_get_inflight_bytes(void);
+
+#endif /* ADMISSION_H_ */
@@ -0,0 +1,244 @@
+#define _GNU_SOURCE /* cpu_set_t, sched_getcpu() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "log.h"
+#include "affinity.h"
+
+#define NODES_DIR "/sys/devices/system/node"
+#define MAX_NODES 64
+#define MPOL_PREFERRED 1 /* from linux/mempolicy.h, libnuma is not required */
+
+static int cpu_nodes[CPU_SETSIZE];       /* node of every CPU */
+static cpu_set_t node_cpus[MAX_NODES];
+static size_t nodes_count = 1;           /* nodes of host */
+static int slot_nodes[MAX_NODES];        /* nodes with worker CPUs, slots are spread over them */
+static size_t slot_nodes_count = 1;
+static cpu_set_t worker_set;
+static cpu_set_t io_set;
+static bool worker_pinned = false;
+static bool io_pinned = false;
+
+/* Parse list of CPUs like "0-3,8,10-11" */
+static int parse_cpus(const char *list, cpu_set_t *set)
+{
+    const char *ptr = list;
+    char *end;
+
+    CPU_ZERO(set);
+    while (*ptr != '\0' && *ptr != '\n')
+    {
+        unsigned long first, last;
+        if (!isdigit((unsigned char)*ptr))
+        {
+            return -1;
+        }
+        first = last = strtoul(ptr, &end, 10);
+        if (*end == '-')
+        {
+            if (!isdigit((unsigned char)end[1]))
+            {
+                return -1;
+            }
+            last = strtoul(end + 1, &end, 10);
+        }
+        if (last < first || last >= CPU_SETSIZE)
+        {
+            return -1;
+        }
+        for (; first <= last; first++)
+        {
+            CPU_SET(first, set);
+        }
+        if (*end == ',')
+        {
+            end++;
+        }
+        ptr = end;
+    }
+    return (CPU_COUNT(set) != 0) ? 0 : -1;
+}
+
+/* Nodes and their CPUs from sysfs, host without the directory is one node */
+static void read_topology(void)
+{
+    char path[64];
+    char list[1024];
+    size_t node;
+    int cpu;
+
+    memset(cpu_nodes, 0x00, sizeof(cpu_nodes));
+    nodes_count = 0;
+    for (node = 0; node < MAX_NODES; node++)
+    {
+        FILE *file;
+        snprintf(path, sizeof(path), NODES_DIR "/node%lu/cpulist", node);
+        file = fopen(path, "r");
+        if (file == NULL)
+        {
+            continue;
+        }
+        if (fgets(list, sizeof(list), file) != NULL && parse_cpus(list, &node_cpus[node]) == 0)
+        {
+            for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &node_cpus[node]))
+                {
+                    cpu_nodes[cpu] = (int)node;
+                }
+            }
+            nodes_count = node + 1;
+        }
+        fclose(file);
+    }
+    if (nodes_count == 0)
+    {
+        nodes_count = 1;
+        CPU_ZERO(&node_cpus[0]);
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, &node_cpus[0]);
+        }
+    }
+}
+
+int affinity_init(const char *worker_cpus, const char *io_cpus)
+{
+    size_t node;
+    cpu_set_t both;
+
+    if (worker_cpus != NULL && parse_cpus(worker_cpus, &worker_set) != 0)
+    {
+        logger(ERROR, "Bad list of worker CPUs %s", worker_cpus);
+        return -1;
+    }
+    if (io_cpus != NULL && parse_cpus(io_cpus, &io_set) != 0)
+    {
+        logger(ERROR, "Bad list of I/O CPUs %s", io_cpus);
+        return -1;
+    }
+    worker_pinned = worker_cpus != NULL;
+    io_pinned     = io_cpus != NULL;
+    read_topology();
+
+    slot_nodes_count = 0;
+    for (node = 0; node < nodes_count; node++)
+    {
+        CPU_AND(&both, &node_cpus[node], &worker_set);
+        if (CPU_COUNT(&node_cpus[node]) != 0 && (!worker_pinned || CPU_COUNT(&both) != 0))
+        {
+            slot_nodes[slot_nodes_count++] = (int)node;
+        }
+    }
+    if (slot_nodes_count == 0)
+    {
+        slot_nodes[slot_nodes_count++] = 0;
+    }
+    if (nodes_count > 1)
+    {
+        logger(INFO, "NUMA host with %lu nodes, sessions are placed on %lu of them", nodes_count, slot_nodes_count);
+    }
+    return 0;
+}
+
+int affinity_get_slot_node(size_t slot)
+{
+    return (nodes_count > 1) ? slot_nodes[slot % slot_nodes_count] : -1;
+}
+
+/* Configured CPUs of node, or all configured if node has none of them */
+static void bind_thread(int node, bool pinned, const cpu_set_t *configured)
+{
+    cpu_set_t set;
+    int ret;
+
+    if (node >= 0 && nodes_count > 1)
+    {
+        if (pinned)
+        {
+            CPU_AND(&set, &node_cpus[node], configured);
+        }
+        else
+        {
+            memcpy(&set, &node_cpus[node], sizeof(set));
+        }
+        if (CPU_COUNT(&set) == 0)
+        {
+            memcpy(&set, configured, sizeof(set));
+        }
+    }
+    else if (pinned)
+    {
+        memcpy(&set, configured, sizeof(set));
+    }
+    else
+    {
+        return;
+    }
+    if (CPU_COUNT(&set) == 0)
+    {
+        return;
+    }
+    ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0)
+    {
+        logger(ERROR, "Can not set CPU affinity (%d:%s)", ret, strerror(ret));
+    }
+}
+
+void affinity_bind_worker(int node)
+{
+    bind_thread(node, worker_pinned, &worker_set);
+}
+
+void affinity_bind_io(int node)
+{
+    bind_thread(node, io_pinned, &io_set);
+}
+
+int affinity_get_current_node(void)
+{
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        return -1;
+    }
+    return cpu_nodes[cpu];
+}
+
+void *affinity_alloc(size_t size, int node)
+{
+    unsigned long mask;
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return NULL;
+    }
+    if (node >= 0 && nodes_count > 1)
+    {
+        mask = 1UL << node;
+        /* pages are not touched yet, they are allocated on node by the first write */
+        if (syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0) != 0)
+        {
+            logger(DEBUG, "Can not bind memory to node %d (%d:%s)", node, errno, strerror(errno));
+        }
+    }
+    return ptr;
+}
+
+void affinity_free(void *ptr, size_t size)
+{
+    if (ptr != NULL)
+    {
+        munmap(ptr, size);
+    }
+}
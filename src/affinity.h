@@ -0,0 +1,45 @@
+#ifndef AFFINITY_H_
+#define AFFINITY_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * CPU affinity and NUMA placement
+ *
+ * Workers of thread pools and I/O threads (accepting and session threads) are
+ * bound to configured CPUs. On hosts with several NUMA nodes every session slot
+ * has home node, its session thread, lanes and receive buffer are placed there,
+ * so indicators read buffers from local memory.
+ */
+
+/**
+ * Read topology and configure CPUs
+ *
+ * @param[in]   worker_cpus     CPUs of pool workers, list like "0-7,16", NULL - all.
+ * @param[in]   io_cpus         CPUs of I/O threads, NULL - all.
+ * @returns     Zero if success
+ */
+int affinity_init(const char *worker_cpus, const char *io_cpus);
+
+/* Home node of session slot */
+int affinity_get_slot_node(size_t slot);
+
+/* Bind calling pool worker to worker CPUs of node, -1 - of all nodes */
+void affinity_bind_worker(int node);
+/* Bind calling I/O thread to I/O CPUs of node, -1 - of all nodes */
+void affinity_bind_io(int node);
+
+/* Node of CPU which runs calling thread, -1 if unknown */
+int affinity_get_current_node(void);
+
+/*
+ * Memory of node
+ *
+ * Pages are preferred on node, other nodes are used if it has no free memory.
+ * Without NUMA it is plain anonymous mapping.
+ */
+void *affinity_alloc(size_t size, int node);
+void affinity_free(void *ptr, size_t size);
+
+#endif /* AFFINITY_H_ */
@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "dash_cam.h"
+#include "indicators.h"
+#include "indicators_lib.h"
+#include "log.h"
+#include "timer.h"
+#include "threadpool.h"
+#include "scratch.h"
+#include "batch.h"
+
+#define BATCH_FILES_PER_THREAD 2 /* mapped files in flight, limits address space and page cache */
+
+typedef struct batch_file_s {
+    char          *path;
+    void          *map;
+    size_t         map_size;
+    const uint8_t *data;      /* payload in mapping */
+    size_t         size;
+    uint64_t       number;    /* owner of scratch arenas */
+    uint64_t       start_us;
+    atomic_size_t  pending;   /* indicators which are not finished */
+    uint64_t      *values;
+    uint8_t       *derived;   /* output of preprocessor, NULL - not preprocessed */
+    size_t         derived_size;
+} batch_file_t;
+
+typedef struct batch_task_s {
+    batch_file_t *file;
+    size_t        index;
+} batch_task_t;
+
+typedef struct batch_state_s {
+    indicators_lib_t      *lib;
+    thread_pool_t         *pool;
+    size_t                 count;
+    uint64_t               files;     /* files passed to pool */
+    batch_format_t         format;
+    FILE                  *out;
+    pthread_mutex_t        out_lock;
+    sem_t                  slots;     /* free places for mapped files */
+    atomic_size_t          failed;
+} batch_state_t;
+
+static batch_state_t state;
+
+static void write_escaped(FILE *out, const char *str, batch_format_t format)
+{
+    for (; *str != '\0'; str++)
+    {
+        if (*str == '"' || (format == BATCH_FORMAT_JSON && *str == '\\'))
+        {
+            /* CSV doubles quotes, JSON escapes them */
+            fputc((format == BATCH_FORMAT_CSV) ? '"' : '\\', out);
+        }
+        fputc(*str, out);
+    }
+}
+
+static void write_header(void)
+{
+    size_t i;
+    if (state.format != BATCH_FORMAT_CSV)
+    {
+        return;
+    }
+    fprintf(state.out, "file,size,ms");
+    for (i = 0; i < state.count; i++)
+    {
+        fprintf(state.out, ",indicator_%lu", i);
+    }
+    fprintf(state.out, "\n");
+}
+
+static void write_result(const batch_file_t *file)
+{
+    size_t i;
+    double ms = (double)(timer_get_monotonic_us() - file->start_us) / 1000.0;
+
+    pthread_mutex_lock(&state.out_lock);
+    if (state.format == BATCH_FORMAT_JSON)
+    {
+        fprintf(state.out, "{\"file\":\"");
+        write_escaped(state.out, file->path, state.format);
+        fprintf(state.out, "\",\"size\":%lu,\"ms\":%.3f,\"values\":[", file->size, ms);
+        for (i = 0; i < state.count; i++)
+        {
+            fprintf(state.out, "%s%lu", (i == 0) ? "" : ",", file->values[i]);
+        }
+        fprintf(state.out, "]}\n");
+    }
+    else
+    {
+        fprintf(state.out, "\"");
+        write_escaped(state.out, file->path, state.format);
+        fprintf(state.out, "\",%lu,%.3f", file->size, ms);
+        for (i = 0; i < state.count; i++)
+        {
+            fprintf(state.out, ",%lu", file->values[i]);
+        }
+        fprintf(state.out, "\n");
+    }
+    pthread_mutex_unlock(&state.out_lock);
+}
+
+static void free_file(batch_file_t *file)
+{
+    if (file->map != NULL)
+    {
+        munmap(file->map, file->map_size);
+    }
+    free(file->values);
+    free(file->derived);
+    free(file->path);
+    free(file);
+}
+
+/* The last indicator of file writes results */
+static void finish_indicators(batch_file_t *file, size_t count)
+{
+    if (atomic_fetch_sub(&file->pending, count) == count)
+    {
+        write_result(file);
+        free_file(file);
+        sem_post(&state.slots);
+    }
+}
+
+static void *batch_task_handler(void *arg)
+{
+    batch_task_t *task = arg;
+    batch_file_t *file = task->file;
+    indicators_handlers_t *handler = &state.lib->handlers[task->index];
+    indicator_ctx_t *ctx = indicators_lib_ctx_alloc(state.lib, task->index);
+
+    if (ctx == NULL)
+    {
+        logger(ERROR, "Can not allocate ctx of indicator %lu", task->index);
+        atomic_fetch_add(&state.failed, 1);
+    }
+    else
+    {
+        /* mapping is not copied, indicator reads page cache */
+        indicator_arg_t indicator_arg = {
+            .ctx  = ctx,
+            .data = file->data,
+            .size = file->size,
+            .scratch = scratch_get(file->number),
+            .derived = file->derived,
+            .derived_size = file->derived_size,
+        };
+        handler->ctx_initializer(ctx);
+        handler->indicator(&indicator_arg);
+        file->values[task->index] = handler->extract(ctx);
+        indicators_lib_ctx_free(state.lib, task->index, ctx);
+    }
+
+    finish_indicators(file, 1);
+    return NULL;
+}
+
+/* Retained spool file is a whole message, only payload is processed */
+static void skip_message_header(batch_file_t *file)
+{
+    messageHeader_t header;
+
+    if (file->size <= sizeof(header))
+    {
+        return;
+    }
+    memcpy(&header, file->data, sizeof(header));
+    if (ntohl(header.magic) == HEADER_MAGIC && ntohl(header.version) == HEADER_VERSION &&
+        (size_t)ntohl(header.size) == file->size - sizeof(header))
+    {
+        file->data += sizeof(header);
+        file->size -= sizeof(header);
+    }
+}
+
+static batch_file_t *map_file(const char *path)
+{
+    struct stat st;
+    void *data;
+    batch_file_t *file;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1 || fstat(fd, &st) != 0)
+    {
+        logger(ERROR, "Can not open %s (%d:%s)", path, errno, strerror(errno));
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return NULL;
+    }
+    if (st.st_size == 0)
+    {
+        logger(ERROR, "File %s is empty", path);
+        close(fd);
+        return NULL;
+    }
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        logger(ERROR, "Can not map %s (%d:%s)", path, errno, strerror(errno));
+        return NULL;
+    }
+    /* read-ahead while tasks are waiting in queue */
+    madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+
+    file = calloc(1, sizeof(*file));
+    if (file == NULL)
+    {
+        munmap(data, (size_t)st.st_size);
+        return NULL;
+    }
+    file->map      = data;
+    file->map_size = (size_t)st.st_size;
+    file->data     = data;
+    file->size     = (size_t)st.st_size;
+    skip_message_header(file);
+    file->path   = strdup(path);
+    file->values = calloc(sizeof(*file->values), state.count);
+    if (file->path == NULL || file->values == NULL)
+    {
+        free_file(file);
+        return NULL;
+    }
+    return file;
+}
+
+static void dispatch_file(batch_file_t *file)
+{
+    size_t i;
+    for (i = 0; i < state.count; i++)
+    {
+        batch_task_t *task = malloc(sizeof(*task));
+        if (task == NULL)
+        {
+            /* indicators which are not queued are finished without values */
+            logger(ERROR, "Can't alloc memory for batch task of %s", file->path);
+            atomic_fetch_add(&state.failed, 1);
+            finish_indicators(file, state.count - i);
+            return;
+        }
+        task->file  = file;
+        task->index = i;
+        thread_pool_add_task(state.pool, batch_task_handler, task, 0);
+    }
+}
+
+/* Preparation shared by indicators is done once, then indicators of file are queued */
+static void *batch_preprocess_handler(void *arg)
+{
+    batch_task_t *task = arg;
+    batch_file_t *file = task->file;
+
+    file->derived = indicators_lib_preprocess(state.lib, file->data, file->size, scratch_get(file->number),
+                                              &file->derived_size);
+    dispatch_file(file);
+    return NULL;
+}
+
+static int process_file(const char *path, size_t *total_size)
+{
+    batch_file_t *file;
+    batch_task_t *task;
+
+    sem_wait(&state.slots);
+    file = map_file(path);
+    if (file == NULL)
+    {
+        sem_post(&state.slots);
+        return -1;
+    }
+    *total_size += file->size;
+    file->number   = state.files++;
+    file->start_us = timer_get_monotonic_us();
+    atomic_init(&file->pending, state.count);
+    if (state.lib->preprocessor == NULL)
+    {
+        dispatch_file(file);
+        return 0;
+    }
+    task = malloc(sizeof(*task));
+    if (task == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for batch task of %s", path);
+        atomic_fetch_add(&state.failed, 1);
+        free_file(file);
+        sem_post(&state.slots);
+        return -1;
+    }
+    task->file  = file;
+    task->index = 0;
+    thread_pool_add_task(state.pool, batch_preprocess_handler, task, 0);
+    return 0;
+}
+
+static int compare_names(const struct dirent **a, const struct dirent **b)
+{
+    return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+static int process_path(const char *path, size_t *files_count, size_t *total_size)
+{
+    int i, count;
+    int ret = 0;
+    struct stat st;
+    struct dirent **entries;
+
+    if (stat(path, &st) != 0)
+    {
+        logger(ERROR, "Can not find %s (%d:%s)", path, errno, strerror(errno));
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        (*files_count)++;
+        return process_file(path, total_size);
+    }
+
+    count = scandir(path, &entries, NULL, compare_names);
+    if (count < 0)
+    {
+        logger(ERROR, "Can not read directory %s (%d:%s)", path, errno, strerror(errno));
+        return -1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        char file_path[PATH_MAX];
+        snprintf(file_path, sizeof(file_path), "%s/%s", path, entries[i]->d_name);
+        if (entries[i]->d_name[0] != '.' && stat(file_path, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            (*files_count)++;
+            ret |= process_file(file_path, total_size);
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return ret;
+}
+
+int batch_run(const batch_options_t *options)
+{
+    int ret = -1;
+    size_t i;
+    size_t files_count = 0, total_size = 0;
+    size_t slots;
+    uint64_t start_us;
+    double seconds;
+    thread_pool_lane_conf_t lane;
+    indicators_lib_t *lib = indicators_lib_acquire();
+
+    if (lib == NULL)
+    {
+        logger(ERROR, "Indicators library is not loaded");
+        return -1;
+    }
+    memset(&state, 0x00, sizeof(state));
+    state.lib      = lib;
+    state.count    = lib->count;
+    state.format   = options->format;
+    atomic_init(&state.failed, 0);
+
+    lane.size = (options->threads != 0) ? options->threads : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    lane.node = -1;
+    slots = lane.size * BATCH_FILES_PER_THREAD;
+    state.out = (options->output != NULL) ? fopen(options->output, "w") : stdout;
+    if (state.out == NULL)
+    {
+        logger(ERROR, "Can not open %s (%d:%s)", options->output, errno, strerror(errno));
+        indicators_lib_release(lib);
+        return -1;
+    }
+    pthread_mutex_init(&state.out_lock, NULL);
+    sem_init(&state.slots, 0, (unsigned)slots);
+
+    /* one lane, every task has own ctx, so any worker could take it */
+    state.pool = thread_pool_create(&lane, 1);
+    if (state.pool == NULL)
+    {
+        logger(ERROR, "Error while initializing thread pool");
+        goto exit;
+    }
+    logger(INFO, "Batch processing with %lu workers", lane.size);
+
+    write_header();
+    start_us = timer_get_monotonic_us();
+    ret = 0;
+    for (i = 0; i < options->paths_count; i++)
+    {
+        ret |= process_path(options->paths[i], &files_count, &total_size);
+    }
+    /* all slots are free when the last file is written */
+    for (i = 0; i < slots; i++)
+    {
+        sem_wait(&state.slots);
+    }
+    seconds = (double)(timer_get_monotonic_us() - start_us) / 1000000.0;
+    logger(INFO, "Batch processed %lu files, %lu bytes in %.3f s, %.2f MB/s", files_count, total_size, seconds,
+           (double)total_size / seconds / 1000000.0);
+    if (ret != 0 || atomic_load(&state.failed) != 0)
+    {
+        ret = -1;
+    }
+
+exit:
+    if (state.pool != NULL)
+    {
+        thread_pool_destroy(state.pool);
+    }
+    fflush(state.out);
+    if (state.out != stdout)
+    {
+        fclose(state.out);
+    }
+    sem_destroy(&state.slots);
+    pthread_mutex_destroy(&state.out_lock);
+    indicators_lib_release(lib);
+    return ret;
+}
@@ -0,0 +1,30 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stddef.h>
+
+typedef enum batch_format_e {
+    BATCH_FORMAT_CSV = 0,
+    BATCH_FORMAT_JSON,
+} batch_format_t;
+
+typedef struct batch_options_s {
+    char          **paths;       /* files or directories with files */
+    size_t          paths_count;
+    const char     *output;      /* file for results, NULL - stdout */
+    batch_format_t  format;
+    size_t          threads;     /* workers for indicators, 0 - all cores */
+} batch_options_t;
+
+/**
+ * Process footage files without network
+ *
+ * Files are mapped to memory and every indicator of every file is a task for
+ * thread pool. Results are written in order of completion, one line per file.
+ *
+ * @param[in]   options     batch options.
+ * @returns     Zero if all files are processed
+ */
+int batch_run(const batch_options_t *options);
+
+#endif /* BATCH_H_ */
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#include "log.h"
+#include "timer.h"
+#include "protocol.h"
+#include "server_utils.h"
+#include "cluster.h"
+
+#define LISTEN_BACKLOG 64
+#define PING_INTERVAL 1000 /* in milliseconds */
+#define UNHEALTHY_TIMEOUT 3000 /* in milliseconds without reports, worker is not chosen */
+#define HUNG_TIMEOUT 10000 /* in milliseconds without reports, worker is killed */
+#define RESTART_DELAY 1000 /* in milliseconds, between restarts of the same worker */
+#define BUSY_RETRY_AFTER 1 /* in seconds, when no worker is healthy */
+
+typedef struct worker_s {
+    size_t   id;
+    pid_t    pid;           /* -1 if not running */
+    int      channel;       /* -1 if not running */
+    uint64_t started_ms;
+    uint64_t report_ms;     /* time of the last load report */
+    uint64_t sent;          /* connections passed to worker */
+    cluster_message_t load; /* the last load report */
+} worker_t;
+
+static volatile sig_atomic_t cluster_running = 1;
+static volatile sig_atomic_t reload_requested = 0;
+
+void cluster_exit(void)
+{
+    cluster_running = 0;
+}
+
+void cluster_request_reload(void)
+{
+    reload_requested = 1;
+}
+
+/* Workers load indicators library themselves, coordinator only passes the request */
+static void reload_workers(worker_t *workers, size_t count)
+{
+    size_t i;
+    reload_requested = 0;
+    logger(INFO, "Reload of indicators library is requested");
+    for (i = 0; i < count; i++)
+    {
+        if (workers[i].pid != -1)
+        {
+            kill(workers[i].pid, SIGUSR2);
+        }
+    }
+}
+
+int cluster_send(int channel, const cluster_message_t *msg, int fd)
+{
+    struct iovec iov = {.iov_base = (void *)msg, .iov_len = sizeof(*msg)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr hdr = {.msg_iov = &iov, .msg_iovlen = 1};
+    ssize_t ret;
+
+    if (fd != -1)
+    {
+        struct cmsghdr *cmsg;
+        memset(&control, 0x00, sizeof(control));
+        hdr.msg_control    = control.buf;
+        hdr.msg_controllen = sizeof(control.buf);
+        cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    do
+    {
+        ret = sendmsg(channel, &hdr, MSG_NOSIGNAL);
+    } while (ret == -1 && errno == EINTR);
+    return (ret == (ssize_t)sizeof(*msg)) ? 0 : -1;
+}
+
+int cluster_recv(int channel, cluster_message_t *msg, int *fd)
+{
+    struct iovec iov = {.iov_base = msg, .iov_len = sizeof(*msg)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr hdr = {.msg_iov = &iov, .msg_iovlen = 1,
+                         .msg_control = control.buf, .msg_controllen = sizeof(control.buf)};
+    struct cmsghdr *cmsg;
+    ssize_t ret;
+
+    *fd = -1;
+    do
+    {
+        ret = recvmsg(channel, &hdr, MSG_CMSG_CLOEXEC);
+    } while (ret == -1 && errno == EINTR);
+    if (ret <= 0)
+    {
+        return (int)ret;
+    }
+    for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (ret != (ssize_t)sizeof(*msg))
+    {
+        logger(ERROR, "Wrong size of control message %ld", ret);
+        if (*fd != -1)
+        {
+            close(*fd);
+            *fd = -1;
+        }
+        return -1;
+    }
+    return (int)ret;
+}
+
+/* Start worker as the same binary with the same arguments and control socket */
+static int start_worker(worker_t *worker, const server_options_t *options, int argc, char **argv)
+{
+    int fds[2];
+    pid_t pid;
+    char fd_arg[32], metrics_arg[32];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0)
+    {
+        logger(ERROR, "Can not create control socket (%d:%s)", errno, strerror(errno));
+        return -1;
+    }
+    pid = fork();
+    if (pid == -1)
+    {
+        logger(ERROR, "Can not start worker (%d:%s)", errno, strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        int i;
+        char **args = calloc((size_t)argc + 3, sizeof(*args));
+        sigset_t set;
+
+        if (args == NULL)
+        {
+            _exit(EXIT_FAILURE);
+        }
+        /* control socket is the only fd inherited by worker */
+        fcntl(fds[1], F_SETFD, 0);
+        for (i = 0; i < argc; i++)
+        {
+            args[i] = argv[i];
+        }
+        snprintf(fd_arg, sizeof(fd_arg), "--worker-fd=%d", fds[1]);
+        args[i++] = fd_arg;
+        if (options->metrics_port != 0)
+        {
+            /* the last option wins, every worker serves metrics on its own port */
+            snprintf(metrics_arg, sizeof(metrics_arg), "--metrics-port=%lu",
+                     (size_t)options->metrics_port + 1 + worker->id);
+            args[i++] = metrics_arg;
+        }
+        sigemptyset(&set);
+        sigprocmask(SIG_SETMASK, &set, NULL);
+        execv("/proc/self/exe", args);
+        _exit(EXIT_FAILURE);
+    }
+    close(fds[1]);
+    worker->pid        = pid;
+    worker->channel    = fds[0];
+    worker->started_ms = timer_get_monotonic_ms();
+    worker->report_ms  = worker->started_ms;
+    memset(&worker->load, 0x00, sizeof(worker->load));
+    logger(INFO, "Worker %lu is started (pid %d)", worker->id, pid);
+    return 0;
+}
+
+static void stop_worker(worker_t *worker, int sig)
+{
+    if (worker->channel != -1)
+    {
+        close(worker->channel);
+        worker->channel = -1;
+    }
+    if (worker->pid != -1)
+    {
+        kill(worker->pid, sig);
+    }
+}
+
+static void reap_workers(worker_t *workers, size_t count)
+{
+    size_t i;
+    int status;
+    pid_t pid;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (workers[i].pid != pid)
+            {
+                continue;
+            }
+            logger(cluster_running ? ERROR : INFO, "Worker %lu (pid %d) exited with status %d", i, pid,
+                   WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status));
+            workers[i].pid = -1;
+            if (workers[i].channel != -1)
+            {
+                close(workers[i].channel);
+                workers[i].channel = -1;
+            }
+        }
+    }
+}
+
+static bool worker_healthy(const worker_t *worker, uint64_t now)
+{
+    return worker->channel != -1 && now - worker->report_ms < UNHEALTHY_TIMEOUT;
+}
+
+/*
+ * Choose worker with the lowest load
+ *
+ * Connections passed after the last report are added to reported sessions,
+ * so burst of connections is spread before workers report again.
+ */
+static worker_t *choose_worker(worker_t *workers, size_t count, uint64_t now)
+{
+    size_t i;
+    worker_t *best = NULL;
+    double best_load = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        worker_t *worker = &workers[i];
+        uint64_t unreported = worker->sent - worker->load.connections;
+        double load;
+
+        if (!worker_healthy(worker, now))
+        {
+            continue;
+        }
+        load = (double)(worker->load.active_sessions + unreported) /
+               (double)((worker->load.max_sessions != 0) ? worker->load.max_sessions : 1) +
+               (double)worker->load.backlog_ms / 1000.0;
+        if (best == NULL || load < best_load)
+        {
+            best = worker;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+static void dispatch_connection(worker_t *workers, size_t count, int fd)
+{
+    uint64_t now = timer_get_monotonic_ms();
+    worker_t *worker = choose_worker(workers, count, now);
+    cluster_message_t msg = {.type = CLUSTER_CONNECTION};
+    messageHeader_t header;
+
+    if (worker != NULL && cluster_send(worker->channel, &msg, fd) == 0)
+    {
+        logger(DEBUG, "[fd %d] Connection is passed to worker %lu", fd, worker->id);
+        worker->sent++;
+        close(fd);
+        return;
+    }
+
+    /* client gets the same answer as from overloaded server */
+    protocol_fill_status(&header, MESSAGE_STATUS_BUSY, BUSY_RETRY_AFTER);
+    logger(INFO, "[fd %d] No healthy worker", fd);
+    write_wrapper(fd, &header, sizeof(header));
+    close_connection_gracefully(fd);
+}
+
+static void check_workers(worker_t *workers, size_t count, const server_options_t *options, int argc, char **argv)
+{
+    size_t i;
+    uint64_t now = timer_get_monotonic_ms();
+    cluster_message_t ping = {.type = CLUSTER_PING};
+
+    reap_workers(workers, count);
+    for (i = 0; i < count; i++)
+    {
+        worker_t *worker = &workers[i];
+        if (worker->pid == -1)
+        {
+            if (now - worker->started_ms >= RESTART_DELAY)
+            {
+                worker->sent = 0;
+                start_worker(worker, options, argc, argv);
+            }
+            continue;
+        }
+        if (now - worker->report_ms >= HUNG_TIMEOUT)
+        {
+            logger(ERROR, "Worker %lu did not report for %lu ms, killing it", i, now - worker->report_ms);
+            stop_worker(worker, SIGKILL);
+            continue;
+        }
+        if (worker->channel != -1)
+        {
+            cluster_send(worker->channel, &ping, -1);
+        }
+    }
+}
+
+static void read_reports(worker_t *worker)
+{
+    cluster_message_t msg;
+    int fd;
+    int ret = cluster_recv(worker->channel, &msg, &fd);
+
+    if (fd != -1)
+    {
+        close(fd);
+    }
+    if (ret == 0 || (ret < 0 && errno != EAGAIN))
+    {
+        /* worker exited, it is restarted after reaping */
+        logger(ERROR, "Control channel of worker %lu is closed", worker->id);
+        close(worker->channel);
+        worker->channel = -1;
+        return;
+    }
+    if (ret > 0 && msg.type == CLUSTER_LOAD)
+    {
+        worker->load = msg;
+        worker->report_ms = timer_get_monotonic_ms();
+    }
+}
+
+int cluster_run(const server_options_t *options, size_t workers_count, int argc, char **argv)
+{
+    int ret = -1;
+    size_t i;
+    int server_fd;
+    uint64_t last_check = 0;
+    worker_t *workers = calloc(workers_count, sizeof(*workers));
+    struct pollfd *fds = calloc(workers_count + 1, sizeof(*fds));
+
+    if (workers == NULL || fds == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for workers");
+        goto exit;
+    }
+    server_fd = init_server(options->ip, options->port, LISTEN_BACKLOG);
+    if (server_fd < 0)
+    {
+        logger(ERROR, "Error while create server socket descriptor");
+        goto exit;
+    }
+    /* workers get connections from coordinator only */
+    fcntl(server_fd, F_SETFD, FD_CLOEXEC);
+
+    for (i = 0; i < workers_count; i++)
+    {
+        workers[i].id      = i;
+        workers[i].pid     = -1;
+        workers[i].channel = -1;
+        if (start_worker(&workers[i], options, argc, argv) != 0)
+        {
+            goto stop;
+        }
+    }
+    logger(INFO, "Coordinator of %lu workers, start to polling...", workers_count);
+
+    while (cluster_running)
+    {
+        uint64_t now = timer_get_monotonic_ms();
+        if (now - last_check >= PING_INTERVAL)
+        {
+            check_workers(workers, workers_count, options, argc, argv);
+            last_check = now;
+        }
+        if (reload_requested)
+        {
+            reload_workers(workers, workers_count);
+        }
+
+        fds[0].fd     = server_fd;
+        fds[0].events = POLLIN;
+        for (i = 0; i < workers_count; i++)
+        {
+            fds[i + 1].fd     = workers[i].channel; /* negative fd is ignored */
+            fds[i + 1].events = POLLIN;
+        }
+        if (poll(fds, workers_count + 1, PING_INTERVAL) <= 0)
+        {
+            continue;
+        }
+        for (i = 0; i < workers_count; i++)
+        {
+            if (fds[i + 1].fd != -1 && fds[i + 1].revents != 0)
+            {
+                read_reports(&workers[i]);
+            }
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept_connection(server_fd);
+            if (fd >= 0)
+            {
+                dispatch_connection(workers, workers_count, fd);
+            }
+        }
+    }
+    ret = 0;
+
+stop:
+    /* workers drain their sessions as on signal */
+    for (i = 0; i < workers_count; i++)
+    {
+        stop_worker(&workers[i], SIGTERM);
+    }
+    for (i = 0; i < workers_count; i++)
+    {
+        if (workers[i].pid != -1)
+        {
+            waitpid(workers[i].pid, NULL, 0);
+        }
+    }
+    close(server_fd);
+exit:
+    free(fds);
+    free(workers);
+    return ret;
+}
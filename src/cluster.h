@@ -0,0 +1,55 @@
+#ifndef CLUSTER_H_
+#define CLUSTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "server_core.h"
+
+#define CLUSTER_REPORT_INTERVAL 100 /* in milliseconds, worker reports load at least this often */
+
+typedef enum cluster_message_type_e {
+    CLUSTER_CONNECTION = 1, /* coordinator to worker, client fd is attached */
+    CLUSTER_PING,           /* coordinator to worker, health check */
+    CLUSTER_LOAD,           /* worker to coordinator, answer to ping and periodic report */
+    CLUSTER_TAKEOVER,       /* new server to running one, request of listening socket */
+    CLUSTER_LISTENER,       /* running server to new one, listening socket is attached */
+    CLUSTER_TAKEOVER_DONE,  /* new server accepts connections, running one drains sessions */
+} cluster_message_type_t;
+
+/* Message of control channel between coordinator and worker or between old and new server */
+typedef struct cluster_message_s {
+    uint32_t type;
+    uint32_t active_sessions;
+    uint32_t max_sessions;
+    uint64_t inflight_bytes;
+    uint64_t backlog_ms;     /* time for processing of queued data */
+    uint64_t connections;    /* connections received by worker */
+} cluster_message_t;
+
+/**
+ * Run coordinator
+ *
+ * Coordinator accepts connections and passes client fds over Unix socket by
+ * SCM_RIGHTS to local worker processes, so data is never copied by coordinator.
+ * Worker with the lowest reported load is chosen. Workers are the same binary
+ * started with the same arguments and --worker-fd, they are pinged every second,
+ * worker without reports is not chosen, hung or exited worker is restarted.
+ *
+ * @param[in]   options     options of server, ip and port are used by coordinator.
+ * @param[in]   workers     count of worker processes.
+ * @param[in]   argc        arguments of the server for workers.
+ * @param[in]   argv        arguments of the server for workers.
+ * @returns     Zero if success
+ */
+int cluster_run(const server_options_t *options, size_t workers, int argc, char **argv);
+void cluster_exit(void);
+/* Pass reload of indicators library to all workers, it is safe for signal handler */
+void cluster_request_reload(void);
+
+/* Send message with attached fd, fd -1 - without fd */
+int cluster_send(int channel, const cluster_message_t *msg, int fd);
+/* Receive message and attached fd, fd is -1 if nothing attached. Returns 0 if channel is closed */
+int cluster_recv(int channel, cluster_message_t *msg, int *fd);
+
+#endif /* CLUSTER_H_ */
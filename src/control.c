@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "log.h"
+#include "server_utils.h"
+#include "control.h"
+
+#define CONTROL_POLL_TIMEOUT 200     /* in milliseconds, stop flag is checked between polls */
+#define CONTROL_REQUEST_TIMEOUT 5000 /* in milliseconds, idle client is disconnected */
+#define CONTROL_LINE_SIZE 256
+
+static int server_fd = -1;
+static char *socket_path = NULL;
+static ino_t socket_ino = 0;
+static pthread_t server_thread;
+static atomic_bool server_running = false;
+static control_handlers_t control_handlers;
+
+/* Execute one command line, answer is written to out */
+static void execute(char *line, FILE *out)
+{
+    char *save = NULL;
+    char *command = strtok_r(line, " \t\r\n", &save);
+    char *name    = strtok_r(NULL, " \t\r\n", &save);
+    char *value   = strtok_r(NULL, " \t\r\n", &save);
+
+    if (command == NULL)
+    {
+        fprintf(out, "error empty command\n");
+    }
+    else if (strcmp(command, "list") == 0)
+    {
+        control_handlers.list(out);
+        fprintf(out, "ok\n");
+    }
+    else if (strcmp(command, "get") == 0 && name != NULL)
+    {
+        if (control_handlers.get(name, out) == 0)
+        {
+            fprintf(out, "ok\n");
+        }
+        else
+        {
+            fprintf(out, "error unknown tunable %s\n", name);
+        }
+    }
+    else if (strcmp(command, "set") == 0 && name != NULL && value != NULL)
+    {
+        if (control_handlers.set(name, value, out) == 0)
+        {
+            logger(INFO, "Tunable %s is set to %s by control socket", name, value);
+            fprintf(out, "ok\n");
+        }
+    }
+    else if (strcmp(command, "stats") == 0)
+    {
+        control_handlers.stats(out);
+        fprintf(out, "ok\n");
+    }
+    else if (strcmp(command, "reload") == 0)
+    {
+        fprintf(out, control_handlers.reload() == 0 ? "ok\n" : "error library is not reloaded, see log\n");
+    }
+    else
+    {
+        fprintf(out, "error unknown command %s, commands: list, get <name>, set <name> <value>, stats, reload\n",
+                command);
+    }
+}
+
+/* Commands of one client, connection is closed when client closes it or is idle */
+static void serve_client(const int fd)
+{
+    char line[CONTROL_LINE_SIZE];
+    size_t used = 0;
+    struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+
+    while (atomic_load(&server_running) && poll(&pfd, 1, CONTROL_REQUEST_TIMEOUT) > 0)
+    {
+        char *end;
+        ssize_t read_size = recv(fd, line + used, sizeof(line) - 1 - used, 0);
+        if (read_size <= 0)
+        {
+            return;
+        }
+        used += (size_t)read_size;
+        line[used] = '\0';
+        while ((end = strchr(line, '\n')) != NULL)
+        {
+            char *answer = NULL;
+            size_t answer_size = 0;
+            FILE *out = open_memstream(&answer, &answer_size);
+            if (out == NULL)
+            {
+                logger(ERROR, "Can't alloc memory for control answer");
+                return;
+            }
+            *end = '\0';
+            execute(line, out);
+            fclose(out);
+            if (write_wrapper(fd, answer, answer_size) != 0)
+            {
+                free(answer);
+                return;
+            }
+            free(answer);
+            used -= (size_t)(end + 1 - line);
+            memmove(line, end + 1, used + 1);
+        }
+        if (used == sizeof(line) - 1)
+        {
+            const char *too_long = "error command is too long\n";
+            write_wrapper(fd, too_long, strlen(too_long));
+            return;
+        }
+    }
+}
+
+static void *control_server(__attribute__((unused)) void *arg)
+{
+    struct pollfd pfd = {.fd = server_fd, .events = POLLIN, .revents = 0};
+
+    while (atomic_load(&server_running))
+    {
+        int fd;
+        if (poll(&pfd, 1, CONTROL_POLL_TIMEOUT) <= 0)
+        {
+            continue;
+        }
+        fd = accept(server_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            continue;
+        }
+        serve_client(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int control_start(const char *path, const control_handlers_t *handlers)
+{
+    int ret;
+    sigset_t set;
+    sigset_t old_set;
+    struct stat st;
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        logger(ERROR, "Control socket path is too long %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server_fd == -1)
+    {
+        logger(ERROR, "Can not create control socket (%d:%s)", errno, strerror(errno));
+        return -1;
+    }
+    /* path is left by previous server or is still used by server which is upgraded */
+    unlink(path);
+    if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server_fd, 4) != 0 ||
+        stat(path, &st) != 0)
+    {
+        logger(ERROR, "Can not listen on %s (%d:%s)", path, errno, strerror(errno));
+        goto error;
+    }
+    socket_ino  = st.st_ino;
+    socket_path = strdup(path);
+    control_handlers = *handlers;
+    atomic_store(&server_running, true);
+
+    /* signals are handled by main thread */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+    ret = pthread_create(&server_thread, NULL, control_server, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    if (ret != 0)
+    {
+        logger(ERROR, "Can not create control thread (%d:%s)", ret, strerror(ret));
+        atomic_store(&server_running, false);
+        unlink(path);
+        goto error;
+    }
+    logger(INFO, "Control socket is available on %s", path);
+    return 0;
+
+error:
+    close(server_fd);
+    server_fd = -1;
+    free(socket_path);
+    socket_path = NULL;
+    return -1;
+}
+
+void control_stop(void)
+{
+    struct stat st;
+
+    if (!atomic_exchange(&server_running, false))
+    {
+        return;
+    }
+    pthread_join(server_thread, NULL);
+    close(server_fd);
+    server_fd = -1;
+    /* new server could replace path during upgrade */
+    if (stat(socket_path, &st) == 0 && st.st_ino == socket_ino)
+    {
+        unlink(socket_path);
+    }
+    free(socket_path);
+    socket_path = NULL;
+}
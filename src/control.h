@@ -0,0 +1,42 @@
+#ifndef CONTROL_H_
+#define CONTROL_H_
+
+#include <stdio.h>
+
+/*
+ * Control socket
+ *
+ * Local Unix stream socket with text commands, one command per line:
+ *   list                  - values of all tunables, "name value" per line
+ *   get <name>            - value of tunable
+ *   set <name> <value>    - change tunable, it is applied without restart
+ *   stats                 - metrics in Prometheus text format
+ *   reload                - load indicators library again
+ * Every answer is finished by line "ok" or "error <reason>".
+ */
+
+typedef struct control_handlers_s {
+    void (*list)(FILE *out);
+    /* Returns zero if tunable is known */
+    int  (*get)(const char *name, FILE *out);
+    /* Returns zero if value is applied, reason of error is written to out */
+    int  (*set)(const char *name, const char *value, FILE *out);
+    void (*stats)(FILE *out);
+    int  (*reload)(void);
+} control_handlers_t;
+
+/**
+ * Start thread which serves control socket
+ *
+ * Stale path is replaced, so new server takes the path from running one
+ * during upgrade.
+ *
+ * @param[in]   path        path of Unix socket.
+ * @param[in]   handlers    commands of server.
+ * @returns     Zero if success
+ */
+int control_start(const char *path, const control_handlers_t *handlers);
+/* Stop thread, path is removed if it was not taken by another server */
+void control_stop(void);
+
+#endif /* CONTROL_H_ */
@@ -0,0 +1,17 @@
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * CRC-32 (IEEE 802.3, as zlib)
+ *
+ * @param[in]   crc     value for previous data, 0 for the first block.
+ * @param[in]   data    data.
+ * @param[in]   size    size of data.
+ * @returns     CRC-32 of all data
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t size);
+
+#endif /* CRC32_H_ */
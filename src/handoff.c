@@ -0,0 +1,165 @@
+#define _GNU_SOURCE /* accept4() */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "log.h"
+#include "cluster.h"
+#include "handoff.h"
+
+#define HANDOFF_TIMEOUT 2 /* in seconds, for every message of handoff */
+
+static int set_timeouts(int fd)
+{
+    struct timeval timeout = {.tv_sec = HANDOFF_TIMEOUT, .tv_usec = 0};
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0)
+    {
+        logger(ERROR, "Can not set timeouts of handoff socket (%d:%s)", errno, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int fill_address(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0x00, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path))
+    {
+        logger(ERROR, "Path of handoff socket is too long (%s)", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+int handoff_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (fill_address(&addr, path) != 0)
+    {
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    if (set_timeouts(fd) != 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        logger(DEBUG, "No running server on %s (%d:%s)", path, errno, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int handoff_takeover(int channel)
+{
+    cluster_message_t msg = {.type = CLUSTER_TAKEOVER};
+    int server_fd = -1;
+
+    if (cluster_send(channel, &msg, -1) != 0 || cluster_recv(channel, &msg, &server_fd) <= 0 ||
+        msg.type != CLUSTER_LISTENER || server_fd == -1)
+    {
+        logger(ERROR, "Running server did not pass listening socket");
+        goto error;
+    }
+    msg.type = CLUSTER_TAKEOVER_DONE;
+    if (cluster_send(channel, &msg, -1) != 0)
+    {
+        logger(ERROR, "Can not confirm takeover (%d:%s)", errno, strerror(errno));
+        goto error;
+    }
+    close(channel);
+    logger(INFO, "Listening socket is taken from running server");
+    return server_fd;
+
+error:
+    if (server_fd != -1)
+    {
+        close(server_fd);
+    }
+    close(channel);
+    return -1;
+}
+
+int handoff_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (fill_address(&addr, path) != 0)
+    {
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        logger(ERROR, "Can not create handoff socket (%d:%s)", errno, strerror(errno));
+        return -1;
+    }
+    /* path is left by previous server */
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0)
+    {
+        logger(ERROR, "Can not listen on %s (%d:%s)", path, errno, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    logger(INFO, "New server could take over from %s", path);
+    return fd;
+}
+
+int handoff_accept(int listener)
+{
+    cluster_message_t msg;
+    int fd = -1;
+    int channel = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+
+    if (channel == -1)
+    {
+        return -1;
+    }
+    if (set_timeouts(channel) != 0 || cluster_recv(channel, &msg, &fd) <= 0 || msg.type != CLUSTER_TAKEOVER)
+    {
+        logger(ERROR, "Wrong request on handoff socket");
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        close(channel);
+        return -1;
+    }
+    return channel;
+}
+
+int handoff_pass(int channel, int server_fd)
+{
+    cluster_message_t msg = {.type = CLUSTER_LISTENER};
+    int fd = -1;
+    int ret = -1;
+
+    if (cluster_send(channel, &msg, server_fd) == 0 && cluster_recv(channel, &msg, &fd) > 0 &&
+        msg.type == CLUSTER_TAKEOVER_DONE)
+    {
+        ret = 0;
+    }
+    else
+    {
+        logger(ERROR, "New server did not confirm takeover, keep accepting");
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+    close(channel);
+    return ret;
+}
@@ -0,0 +1,38 @@
+#ifndef HANDOFF_H_
+#define HANDOFF_H_
+
+/*
+ * Listening socket handoff between running and new server
+ *
+ * Running server listens on Unix socket path. New server connects to it when all
+ * its resources are ready, gets listening socket by SCM_RIGHTS and starts to
+ * accept, running server stops to accept and drains its sessions.
+ */
+
+/* Connect to running server, -1 if nobody listens on path */
+int handoff_connect(const char *path);
+
+/**
+ * Take listening socket from running server
+ *
+ * @param[in]   channel     connection from handoff_connect(), it is closed.
+ * @returns     Listening socket or -1
+ */
+int handoff_takeover(int channel);
+
+/* Listen on path for the next server, stale path is replaced */
+int handoff_listen(const char *path);
+
+/* Accept new server and read its request, returns channel or -1 */
+int handoff_accept(int listener);
+
+/**
+ * Pass listening socket to new server
+ *
+ * @param[in]   channel     channel from handoff_accept(), it is closed.
+ * @param[in]   server_fd   listening socket.
+ * @returns     Zero if new server confirmed that it accepts connections
+ */
+int handoff_pass(int channel, int server_fd);
+
+#endif /* HANDOFF_H_ */
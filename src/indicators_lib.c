@@ -0,0 +1,515 @@
+#define _GNU_SOURCE /* memfd_create(), RTLD_DEEPBIND */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "crc32.h"
+#include "indicators_lib.h"
+
+#define WATCH_INTERVAL 1 /* in seconds, file is reloaded when it is not changed for one interval */
+#define COPY_BUFFER_SIZE ((size_t) (64 * 1024))
+
+typedef indicators_handlers_t *(*get_handlers_t)(void);
+typedef size_t (*get_count_t)(void);
+typedef const indicator_ctx_layout_t *(*get_layouts_t)(void);
+typedef const indicators_preprocessor_t *(*get_preprocessor_t)(void);
+
+typedef struct file_state_s {
+    dev_t  dev;
+    ino_t  ino;
+    off_t  size;
+    struct timespec mtime;
+} file_state_t;
+
+static char *lib_path = NULL;
+static indicators_lib_t *current = NULL;
+static pthread_mutex_t current_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint generation = 0;
+static volatile sig_atomic_t reload_requested = 0;
+
+static pthread_t watcher;
+static bool watcher_started = false;
+static bool watcher_running = false;
+static pthread_mutex_t watcher_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watcher_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t reload_lock = PTHREAD_MUTEX_INITIALIZER; /* serializes reloads, protects loaded_state */
+static file_state_t loaded_state;
+
+static bool get_file_state(const char *path, file_state_t *state)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return false;
+    }
+    state->dev   = st.st_dev;
+    state->ino   = st.st_ino;
+    state->size  = st.st_size;
+    state->mtime = st.st_mtim;
+    return true;
+}
+
+static bool same_file_state(const file_state_t *a, const file_state_t *b)
+{
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+           a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+/* CRC-32 of file which contains the symbol, for linked or preloaded library */
+static uint32_t get_symbol_file_id(void *symbol)
+{
+    Dl_info info;
+    uint8_t buffer[COPY_BUFFER_SIZE];
+    uint32_t crc = 0;
+    ssize_t size;
+    int fd;
+
+    if (dladdr(symbol, &info) == 0 || info.dli_fname == NULL || (fd = open(info.dli_fname, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        return 0;
+    }
+    while ((size = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        crc = crc32_update(crc, buffer, (size_t)size);
+    }
+    close(fd);
+    return crc;
+}
+
+/* Copy library to memory file, so loaded version does not depend on the file */
+static int copy_to_memory(const char *path, uint32_t *crc)
+{
+    uint8_t buffer[COPY_BUFFER_SIZE];
+    ssize_t size;
+    int src = open(path, O_RDONLY | O_CLOEXEC);
+    int dst;
+
+    if (src == -1)
+    {
+        logger(ERROR, "Can not open indicators library %s (%d:%s)", path, errno, strerror(errno));
+        return -1;
+    }
+    dst = memfd_create("indicators", MFD_CLOEXEC);
+    if (dst == -1)
+    {
+        logger(ERROR, "Can not create memory file (%d:%s)", errno, strerror(errno));
+        close(src);
+        return -1;
+    }
+    *crc = 0;
+    while ((size = read(src, buffer, sizeof(buffer))) > 0)
+    {
+        *crc = crc32_update(*crc, buffer, (size_t)size);
+        if (write(dst, buffer, (size_t)size) != size)
+        {
+            size = -1;
+            break;
+        }
+    }
+    close(src);
+    if (size < 0)
+    {
+        logger(ERROR, "Can not copy indicators library %s (%d:%s)", path, errno, strerror(errno));
+        close(dst);
+        return -1;
+    }
+    return dst;
+}
+
+/* Every context must fit to its alignment, alignment must be accepted by posix_memalign() */
+static bool check_layouts(const indicators_lib_t *lib)
+{
+    size_t i, alignment;
+    for (i = 0; i < lib->count; i++)
+    {
+        alignment = lib->layouts[i].alignment;
+        if (lib->layouts[i].size == 0 || (alignment & (alignment - 1)) != 0)
+        {
+            logger(ERROR, "Bad layout of context of indicator %lu: size %lu, alignment %lu", i,
+                   lib->layouts[i].size, alignment);
+            return false;
+        }
+    }
+    return true;
+}
+
+static indicators_lib_t *load_library(const char *path)
+{
+    get_handlers_t get_handlers;
+    get_count_t get_count;
+    get_layouts_t get_layouts;
+    get_preprocessor_t get_preprocessor;
+    char fd_path[64];
+    indicators_lib_t *lib = calloc(1, sizeof(*lib));
+    int fd = -1;
+
+    if (lib == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for indicators library");
+        return NULL;
+    }
+    if (path == NULL)
+    {
+        /* linked library, LD_PRELOAD takes precedence */
+        void *symbol = dlsym(RTLD_DEFAULT, "get_indicators_handlers");
+        get_handlers = (get_handlers_t)(uintptr_t)symbol;
+        get_count    = (get_count_t)(uintptr_t)dlsym(RTLD_DEFAULT, "get_indicators_count");
+        get_layouts  = (get_layouts_t)(uintptr_t)dlsym(RTLD_DEFAULT, "get_indicators_ctx_layouts");
+        get_preprocessor = (get_preprocessor_t)(uintptr_t)dlsym(RTLD_DEFAULT, "get_indicators_preprocessor");
+        if (symbol != NULL)
+        {
+            lib->id = get_symbol_file_id(symbol);
+        }
+    }
+    else
+    {
+        fd = copy_to_memory(path, &lib->id);
+        if (fd == -1)
+        {
+            goto error;
+        }
+        snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", fd);
+        /* own symbols of library win over the same names linked to server */
+        lib->handle = dlopen(fd_path, RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND);
+        close(fd);
+        if (lib->handle == NULL)
+        {
+            logger(ERROR, "Can not load indicators library %s (%s)", path, dlerror());
+            goto error;
+        }
+        get_handlers = (get_handlers_t)(uintptr_t)dlsym(lib->handle, "get_indicators_handlers");
+        get_count    = (get_count_t)(uintptr_t)dlsym(lib->handle, "get_indicators_count");
+        get_layouts  = (get_layouts_t)(uintptr_t)dlsym(lib->handle, "get_indicators_ctx_layouts");
+        get_preprocessor = (get_preprocessor_t)(uintptr_t)dlsym(lib->handle, "get_indicators_preprocessor");
+    }
+    if (get_handlers == NULL || get_count == NULL)
+    {
+        logger(ERROR, "Indicators library has no get_indicators_handlers() or get_indicators_count()");
+        goto error;
+    }
+    lib->handlers = get_handlers();
+    lib->count    = get_count();
+    if (lib->handlers == NULL || lib->count == 0)
+    {
+        logger(ERROR, "Bad data from indicators library");
+        goto error;
+    }
+    /* layouts are optional, old libraries allocate contexts by themselves */
+    lib->layouts = (get_layouts != NULL) ? get_layouts() : NULL;
+    if (lib->layouts != NULL && !check_layouts(lib))
+    {
+        goto error;
+    }
+    lib->preprocessor = (get_preprocessor != NULL) ? get_preprocessor() : NULL;
+    if (lib->preprocessor != NULL && (lib->preprocessor->derived_size == NULL || lib->preprocessor->preprocess == NULL))
+    {
+        logger(ERROR, "Preprocessor of indicators library has no functions");
+        goto error;
+    }
+    atomic_init(&lib->refs, 1);
+    return lib;
+
+error:
+    if (lib->handle != NULL)
+    {
+        dlclose(lib->handle);
+    }
+    free(lib);
+    return NULL;
+}
+
+indicators_lib_t *indicators_lib_acquire(void)
+{
+    indicators_lib_t *lib;
+    pthread_mutex_lock(&current_lock);
+    lib = current;
+    if (lib != NULL)
+    {
+        atomic_fetch_add(&lib->refs, 1);
+    }
+    pthread_mutex_unlock(&current_lock);
+    return lib;
+}
+
+void indicators_lib_release(indicators_lib_t *lib)
+{
+    if (lib == NULL || atomic_fetch_sub(&lib->refs, 1) != 1)
+    {
+        return;
+    }
+    logger(INFO, "Indicators library 0x%08x (generation %u) is unloaded", lib->id, lib->generation);
+    if (lib->handle != NULL)
+    {
+        dlclose(lib->handle);
+    }
+    free(lib);
+}
+
+indicator_ctx_t *indicators_lib_ctx_alloc(const indicators_lib_t *lib, size_t index)
+{
+    const indicator_ctx_layout_t *layout;
+    size_t alignment, size;
+    void *ctx;
+
+    if (lib->layouts == NULL)
+    {
+        return lib->handlers[index].ctx_allocator();
+    }
+    layout    = &lib->layouts[index];
+    alignment = (layout->alignment > INDICATOR_CACHE_LINE_SIZE) ? layout->alignment : INDICATOR_CACHE_LINE_SIZE;
+    /* tail is padded, so the next allocation starts on another cache line */
+    size = (layout->size + INDICATOR_CACHE_LINE_SIZE - 1) & ~((size_t)INDICATOR_CACHE_LINE_SIZE - 1);
+    if (posix_memalign(&ctx, alignment, size) != 0)
+    {
+        return NULL;
+    }
+    memset(ctx, 0x00, size);
+    return ctx;
+}
+
+void indicators_lib_ctx_free(const indicators_lib_t *lib, size_t index, indicator_ctx_t *ctx)
+{
+    if (lib->layouts == NULL)
+    {
+        lib->handlers[index].ctx_free(ctx);
+        return;
+    }
+    free(ctx);
+}
+
+uint8_t *indicators_lib_preprocess(const indicators_lib_t *lib, const uint8_t *data, size_t size,
+                                   indicator_scratch_t *scratch, size_t *derived_size)
+{
+    uint8_t *derived;
+
+    *derived_size = 0;
+    if (lib->preprocessor == NULL)
+    {
+        return NULL;
+    }
+    /* empty output is allocated too, so NULL always means no preprocessing */
+    derived = malloc(lib->preprocessor->derived_size(size) + 1);
+    if (derived == NULL)
+    {
+        logger(ERROR, "Can not allocate memory for preprocessed data");
+        return NULL;
+    }
+    *derived_size = lib->preprocessor->preprocess(data, size, derived, scratch);
+    return derived;
+}
+
+uint32_t indicators_lib_get_generation(void)
+{
+    return atomic_load(&generation);
+}
+
+void indicators_lib_request_reload(void)
+{
+    reload_requested = 1;
+}
+
+static bool is_loaded_state(const file_state_t *state)
+{
+    bool ret;
+    pthread_mutex_lock(&reload_lock);
+    ret = same_file_state(state, &loaded_state);
+    pthread_mutex_unlock(&reload_lock);
+    return ret;
+}
+
+/* Caller holds reload_lock, so current is changed only here */
+static int reload_library(void)
+{
+    indicators_lib_t *lib, *old;
+    file_state_t state;
+    bool have_state;
+
+    if (lib_path == NULL)
+    {
+        logger(ERROR, "Indicators library is linked, it can not be reloaded");
+        return -1;
+    }
+    have_state = get_file_state(lib_path, &state);
+    lib = load_library(lib_path);
+    if (lib == NULL)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&current_lock);
+    old = current;
+    pthread_mutex_unlock(&current_lock);
+    if (lib->id == old->id)
+    {
+        logger(INFO, "Indicators library 0x%08x is not changed", lib->id);
+        indicators_lib_release(lib);
+        if (have_state)
+        {
+            loaded_state = state;
+        }
+        return 0;
+    }
+    if (lib->count != old->count)
+    {
+        /* lanes, metrics and responses are sized by count of indicators */
+        logger(ERROR, "New indicators library has %lu indicators instead of %lu, it is not loaded",
+               lib->count, old->count);
+        indicators_lib_release(lib);
+        return -1;
+    }
+    if ((lib->preprocessor != NULL) != (old->preprocessor != NULL))
+    {
+        /* lanes of preprocessing are created on start */
+        logger(ERROR, "New indicators library %s preprocessor, it is not loaded", lib->preprocessor ? "has" : "has no");
+        indicators_lib_release(lib);
+        return -1;
+    }
+
+    pthread_mutex_lock(&current_lock);
+    lib->generation = old->generation + 1;
+    current = lib;
+    atomic_store(&generation, lib->generation);
+    pthread_mutex_unlock(&current_lock);
+    if (have_state)
+    {
+        loaded_state = state;
+    }
+
+    logger(INFO, "Indicators library 0x%08x (generation %u) is loaded, 0x%08x is used by running sessions",
+           lib->id, lib->generation, old->id);
+    indicators_lib_release(old);
+    return 0;
+}
+
+int indicators_lib_reload(void)
+{
+    int ret;
+    /* watcher and control socket could reload at the same time */
+    pthread_mutex_lock(&reload_lock);
+    ret = reload_library();
+    pthread_mutex_unlock(&reload_lock);
+    return ret;
+}
+
+/* Reload library when it is requested or file is changed and stays the same for one interval */
+static void *watcher_thread(__attribute__((unused)) void *arg)
+{
+    struct timespec wakeup;
+    file_state_t state, previous = loaded_state;
+    bool changed = false;
+
+    pthread_mutex_lock(&watcher_lock);
+    while (watcher_running)
+    {
+        clock_gettime(CLOCK_REALTIME, &wakeup);
+        wakeup.tv_sec += WATCH_INTERVAL;
+        pthread_cond_timedwait(&watcher_cond, &watcher_lock, &wakeup);
+        if (!watcher_running)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&watcher_lock);
+
+        if (reload_requested)
+        {
+            reload_requested = 0;
+            changed = false;
+            indicators_lib_reload();
+        }
+        else if (get_file_state(lib_path, &state) && !is_loaded_state(&state))
+        {
+            /* file could be written right now, wait till it is stable */
+            if (changed && same_file_state(&state, &previous))
+            {
+                logger(INFO, "Indicators library %s is changed", lib_path);
+                changed = false;
+                pthread_mutex_lock(&reload_lock);
+                if (reload_library() != 0)
+                {
+                    /* broken file is not loaded again till the next change */
+                    loaded_state = state;
+                }
+                pthread_mutex_unlock(&reload_lock);
+            }
+            else
+            {
+                changed  = true;
+                previous = state;
+            }
+        }
+
+        pthread_mutex_lock(&watcher_lock);
+    }
+    pthread_mutex_unlock(&watcher_lock);
+    return NULL;
+}
+
+int indicators_lib_init(const char *path, bool watch)
+{
+    int ret;
+    sigset_t set;
+
+    if (path != NULL)
+    {
+        lib_path = strdup(path);
+        if (lib_path == NULL || !get_file_state(path, &loaded_state))
+        {
+            logger(ERROR, "Can not use indicators library %s (%d:%s)", path, errno, strerror(errno));
+            goto error;
+        }
+    }
+    current = load_library(lib_path);
+    if (current == NULL)
+    {
+        goto error;
+    }
+    logger(INFO, "Indicators library 0x%08x is loaded%s%s", current->id, lib_path ? " from " : "",
+           lib_path ? lib_path : "");
+    if (!watch || lib_path == NULL)
+    {
+        return 0;
+    }
+
+    watcher_running = true;
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    ret = pthread_create(&watcher, NULL, watcher_thread, NULL);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+    if (ret != 0)
+    {
+        logger(ERROR, "Can not create watcher of indicators library (%d:%s)", ret, strerror(ret));
+        goto error;
+    }
+    watcher_started = true;
+    return 0;
+
+error:
+    indicators_lib_deinit();
+    return -1;
+}
+
+void indicators_lib_deinit(void)
+{
+    pthread_mutex_lock(&watcher_lock);
+    watcher_running = false;
+    pthread_cond_signal(&watcher_cond);
+    pthread_mutex_unlock(&watcher_lock);
+    if (watcher_started)
+    {
+        pthread_join(watcher, NULL);
+        watcher_started = false;
+    }
+    indicators_lib_release(current);
+    current = NULL;
+    free(lib_path);
+    lib_path = NULL;
+}
@@ -0,0 +1,78 @@
+#ifndef INDICATORS_LIB_H_
+#define INDICATORS_LIB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "indicators.h"
+
+/* Loaded version of indicators library */
+typedef struct indicators_lib_s {
+    void                  *handle;     /* NULL - library linked to server or preloaded */
+    indicators_handlers_t *handlers;
+    const indicator_ctx_layout_t *layouts;  /* NULL - contexts are allocated by library */
+    const indicators_preprocessor_t *preprocessor; /* NULL - indicators get raw data only */
+    size_t                 count;
+    uint32_t               id;         /* CRC-32 of library file, 0 - unknown */
+    uint32_t               generation; /* number of load, 0 - the first one */
+    atomic_uint            refs;
+} indicators_lib_t;
+
+/**
+ * Load indicators library
+ *
+ * Library from path is copied to memory file and loaded by dlopen(), so every
+ * reload gets new version even if the file was overwritten in place. Without
+ * path symbols linked to server are used, LD_PRELOAD replaces them as before.
+ *
+ * @param[in]   path    path of library, NULL - linked library.
+ * @param[in]   watch   reload library when file is changed or reload is requested.
+ * @returns     Zero if success
+ */
+int indicators_lib_init(const char *path, bool watch);
+void indicators_lib_deinit(void);
+
+/**
+ * Get current version of library
+ *
+ * Version is not unloaded till it is released, so sessions started before
+ * reload finish with their version.
+ */
+indicators_lib_t *indicators_lib_acquire(void);
+void indicators_lib_release(indicators_lib_t *lib);
+
+/* Generation of current version, it is changed by every reload */
+uint32_t indicators_lib_get_generation(void);
+
+/* Ask watcher to reload library, it is safe for signal handler */
+void indicators_lib_request_reload(void);
+
+/*
+ * Load library again, it must have the same count of indicators and must have
+ * preprocessor only if the current one has it. Returns zero if reloaded
+ */
+int indicators_lib_reload(void);
+
+/**
+ * Allocate context of indicator
+ *
+ * If library declares layouts of contexts, context is allocated by the server
+ * aligned and padded to cache lines and zeroed, otherwise ctx_allocator is used.
+ *
+ * @returns     Pointer to context or NULL if no memory
+ */
+indicator_ctx_t *indicators_lib_ctx_alloc(const indicators_lib_t *lib, size_t index);
+void indicators_lib_ctx_free(const indicators_lib_t *lib, size_t index, indicator_ctx_t *ctx);
+
+/**
+ * Preprocess data for all indicators
+ *
+ * @param[out]  derived_size    size of output.
+ * @returns     Output allocated by malloc(), NULL if library has no preprocessor or no memory
+ */
+uint8_t *indicators_lib_preprocess(const indicators_lib_t *lib, const uint8_t *data, size_t size,
+                                   indicator_scratch_t *scratch, size_t *derived_size);
+
+#endif /* INDICATORS_LIB_H_ */
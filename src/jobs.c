@@ -0,0 +1,667 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/queue.h>
+#include <sys/random.h>
+#include <arpa/inet.h>
+
+#include "log.h"
+#include "timer.h"
+#include "threadpool.h"
+#include "indicators_lib.h"
+#include "scratch.h"
+#include "jobs.h"
+
+#define JOB_SUFFIX ".job"
+#define RESULT_SUFFIX ".result"
+#define TMP_SUFFIX ".tmp"
+#define JOBS_RESULT_TTL (24 * 60 * 60) /* in seconds, results which were not fetched are deleted */
+#define JOBS_CLEANUP_INTERVAL 60 /* in seconds */
+#define JOBS_DEFAULT_SPEED ((uint64_t) (5 * 1000 * 1000)) /* bytes per second before the first job */
+
+typedef struct job_s {
+    uint64_t id;
+    size_t   size;  /* size of file for estimation */
+    TAILQ_ENTRY(job_s) next;
+} job_t;
+
+typedef struct job_task_s {
+    indicators_lib_t *lib;
+    uint64_t       job_id;
+    const uint8_t *data;
+    size_t         size;
+    const uint8_t *derived;   /* output of preprocessor, NULL - not preprocessed */
+    size_t         derived_size;
+    size_t         index;
+    uint64_t      *values;
+    sem_t         *done;
+} job_task_t;
+
+static char *jobs_dir = NULL;
+static int dir_fd = -1;
+static size_t handlers_count = 0;
+static thread_pool_t *pool = NULL;
+
+static pthread_t worker;
+static bool worker_started = false;
+static bool running = false;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond;
+static pthread_cond_t drained_cond = PTHREAD_COND_INITIALIZER;
+static TAILQ_HEAD(, job_s) queue = TAILQ_HEAD_INITIALIZER(queue);
+static size_t pending = 0;
+static uint64_t pending_bytes = 0;
+static uint64_t computing_id = 0;
+static atomic_uint_fast64_t speed = JOBS_DEFAULT_SPEED; /* bytes per second of computing */
+
+static void get_path(char *path, size_t size, uint64_t id, const char *suffix)
+{
+    snprintf(path, size, "%s/%lu%s", jobs_dir, id, suffix);
+}
+
+/*
+ * Write file to tmp, sync it and rename, so file with final name is always complete
+ *
+ * Journal could be shared with other process during upgrade, so tmp file has pid
+ * in name and exclusive file is linked instead of rename. Returns 1 if exclusive
+ * file exists.
+ */
+static int write_durable(uint64_t id, const char *suffix, const void *data, size_t size, bool exclusive)
+{
+    char tmp_path[PATH_MAX], path[PATH_MAX];
+    size_t written = 0;
+    int fd;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%lu.%d%s", jobs_dir, id, getpid(), TMP_SUFFIX);
+    get_path(path, sizeof(path), id, suffix);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        logger(ERROR, "Can not create %s (%d:%s)", tmp_path, errno, strerror(errno));
+        return -1;
+    }
+    while (written < size)
+    {
+        ssize_t ret = write(fd, (const uint8_t *)data + written, size - written);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret < 0)
+        {
+            logger(ERROR, "Can not write %s (%d:%s)", tmp_path, errno, strerror(errno));
+            goto error;
+        }
+        written += (size_t)ret;
+    }
+    if (fsync(fd) != 0)
+    {
+        logger(ERROR, "Can not sync %s (%d:%s)", tmp_path, errno, strerror(errno));
+        goto error;
+    }
+    if (exclusive && link(tmp_path, path) != 0)
+    {
+        int ret = (errno == EEXIST) ? 1 : -1;
+        if (ret != 1)
+        {
+            logger(ERROR, "Can not store %s (%d:%s)", path, errno, strerror(errno));
+        }
+        close(fd);
+        unlink(tmp_path);
+        return ret;
+    }
+    if ((exclusive ? unlink(tmp_path) : rename(tmp_path, path)) != 0 || fsync(dir_fd) != 0)
+    {
+        logger(ERROR, "Can not store %s (%d:%s)", path, errno, strerror(errno));
+        goto error;
+    }
+    close(fd);
+    return 0;
+
+error:
+    close(fd);
+    unlink(tmp_path);
+    return -1;
+}
+
+static void enqueue(uint64_t id, size_t size)
+{
+    job_t *job = malloc(sizeof(*job));
+    if (job == NULL)
+    {
+        /* file stays in journal and is resumed after restart */
+        logger(ERROR, "Can't alloc memory for job %lu", id);
+        return;
+    }
+    job->id   = id;
+    job->size = size;
+    pthread_mutex_lock(&queue_lock);
+    TAILQ_INSERT_TAIL(&queue, job, next);
+    pending++;
+    pending_bytes += size;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static void *job_task_handler(void *arg)
+{
+    job_task_t *task = arg;
+    indicators_handlers_t *handler = &task->lib->handlers[task->index];
+    indicator_ctx_t *ctx = indicators_lib_ctx_alloc(task->lib, task->index);
+
+    if (ctx != NULL)
+    {
+        indicator_arg_t indicator_arg = {
+            .ctx  = ctx,
+            .data = task->data,
+            .size = task->size,
+            .scratch = scratch_get(task->job_id),
+            .derived = task->derived,
+            .derived_size = task->derived_size,
+        };
+        handler->ctx_initializer(ctx);
+        handler->indicator(&indicator_arg);
+        task->values[task->index] = htobe64(handler->extract(ctx));
+        indicators_lib_ctx_free(task->lib, task->index, ctx);
+    }
+    else
+    {
+        logger(ERROR, "Can not allocate ctx of indicator %lu", task->index);
+    }
+    sem_post(task->done);
+    return NULL;
+}
+
+/* Compute all indicators of journal file and store results message */
+static int compute_job(const job_t *job)
+{
+    int ret = -1;
+    size_t i;
+    char path[PATH_MAX];
+    struct stat st;
+    void *map;
+    sem_t done;
+    message_t *result;
+    indicators_lib_t *lib;
+    uint8_t *derived;
+    size_t derived_size;
+    size_t queued = 0;
+    size_t result_size = sizeof(messageHeader_t) + sizeof(uint64_t) * handlers_count;
+    uint64_t start_us = timer_get_monotonic_us();
+    int fd;
+
+    get_path(path, sizeof(path), job->id, JOB_SUFFIX);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 && errno == ENOENT)
+    {
+        /* previous process computed it while handing off */
+        logger(INFO, "Job %lu is already computed", job->id);
+        return 0;
+    }
+    /* journal could be shared with other process during upgrade, job is computed by the one which claims it */
+    if (fd != -1 && flock(fd, LOCK_EX | LOCK_NB) != 0 && errno == EWOULDBLOCK)
+    {
+        logger(INFO, "Job %lu is computed by other process", job->id);
+        close(fd);
+        return 0;
+    }
+    if (fd == -1 || fstat(fd, &st) != 0 || (size_t)st.st_size <= sizeof(messageHeader_t))
+    {
+        logger(ERROR, "Can not open job %s", path);
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    if (st.st_nlink == 0)
+    {
+        /* other process computed it between open and claim */
+        logger(INFO, "Job %lu is already computed", job->id);
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    result = calloc(1, result_size);
+    if (map == MAP_FAILED || result == NULL || sem_init(&done, 0, 0) != 0)
+    {
+        logger(ERROR, "Can not prepare job %lu", job->id);
+        free(result);
+        if (map != MAP_FAILED)
+        {
+            munmap(map, (size_t)st.st_size);
+        }
+        close(fd);
+        return -1;
+    }
+
+    /* job is computed by one version of library even if it is reloaded meanwhile */
+    lib = indicators_lib_acquire();
+    /* preparation shared by indicators is done once before their tasks */
+    derived = indicators_lib_preprocess(lib, ((const message_t *)map)->payload,
+                                        (size_t)st.st_size - sizeof(messageHeader_t), scratch_get(job->id), &derived_size);
+    /* every indicator processes the whole payload in own task */
+    for (i = 0; i < handlers_count; i++)
+    {
+        job_task_t *task = malloc(sizeof(*task));
+        if (task == NULL)
+        {
+            logger(ERROR, "Can't alloc memory for job task");
+            break;
+        }
+        task->lib      = lib;
+        task->job_id   = job->id;
+        task->data     = ((const message_t *)map)->payload;
+        task->size     = (size_t)st.st_size - sizeof(messageHeader_t);
+        task->derived  = derived;
+        task->derived_size = derived_size;
+        task->index    = i;
+        task->values   = (uint64_t *)result->payload;
+        task->done     = &done;
+        thread_pool_add_task(pool, job_task_handler, task, 0);
+        queued++;
+    }
+    for (i = 0; i < queued; i++)
+    {
+        sem_wait(&done);
+    }
+    sem_destroy(&done);
+    free(derived);
+    munmap(map, (size_t)st.st_size);
+    result->header.library_id = htonl(lib->id);
+    indicators_lib_release(lib);
+    if (queued != handlers_count)
+    {
+        /* job stays in journal and is queued again by periodic scan */
+        free(result);
+        close(fd);
+        return -1;
+    }
+
+    result->header.magic      = htonl(HEADER_MAGIC);
+    result->header.version    = htonl(HEADER_VERSION);
+    result->header.size       = htonl((uint32_t)(sizeof(uint64_t) * handlers_count));
+    result->header.frame_size = htonl(sizeof(uint64_t));
+    result->header.type       = MESSAGE_TYPE_RESULT;
+    result->header.status     = MESSAGE_STATUS_OK;
+    result->header.offset     = htonl((uint32_t)((size_t)st.st_size - sizeof(messageHeader_t)));
+    result->header.job_id     = htobe64(job->id);
+    if (write_durable(job->id, RESULT_SUFFIX, result, result_size, false) == 0)
+    {
+        /* journal entry is not needed when results are durable, claim is released after it */
+        unlink(path);
+        ret = 0;
+    }
+    close(fd);
+    free(result);
+
+    atomic_store(&speed, (atomic_load(&speed) * 7 + (uint64_t)st.st_size * 1000000 /
+                          (timer_get_monotonic_us() - start_us + 1)) / 8);
+    logger(INFO, "Job %lu is computed in %lu ms", job->id, (timer_get_monotonic_us() - start_us) / 1000);
+    return ret;
+}
+
+/* Delete results which were not fetched for JOBS_RESULT_TTL and broken tmp files */
+static void cleanup_results(void)
+{
+    DIR *dir = opendir(jobs_dir);
+    struct dirent *entry;
+    time_t now = time(NULL);
+
+    if (dir == NULL)
+    {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        struct stat st;
+        size_t len = strlen(entry->d_name);
+        if (len > strlen(RESULT_SUFFIX) && strcmp(entry->d_name + len - strlen(RESULT_SUFFIX), RESULT_SUFFIX) == 0 &&
+            fstatat(dirfd(dir), entry->d_name, &st, 0) == 0 && now - st.st_mtime > JOBS_RESULT_TTL)
+        {
+            logger(INFO, "Results %s were not fetched, deleting", entry->d_name);
+            unlinkat(dirfd(dir), entry->d_name, 0);
+        }
+    }
+    closedir(dir);
+}
+
+static int scan_journal(void);
+
+static void *jobs_worker(__attribute__((unused)) void *arg)
+{
+    job_t *job;
+    struct timespec wakeup;
+
+    pthread_mutex_lock(&queue_lock);
+    while (running)
+    {
+        if (TAILQ_EMPTY(&queue))
+        {
+            clock_gettime(CLOCK_MONOTONIC, &wakeup);
+            wakeup.tv_sec += JOBS_CLEANUP_INTERVAL;
+            if (pthread_cond_timedwait(&queue_cond, &queue_lock, &wakeup) == ETIMEDOUT)
+            {
+                pthread_mutex_unlock(&queue_lock);
+                cleanup_results();
+                scan_journal();
+                pthread_mutex_lock(&queue_lock);
+            }
+            continue;
+        }
+        job = TAILQ_FIRST(&queue);
+        TAILQ_REMOVE(&queue, job, next);
+        computing_id = job->id;
+        pthread_mutex_unlock(&queue_lock);
+
+        if (compute_job(job) != 0)
+        {
+            logger(ERROR, "Job %lu failed, it stays in journal", job->id);
+        }
+
+        pthread_mutex_lock(&queue_lock);
+        computing_id = 0;
+        pending--;
+        pending_bytes -= job->size;
+        free(job);
+        if (pending == 0)
+        {
+            pthread_cond_broadcast(&drained_cond);
+        }
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return NULL;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static bool is_queued(uint64_t id)
+{
+    job_t *job;
+    bool ret = (computing_id == id);
+
+    TAILQ_FOREACH(job, &queue, next)
+    {
+        ret = ret || (job->id == id);
+    }
+    return ret;
+}
+
+/*
+ * Queue jobs of journal which are not queued yet, in order of ids
+ *
+ * It is called on start and periodically, so jobs stored by previous process
+ * while handing off are picked up too.
+ */
+static int scan_journal(void)
+{
+    DIR *dir = opendir(jobs_dir);
+    struct dirent *entry;
+    uint64_t *ids = NULL;
+    size_t i, count = 0;
+
+    if (dir == NULL)
+    {
+        logger(ERROR, "Can not read jobs directory %s (%d:%s)", jobs_dir, errno, strerror(errno));
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char *end;
+        struct stat st;
+        bool known;
+        uint64_t id = strtoull(entry->d_name, &end, 10);
+
+        if (end == entry->d_name)
+        {
+            continue;
+        }
+        if (strlen(end) > strlen(TMP_SUFFIX) && strcmp(end + strlen(end) - strlen(TMP_SUFFIX), TMP_SUFFIX) == 0)
+        {
+            /* file was not acknowledged, dash cam will send it again */
+            pid_t pid = (pid_t)strtol(end + 1, NULL, 10);
+            if (pid != getpid() && kill(pid, 0) != 0 && errno == ESRCH)
+            {
+                unlinkat(dirfd(dir), entry->d_name, 0);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&queue_lock);
+        known = is_queued(id);
+        pthread_mutex_unlock(&queue_lock);
+        if (!known && strcmp(end, JOB_SUFFIX) == 0 && fstatat(dirfd(dir), entry->d_name, &st, 0) == 0)
+        {
+            uint64_t *new_ids = realloc(ids, sizeof(*ids) * (count + 1) * 2);
+            if (new_ids == NULL)
+            {
+                break;
+            }
+            ids = new_ids;
+            ids[2 * count]     = id;
+            ids[2 * count + 1] = (uint64_t)st.st_size;
+            count++;
+        }
+    }
+    closedir(dir);
+
+    /* pairs of id and size are sorted by id */
+    qsort(ids, count, 2 * sizeof(*ids), compare_ids);
+    for (i = 0; i < count; i++)
+    {
+        enqueue(ids[2 * i], (size_t)ids[2 * i + 1]);
+    }
+    if (count != 0)
+    {
+        logger(INFO, "%lu jobs are resumed from journal", count);
+    }
+    free(ids);
+    return 0;
+}
+
+int jobs_init(const char *dir, size_t count)
+{
+    int ret;
+    sigset_t set;
+    pthread_condattr_t attr;
+    thread_pool_lane_conf_t lane = {.size = count, .node = -1};
+
+    handlers_count = count;
+    jobs_dir = strdup(dir);
+    dir_fd   = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (jobs_dir == NULL || dir_fd == -1 || access(dir, W_OK) != 0)
+    {
+        logger(ERROR, "Can not use jobs directory %s (%d:%s)", dir, errno, strerror(errno));
+        goto error;
+    }
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    /* own lane, so background jobs do not take lanes of sessions */
+    pool = thread_pool_create(&lane, 1);
+    if (pool == NULL || scan_journal() != 0)
+    {
+        goto error;
+    }
+    cleanup_results();
+
+    running = true;
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    ret = pthread_create(&worker, NULL, jobs_worker, NULL);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+    if (ret != 0)
+    {
+        logger(ERROR, "Can not create jobs worker (%d:%s)", ret, strerror(ret));
+        goto error;
+    }
+    worker_started = true;
+    logger(INFO, "Async sessions are enabled, jobs are stored to %s", jobs_dir);
+    return 0;
+
+error:
+    jobs_deinit();
+    return -1;
+}
+
+void jobs_deinit(void)
+{
+    job_t *job;
+
+    pthread_mutex_lock(&queue_lock);
+    running = false;
+    pthread_cond_signal(&queue_cond);
+    pthread_cond_broadcast(&drained_cond);
+    pthread_mutex_unlock(&queue_lock);
+    if (worker_started)
+    {
+        /* the current job is finished, others stay in journal */
+        pthread_join(worker, NULL);
+        worker_started = false;
+    }
+    while ((job = TAILQ_FIRST(&queue)) != NULL)
+    {
+        TAILQ_REMOVE(&queue, job, next);
+        free(job);
+    }
+    pending = 0;
+    pending_bytes = 0;
+    if (pool != NULL)
+    {
+        thread_pool_destroy(pool);
+        pool = NULL;
+    }
+    if (dir_fd != -1)
+    {
+        close(dir_fd);
+        dir_fd = -1;
+    }
+    free(jobs_dir);
+    jobs_dir = NULL;
+}
+
+void jobs_drain(void)
+{
+    pthread_mutex_lock(&queue_lock);
+    while (running && pending != 0)
+    {
+        pthread_cond_wait(&drained_cond, &queue_lock);
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
+
+bool jobs_enabled(void)
+{
+    return jobs_dir != NULL;
+}
+
+/* Fetch needs only id, so ids are random to keep results of other dash cams unreadable */
+static int get_random_id(uint64_t *id)
+{
+    ssize_t ret;
+    do
+    {
+        ret = getrandom(id, sizeof(*id), 0);
+    } while ((ret < 0 && errno == EINTR) || (ret == (ssize_t)sizeof(*id) && *id == 0));
+    if (ret != (ssize_t)sizeof(*id))
+    {
+        logger(ERROR, "Can not generate job id (%d:%s)", errno, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int jobs_submit(const message_t *msg, uint64_t *job_id)
+{
+    size_t size = sizeof(msg->header) + ntohl(msg->header.size);
+    char path[PATH_MAX];
+    uint64_t id;
+    int ret;
+
+    do
+    {
+        if (get_random_id(&id) != 0)
+        {
+            return -1;
+        }
+        /* id could be taken by other job of journal, ids of results are not reused */
+        get_path(path, sizeof(path), id, RESULT_SUFFIX);
+        ret = (access(path, F_OK) == 0) ? 1 : write_durable(id, JOB_SUFFIX, msg, size, true);
+    } while (ret == 1);
+    if (ret != 0)
+    {
+        return -1;
+    }
+    enqueue(id, size);
+    *job_id = id;
+    return 0;
+}
+
+job_status_t jobs_fetch(uint64_t job_id, message_t **result, size_t *size)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    int fd;
+
+    get_path(path, sizeof(path), job_id, RESULT_SUFFIX);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        get_path(path, sizeof(path), job_id, JOB_SUFFIX);
+        return (access(path, F_OK) == 0) ? JOB_PENDING : JOB_NOT_FOUND;
+    }
+    if (fstat(fd, &st) != 0 || (*result = malloc((size_t)st.st_size)) == NULL)
+    {
+        close(fd);
+        return JOB_NOT_FOUND;
+    }
+    *size = (size_t)st.st_size;
+    if (read(fd, *result, *size) != (ssize_t)*size)
+    {
+        free(*result);
+        *result = NULL;
+        close(fd);
+        return JOB_NOT_FOUND;
+    }
+    close(fd);
+    return JOB_DONE;
+}
+
+size_t jobs_get_pending(void)
+{
+    size_t ret;
+    pthread_mutex_lock(&queue_lock);
+    ret = pending;
+    pthread_mutex_unlock(&queue_lock);
+    return ret;
+}
+
+uint16_t jobs_get_retry_after(void)
+{
+    uint64_t bytes, seconds;
+    uint64_t current_speed = atomic_load(&speed);
+
+    pthread_mutex_lock(&queue_lock);
+    bytes = pending_bytes;
+    pthread_mutex_unlock(&queue_lock);
+    seconds = bytes / ((current_speed != 0) ? current_speed : 1) + 1;
+    return (uint16_t)((seconds < UINT16_MAX) ? seconds : UINT16_MAX);
+}
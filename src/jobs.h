@@ -0,0 +1,63 @@
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "dash_cam.h"
+#include "indicators.h"
+
+typedef enum job_status_e {
+    JOB_DONE = 0,
+    JOB_PENDING,     /* file is in journal, results are not ready */
+    JOB_NOT_FOUND
+} job_status_t;
+
+/**
+ * Enable async sessions
+ *
+ * Files of async sessions are stored to journal <dir>/<id>.job and computed by
+ * background worker, results are stored to <dir>/<id>.result. Jobs which were
+ * not computed before restart are resumed. Journal could be shared with previous
+ * server during upgrade, its jobs are picked up by periodic scan and every job
+ * is claimed by flock() of its journal file, so it is computed once. Indicators
+ * are taken from the current version of indicators library for every job.
+ *
+ * @param[in]   dir         existing directory for journal and results.
+ * @param[in]   count       count of indicators.
+ * @returns     Zero if success
+ */
+int jobs_init(const char *dir, size_t count);
+void jobs_deinit(void);
+bool jobs_enabled(void);
+/* Wait till all queued jobs are computed, before exit after handoff */
+void jobs_drain(void);
+
+/**
+ * Store message to journal and queue it for computing
+ *
+ * File is synced to disk before return, so acknowledged job survives crash.
+ *
+ * @param[in]   msg     received message, payload size is in header.
+ * @param[out]  job_id  id for fetching results.
+ * @returns     Zero if success
+ */
+int jobs_submit(const message_t *msg, uint64_t *job_id);
+
+/**
+ * Get results of job
+ *
+ * @param[in]   job_id  id from jobs_submit().
+ * @param[out]  result  results message for JOB_DONE, it must be freed by caller.
+ * @param[out]  size    size of results message.
+ * @returns     Status of job
+ */
+job_status_t jobs_fetch(uint64_t job_id, message_t **result, size_t *size);
+
+/* Jobs waiting for computing */
+size_t jobs_get_pending(void);
+/* Estimate of seconds till all pending jobs are computed */
+uint16_t jobs_get_retry_after(void);
+
+#endif /* JOBS_H_ */
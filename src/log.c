@@ -1,50 +1,314 @@
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <syslog.h>
+#include <time.h>
 
 #include "log.h"
 
+#define LOG_RING_SIZE 256 /* messages, power of two */
+#define LOG_MESSAGE_SIZE 256
+#define LOG_FLUSH_PERIOD 10 /* in milliseconds */
+
+typedef struct log_record_s {
+    struct timespec time;
+    int             priority;
+    char            text[LOG_MESSAGE_SIZE];
+} log_record_t;
+
+/*
+ * Ring buffer of one thread
+ *
+ * Only owner thread moves head and only flusher moves tail. Ring of finished
+ * thread is reused by new thread after flusher has emptied it.
+ */
+typedef struct log_ring_s {
+    struct log_ring_s *next;
+    atomic_bool        owned;
+    atomic_size_t      head;
+    atomic_size_t      tail;
+    log_record_t       records[LOG_RING_SIZE];
+} log_ring_t;
+
+atomic_int log_level = INFO;
 static bool debug = 0;
 static bool quiet = 0;
 
+static log_ring_t *rings = NULL; /* list only grows, ring->next is never changed */
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static atomic_size_t dropped = 0;
+
+static pthread_t flusher;
+static atomic_bool flusher_running = false;
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *log_file = NULL;
+static bool log_syslog = false;
+
+static void update_level(void)
+{
+    atomic_store_explicit(&log_level, quiet ? ERROR : (debug ? DEBUG : INFO), memory_order_relaxed);
+}
+
 void set_debug(bool _debug)
 {
     debug = _debug;
+    update_level();
 }
 
 void set_quiet(bool _quiet)
 {
     quiet = _quiet;
+    update_level();
 }
 
-void logger(int priority, const char *format, ...)
+void log_set_level(int level)
 {
-    FILE* fout = stdout;
-    va_list args;
+    debug = (level == DEBUG);
+    quiet = (level == ERROR);
+    update_level();
+}
 
-    switch (priority)
+static void output(int priority, const struct timespec *time, const char *text)
+{
+    static const int syslog_priority[] = {LOG_DEBUG, LOG_INFO, LOG_ERR};
+    char time_str[32];
+    struct tm tm;
+    FILE *fout = log_file;
+
+    if (log_syslog)
     {
-    case DEBUG:
-        if (!debug || quiet)
-        {
-            return;
-        }
-        break;
-    case INFO:
-        if (quiet)
+        syslog(syslog_priority[priority], "%s", text);
+        return;
+    }
+    if (fout == NULL)
+    {
+        fout = (priority == ERROR) ? stderr : stdout;
+    }
+    localtime_r(&time->tv_sec, &tm);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &tm);
+    fprintf(fout, "%s.%03ld %s\n", time_str, time->tv_nsec / 1000000, text);
+}
+
+static log_ring_t *get_rings(void)
+{
+    log_ring_t *ring;
+    pthread_mutex_lock(&rings_lock);
+    ring = rings;
+    pthread_mutex_unlock(&rings_lock);
+    return ring;
+}
+
+static void ring_release(void *arg)
+{
+    log_ring_t *ring = arg;
+    atomic_store(&ring->owned, false);
+}
+
+static void ring_key_create(void)
+{
+    pthread_key_create(&ring_key, ring_release);
+}
+
+static log_ring_t *get_thread_ring(void)
+{
+    log_ring_t *ring;
+
+    pthread_once(&ring_key_once, ring_key_create);
+    ring = pthread_getspecific(ring_key);
+    if (ring != NULL)
+    {
+        return ring;
+    }
+
+    /* reuse empty ring of finished thread */
+    for (ring = get_rings(); ring != NULL; ring = ring->next)
+    {
+        bool owned = false;
+        if (atomic_load(&ring->head) == atomic_load(&ring->tail) &&
+            atomic_compare_exchange_strong(&ring->owned, &owned, true))
         {
-            return;
+            goto exit;
         }
-        break;
-    case ERROR:
-        fout = stderr;
-        break;
-    default:
+    }
+
+    ring = calloc(1, sizeof(*ring));
+    if (ring == NULL)
+    {
+        return NULL;
+    }
+    atomic_init(&ring->owned, true);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    pthread_mutex_lock(&rings_lock);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_lock);
+
+exit:
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+static void write_sync(int priority, const char *format, va_list args)
+{
+    struct timespec time;
+    char text[LOG_MESSAGE_SIZE];
+
+    clock_gettime(CLOCK_REALTIME_COARSE, &time);
+    vsnprintf(text, sizeof(text), format, args);
+    pthread_mutex_lock(&output_lock);
+    output(priority, &time, text);
+    pthread_mutex_unlock(&output_lock);
+}
+
+void log_write(int priority, const char *format, ...)
+{
+    va_list args;
+    log_ring_t *ring = NULL;
+    log_record_t *record;
+    size_t head;
+
+    if (priority < DEBUG || priority > ERROR)
+    {
         return;
     }
 
     va_start(args, format);
-    vfprintf(fout, format, args);
+    if (!atomic_load(&flusher_running) || (ring = get_thread_ring()) == NULL)
+    {
+        write_sync(priority, format, args);
+        goto exit;
+    }
+
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == LOG_RING_SIZE)
+    {
+        /* never block hot path, flusher reports count of lost messages */
+        atomic_fetch_add(&dropped, 1);
+        goto exit;
+    }
+    record = &ring->records[head & (LOG_RING_SIZE - 1)];
+    clock_gettime(CLOCK_REALTIME_COARSE, &record->time);
+    record->priority = priority;
+    vsnprintf(record->text, sizeof(record->text), format, args);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+exit:
     va_end(args);
+}
+
+static void flush_rings(void)
+{
+    log_ring_t *ring;
+    size_t lost = atomic_exchange(&dropped, 0);
+    bool written = false;
 
-    fprintf(fout, "\n");
+    pthread_mutex_lock(&output_lock);
+    for (ring = get_rings(); ring != NULL; ring = ring->next)
+    {
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++)
+        {
+            log_record_t *record = &ring->records[tail & (LOG_RING_SIZE - 1)];
+            output(record->priority, &record->time, record->text);
+            written = true;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    if (lost != 0)
+    {
+        struct timespec time;
+        char text[LOG_MESSAGE_SIZE];
+        clock_gettime(CLOCK_REALTIME_COARSE, &time);
+        snprintf(text, sizeof(text), "%lu log messages were dropped", lost);
+        output(ERROR, &time, text);
+        written = true;
+    }
+    if (written && !log_syslog)
+    {
+        fflush(log_file != NULL ? log_file : stdout);
+    }
+    pthread_mutex_unlock(&output_lock);
+}
+
+static void *flusher_thread(__attribute__((unused)) void *arg)
+{
+    struct timespec period = {
+        .tv_sec = 0,
+        .tv_nsec = LOG_FLUSH_PERIOD * 1000000
+    };
+
+    while (atomic_load(&flusher_running))
+    {
+        flush_rings();
+        nanosleep(&period, NULL);
+    }
+    return NULL;
+}
+
+int log_open(const char *file, bool use_syslog)
+{
+    if (use_syslog)
+    {
+        openlog("computation-server", LOG_PID, LOG_DAEMON);
+        log_syslog = true;
+        return 0;
+    }
+    if (file != NULL)
+    {
+        log_file = fopen(file, "a");
+        if (log_file == NULL)
+        {
+            perror("Can not open log file");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int log_start(void)
+{
+    int ret;
+    sigset_t set;
+    sigset_t old_set;
+
+    atomic_store(&flusher_running, true);
+    /* signals are handled by main thread */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+    ret = pthread_create(&flusher, NULL, flusher_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    if (ret != 0)
+    {
+        atomic_store(&flusher_running, false);
+        return -1;
+    }
+    return 0;
+}
+
+void log_stop(void)
+{
+    if (atomic_exchange(&flusher_running, false))
+    {
+        pthread_join(flusher, NULL);
+    }
+    flush_rings();
+
+    if (log_syslog)
+    {
+        closelog();
+        log_syslog = false;
+    }
+    if (log_file != NULL)
+    {
+        fclose(log_file);
+        log_file = NULL;
+    }
 }
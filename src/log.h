@@ -2,6 +2,7 @@
 #define LOG_H_
 
 #include <stdbool.h>
+#include <stdatomic.h>
 
 enum {
     DEBUG = 0,
@@ -9,8 +10,49 @@ enum {
     ERROR,
 };
 
-void logger(int priority, const char *format, ...);
+/* Messages below this level are removed by compiler */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL DEBUG
+#endif
+
+/* Runtime level, set by set_debug(), set_quiet() and log_set_level(), it is changed while threads log */
+extern atomic_int log_level;
+
+/*
+ * Message is formatted by the calling thread and stored in its own ring buffer,
+ * output is done by the flusher thread. Arguments are not evaluated for
+ * disabled levels.
+ */
+#define logger(priority, ...)                                       \
+    do {                                                            \
+        if ((priority) >= LOG_LEVEL &&                              \
+            (priority) >= atomic_load_explicit(&log_level, memory_order_relaxed)) \
+        {                                                           \
+            log_write((priority), __VA_ARGS__);                     \
+        }                                                           \
+    } while (0)
+
+void log_write(int priority, const char *format, ...) __attribute__((format(printf, 2, 3)));
 void set_debug(bool _debug);
 void set_quiet(bool _quiet);
+/* Set runtime level in one step, for control socket */
+void log_set_level(int level);
+
+/**
+ * Open output of messages
+ *
+ * Must be called before daemonizing, so relative path of file is kept.
+ *
+ * @param[in]   file        path of log file, NULL - stdout and stderr.
+ * @param[in]   use_syslog  send messages to syslog instead of file.
+ * @returns     0 if success.
+ */
+int log_open(const char *file, bool use_syslog);
+
+/* Start flusher thread, messages are written synchronously before it */
+int log_start(void);
+
+/* Flush all buffered messages, stop flusher thread and close output */
+void log_stop(void);
 
 #endif /* LOG_H_ */
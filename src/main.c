@@ -14,9 +14,51 @@
 #include "indicators.h"
 #include "server_core.h"
 #include "log.h"
+#include "trace.h"
+#include "batch.h"
+#include "indicators_lib.h"
+#include "affinity.h"
+#include "cluster.h"
 
 #define DEFAILT_IP   "127.0.0.1"
 #define DEFAULT_PORT  5000
+#define DEFAULT_PROGRESS_INTERVAL 1000 /* in milliseconds */
+
+/* Keys for options without short name */
+enum {
+    OPT_PROGRESS_INTERVAL = 0x100,
+    OPT_PARTIAL_RESULTS,
+    OPT_LOAD_SHEDDING,
+    OPT_MAX_SESSIONS,
+    OPT_MAX_INFLIGHT,
+    OPT_MEMORY_BUDGET,
+    OPT_LOG_FILE,
+    OPT_SYSLOG,
+    OPT_METRICS_PORT,
+    OPT_TRACE_DIR,
+    OPT_RECORD_DIR,
+    OPT_SPOOL_DIR,
+    OPT_SPOOL_POLICY,
+    OPT_SPOOL_THRESHOLD,
+    OPT_JOBS_DIR,
+    OPT_WORKERS,
+    OPT_UPGRADE_SOCKET,
+    OPT_WORKER_FD,
+    OPT_BATCH,
+    OPT_BATCH_OUTPUT,
+    OPT_BATCH_FORMAT,
+    OPT_BATCH_THREADS,
+    OPT_PERF_COUNTERS,
+    OPT_INDICATORS_LIB,
+    OPT_CONFIG,
+    OPT_CONTROL_SOCKET,
+    OPT_DEADLINE,
+    OPT_MAX_FILE_SIZE,
+    OPT_CHUNK_SIZE,
+    OPT_LOG_LEVEL,
+    OPT_WORKER_CPUS,
+    OPT_IO_CPUS,
+};
 
 const char *argp_program_version     = "1.0";
 const char *argp_program_bug_address = "<alexeyfonlapshin@gmail.com>";
@@ -28,9 +70,41 @@ struct arguments
     bool      quiet;
     bool      verbose;
     uint8_t   daemonize;
+    unsigned  progress_interval;
+    bool      partial_results;
+    bool      load_shedding;
+    size_t    max_sessions;
+    size_t    max_inflight;
+    size_t    memory_budget;
+    char     *log_file;
+    bool      syslog;
+    uint16_t  metrics_port;
+    char     *trace_dir;
+    char     *record_dir;
+    char     *spool_dir;
+    spool_policy_t spool_policy;
+    size_t    spool_threshold;
+    char     *jobs_dir;
+    size_t    workers;
+    char     *upgrade_socket;
+    int       worker_fd;
+    bool      perf_counters;
+    char     *indicators_lib;
+    char     *config;
+    char     *control_socket;
+    unsigned  deadline;
+    size_t    max_file_size;
+    size_t    chunk_size;
+    char     *worker_cpus;
+    char     *io_cpus;
+    batch_options_t batch;
 };
 
 
+/* Options from configuration file, arguments point to them till exit */
+static char **config_argv = NULL;
+static int config_argc = 0;
+
 static const int handle_signals[] =
 {
     SIGHUP, SIGTERM, SIGINT, SIGQUIT
@@ -39,6 +113,18 @@ static const int handle_signals[] =
 static void signal_handler(__attribute__((unused)) int signal)
 {
     server_exit();
+    cluster_exit();
+}
+
+static void trace_signal_handler(__attribute__((unused)) int signal)
+{
+    trace_request_dump();
+}
+
+static void reload_signal_handler(__attribute__((unused)) int signal)
+{
+    indicators_lib_request_reload();
+    cluster_request_reload();
 }
 
 static int signals_handle_init(void)
@@ -56,6 +142,16 @@ static int signals_handle_init(void)
             return ret;
         }
     }
+
+    act.sa_handler = trace_signal_handler;
+    ret = sigaction(SIGUSR1, &act, NULL);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    act.sa_handler = reload_signal_handler;
+    ret = sigaction(SIGUSR2, &act, NULL);
     return ret;
 }
 
@@ -72,6 +168,28 @@ static int is_number(char *str)
     return 0;
 }
 
+/*
+ * Value of option which is tunable at runtime, in bounds of control socket
+ *
+ * Zero is the default of some options, it is accepted for them out of bounds.
+ * Wrong value stops parsing by argp_error().
+ */
+static size_t parse_tunable(struct argp_state *state, const char *name, char *arg, bool zero_is_default)
+{
+    size_t min = 0, max = 0;
+    unsigned long value;
+
+    errno = 0;
+    value = strtoul(arg, NULL, 10);
+    if (server_get_tunable_bounds(name, &min, &max) != 0 || arg[0] == '\0' || is_number(arg) != 0 ||
+        errno != 0 || ((value < min || value > max) && !(zero_is_default && value == 0)))
+    {
+        argp_error(state, "--%s must be a number in [%lu, %lu] (%s)", name, min, max, arg);
+        return 0;
+    }
+    return value;
+}
+
 static error_t parse_opt (int key, char *arg, struct argp_state *state)
 {
     struct arguments *arguments = state->input;
@@ -105,6 +223,166 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
     case 'd':
         arguments->daemonize = 1;
         break;
+    case OPT_PROGRESS_INTERVAL:
+        arguments->progress_interval = (unsigned)parse_tunable(state, "progress-interval", arg, false);
+        break;
+    case OPT_METRICS_PORT:
+        if(is_number(arg) != 0 || strtoul(arg, &tmp, 10) > USHRT_MAX)
+        {
+            printf("Input metrics port value not a number! (%s)\n", arg);
+            return -1;
+        }
+        arguments->metrics_port = (uint16_t)strtoul(arg, &tmp, 10);
+        break;
+    case OPT_PERF_COUNTERS:
+        arguments->perf_counters = true;
+        break;
+    case OPT_TRACE_DIR:
+        arguments->trace_dir = arg;
+        break;
+    case OPT_RECORD_DIR:
+        arguments->record_dir = arg;
+        break;
+    case OPT_SPOOL_DIR:
+        arguments->spool_dir = arg;
+        break;
+    case OPT_INDICATORS_LIB:
+        arguments->indicators_lib = arg;
+        break;
+    case OPT_CONFIG:
+        arguments->config = arg;
+        break;
+    case OPT_CONTROL_SOCKET:
+        arguments->control_socket = arg;
+        break;
+    case OPT_WORKER_CPUS:
+        arguments->worker_cpus = arg;
+        break;
+    case OPT_IO_CPUS:
+        arguments->io_cpus = arg;
+        break;
+    case OPT_LOG_LEVEL:
+        if (strcmp(arg, "debug") != 0 && strcmp(arg, "info") != 0 && strcmp(arg, "error") != 0)
+        {
+            printf("Unknown log level! (%s)\n", arg);
+            return -1;
+        }
+        arguments->verbose = strcmp(arg, "debug") == 0;
+        arguments->quiet   = strcmp(arg, "error") == 0;
+        break;
+    /* bounds keep multiplications below from overflow */
+    case OPT_DEADLINE:
+        arguments->deadline = (unsigned)parse_tunable(state, "deadline", arg, false);
+        break;
+    case OPT_MAX_FILE_SIZE:
+        arguments->max_file_size = parse_tunable(state, "max-file-size", arg, false) * 1000 * 1000;
+        break;
+    case OPT_CHUNK_SIZE:
+        arguments->chunk_size = parse_tunable(state, "chunk-size", arg, false) * 1000;
+        break;
+    case OPT_JOBS_DIR:
+        arguments->jobs_dir = arg;
+        break;
+    case OPT_SPOOL_POLICY:
+        if (strcmp(arg, "delete") == 0)
+        {
+            arguments->spool_policy = SPOOL_DELETE;
+        }
+        else if (strcmp(arg, "retain") == 0)
+        {
+            arguments->spool_policy = SPOOL_RETAIN;
+        }
+        else if (strcmp(arg, "retain-failed") == 0)
+        {
+            arguments->spool_policy = SPOOL_RETAIN_FAILED;
+        }
+        else
+        {
+            printf("Unknown spool policy! (%s)\n", arg);
+            return -1;
+        }
+        break;
+    case OPT_SPOOL_THRESHOLD:
+        arguments->spool_threshold = parse_tunable(state, "spool-threshold", arg, false) * 1000 * 1000;
+        break;
+    case OPT_BATCH:
+    {
+        char **paths = realloc(arguments->batch.paths, sizeof(*paths) * (arguments->batch.paths_count + 1));
+        if (paths == NULL)
+        {
+            printf("Can not allocate memory\n");
+            return -1;
+        }
+        arguments->batch.paths = paths;
+        arguments->batch.paths[arguments->batch.paths_count++] = arg;
+        break;
+    }
+    case OPT_BATCH_OUTPUT:
+        arguments->batch.output = arg;
+        break;
+    case OPT_BATCH_FORMAT:
+        if (strcmp(arg, "csv") == 0)
+        {
+            arguments->batch.format = BATCH_FORMAT_CSV;
+        }
+        else if (strcmp(arg, "json") == 0)
+        {
+            arguments->batch.format = BATCH_FORMAT_JSON;
+        }
+        else
+        {
+            printf("Unknown batch format! (%s)\n", arg);
+            return -1;
+        }
+        break;
+    case OPT_BATCH_THREADS:
+        if(is_number(arg) != 0)
+        {
+            printf("Input value not a number! (%s)\n", arg);
+            return -1;
+        }
+        arguments->batch.threads = strtoul(arg, &tmp, 10);
+        break;
+    case OPT_LOG_FILE:
+        arguments->log_file = arg;
+        break;
+    case OPT_SYSLOG:
+        arguments->syslog = true;
+        break;
+    case OPT_PARTIAL_RESULTS:
+        arguments->partial_results = true;
+        break;
+    case OPT_LOAD_SHEDDING:
+        arguments->load_shedding = true;
+        break;
+    case OPT_UPGRADE_SOCKET:
+        arguments->upgrade_socket = arg;
+        break;
+    case OPT_WORKER_FD:
+        arguments->worker_fd = atoi(arg);
+        break;
+    case OPT_MAX_INFLIGHT:
+        arguments->max_inflight = parse_tunable(state, "max-inflight", arg, true) * 1000 * 1000;
+        break;
+    case OPT_MEMORY_BUDGET:
+        arguments->memory_budget = parse_tunable(state, "memory-budget", arg, true) * 1000 * 1000;
+        break;
+    case OPT_WORKERS:
+    case OPT_MAX_SESSIONS:
+        if(is_number(arg) != 0)
+        {
+            printf("Input value not a number! (%s)\n", arg);
+            return -1;
+        }
+        if (key == OPT_WORKERS)
+        {
+            arguments->workers = strtoul(arg, &tmp, 10);
+        }
+        else
+        {
+            arguments->max_sessions = strtoul(arg, &tmp, 10);
+        }
+        break;
 
 
     default:
@@ -113,14 +391,183 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
     return 0;
 }
 
+/*
+ * Read configuration file to arguments vector
+ *
+ * Every line is long option without dashes, "name = value" or "name" for
+ * flags. Empty lines and lines started by # are skipped.
+ */
+static int read_config(const char *path, char *argv0)
+{
+    int ret = -1;
+    char line[1024];
+    size_t number = 0;
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+    {
+        printf("Can not open configuration file %s (%d:%s)\n", path, errno, strerror(errno));
+        return -1;
+    }
+    config_argv = calloc(sizeof(*config_argv), 2);
+    if (config_argv == NULL)
+    {
+        goto exit;
+    }
+    config_argv[config_argc++] = argv0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char *name = line;
+        char *value;
+        char *end;
+        char **new_argv;
+        size_t size;
+
+        number++;
+        while (isspace((unsigned char)*name))
+        {
+            name++;
+        }
+        if (*name == '\0' || *name == '#')
+        {
+            continue;
+        }
+        value = strchr(name, '=');
+        end = (value != NULL) ? value : name + strlen(name);
+        while (end > name && isspace((unsigned char)end[-1]))
+        {
+            end--;
+        }
+        *end = '\0';
+        if (value != NULL)
+        {
+            value++;
+            while (isspace((unsigned char)*value))
+            {
+                value++;
+            }
+            end = value + strlen(value);
+            while (end > value && isspace((unsigned char)end[-1]))
+            {
+                end--;
+            }
+            *end = '\0';
+        }
+
+        size = strlen("--=") + strlen(name) + ((value != NULL) ? strlen(value) : 0) + 1;
+        new_argv = realloc(config_argv, sizeof(*config_argv) * (size_t)(config_argc + 2));
+        if (new_argv == NULL)
+        {
+            goto exit;
+        }
+        config_argv = new_argv;
+        config_argv[config_argc] = malloc(size);
+        if (config_argv[config_argc] == NULL)
+        {
+            goto exit;
+        }
+        if (value != NULL)
+        {
+            snprintf(config_argv[config_argc], size, "--%s=%s", name, value);
+        }
+        else
+        {
+            snprintf(config_argv[config_argc], size, "--%s", name);
+        }
+        config_argv[++config_argc] = NULL;
+    }
+    ret = 0;
+
+exit:
+    if (ret != 0)
+    {
+        printf("Can not read configuration file %s, line %lu\n", path, number);
+    }
+    fclose(file);
+    return ret;
+}
+
+static void free_config(void)
+{
+    int i;
+    /* the first one is argv[0] of the server */
+    for (i = 1; i < config_argc; i++)
+    {
+        free(config_argv[i]);
+    }
+    free(config_argv);
+    config_argv = NULL;
+    config_argc = 0;
+}
+
 static int parse_parameters(int argc, char **argv, struct arguments *arguments)
 {
+    int ret;
+    char *config;
+    struct arguments defaults = *arguments;
     struct argp_option options[] = {
         {"quiet", 'q',  NULL, 0,  "Print only error messages", 0},
         {"verbose", 'V',  NULL, 0,  "Print debug messages", 0},
         {"ip", 'i', "address", 0,  "Server ip address (default: localhost)", 0},
         {"port", 'p', "port", 0,  "Server TCP port (default: 5000)", 0},
         {"daemonize", 'd',  NULL, 0,  "Run as a daemon", 0},
+        {"progress-interval", OPT_PROGRESS_INTERVAL, "ms", 0,  "Period of interim results for progressive "
+                                                              "sessions, 0 disables them (default: 1000)", 0},
+        {"partial-results", OPT_PARTIAL_RESULTS, NULL, 0,  "Send results computed so far when deadline expires", 0},
+        {"load-shedding", OPT_LOAD_SHEDDING, NULL, 0,  "Process only part of frames of new sessions when "
+                                                      "server is overloaded", 0},
+        {"max-sessions", OPT_MAX_SESSIONS, "count", 0,  "Sessions processed in parallel, others are "
+                                                       "answered by busy status (default: 1)", 0},
+        {"max-inflight", OPT_MAX_INFLIGHT, "MB", 0,  "Limit of files size in all sessions "
+                                                    "(default: 80MB per session)", 0},
+        {"memory-budget", OPT_MEMORY_BUDGET, "MB", 0,  "Memory for receive buffers of all sessions, "
+                                                      "uploads wait while it is taken (default: 80MB per session)", 0},
+        {"metrics-port", OPT_METRICS_PORT, "port", 0,  "Serve Prometheus metrics on localhost port "
+                                                     "(default: disabled)", 0},
+        {"trace-dir", OPT_TRACE_DIR, "path", 0,  "Write Chrome trace of every session to directory, "
+                                                "SIGUSR1 writes trace of all sessions", 0},
+        {"record-dir", OPT_RECORD_DIR, "path", 0,  "Record every session to directory for "
+                                                  "dash_cam --replay", 0},
+        {"spool-dir", OPT_SPOOL_DIR, "path", 0,  "Receive files to memory mapped files in directory, "
+                                                "file size is not limited by 80MB", 0},
+        {"spool-policy", OPT_SPOOL_POLICY, "policy", 0,  "What to do with spool file after session: "
+                                                        "delete, retain, retain-failed (default: delete)", 0},
+        {"spool-threshold", OPT_SPOOL_THRESHOLD, "MB", 0,  "Only files bigger than this are spooled, "
+                                                          "files bigger than 80MB are always spooled (default: 0)", 0},
+        {"jobs-dir", OPT_JOBS_DIR, "path", 0,  "Accept async sessions, store their files to journal in "
+                                              "directory and keep results for fetching", 0},
+        {"workers", OPT_WORKERS, "count", 0,  "Run coordinator which passes connections to worker processes "
+                                             "by their load, every worker has options of the server", 0},
+        {"upgrade-socket", OPT_UPGRADE_SOCKET, "path", 0,  "Unix socket for upgrade: new server started with "
+                                                          "the same path takes listening socket, old one "
+                                                          "drains its sessions and exits", 0},
+        {"worker-fd", OPT_WORKER_FD, "fd", OPTION_HIDDEN,  "Control channel from coordinator", 0},
+        {"batch", OPT_BATCH, "path", 0,  "Process file or all files of directory without network and exit, "
+                                        "option could be repeated", 0},
+        {"batch-output", OPT_BATCH_OUTPUT, "path", 0,  "File for batch results (default: stdout)", 0},
+        {"batch-format", OPT_BATCH_FORMAT, "csv|json", 0,  "Format of batch results, line per file "
+                                                          "(default: csv)", 0},
+        {"batch-threads", OPT_BATCH_THREADS, "count", 0,  "Workers for batch mode (default: all cores)", 0},
+        {"config", OPT_CONFIG, "path", 0,  "Read options from file, line per long option: name = value, "
+                                          "command line options override them", 0},
+        {"control-socket", OPT_CONTROL_SOCKET, "path", 0,  "Unix socket for commands list, get, set, stats "
+                                                          "and reload, tunables are changed without restart", 0},
+        {"log-level", OPT_LOG_LEVEL, "level", 0,  "Print messages of level and above: debug, info, error "
+                                                 "(default: info)", 0},
+        {"deadline", OPT_DEADLINE, "seconds", 0,  "Time for processing of session (default: 35)", 0},
+        {"max-file-size", OPT_MAX_FILE_SIZE, "MB", 0,  "Bigger files are spooled or rejected (default: 80)", 0},
+        {"chunk-size", OPT_CHUNK_SIZE, "KB", 0,  "Received frames are passed to indicators by chunks of at "
+                                                "least this size (default: every read)", 0},
+        {"worker-cpus", OPT_WORKER_CPUS, "list", 0,  "CPUs for workers of indicators, like 0-7,16 "
+                                                    "(default: all)", 0},
+        {"io-cpus", OPT_IO_CPUS, "list", 0,  "CPUs for accepting and receiving threads (default: all)", 0},
+        {"indicators-lib", OPT_INDICATORS_LIB, "path", 0,  "Load indicators from shared library, it is "
+                                                          "reloaded when file is changed or on SIGUSR2, "
+                                                          "running sessions finish with old version", 0},
+        {"perf-counters", OPT_PERF_COUNTERS, NULL, 0,  "Collect hardware counters of every indicator, "
+                                                      "they are printed on exit", 0},
+        {"log-file", OPT_LOG_FILE, "path", 0,  "Write messages to file instead of stdout and stderr", 0},
+        {"syslog", OPT_SYSLOG, NULL, 0,  "Send messages to syslog", 0},
         { 0 },
     };
     char *doc = "This is a computation server which receives video files from"
@@ -129,6 +576,25 @@ static int parse_parameters(int argc, char **argv, struct arguments *arguments)
                 "to the vehicle in the same connection";
     struct argp argp = {options, parse_opt, NULL, doc, NULL, NULL, NULL};
 
+    ret = argp_parse(&argp, argc, argv, 0, 0, arguments);
+    if (ret != 0 || arguments->config == NULL)
+    {
+        return ret;
+    }
+
+    /* options of file are parsed first, so command line overrides them */
+    config = arguments->config;
+    free(arguments->batch.paths);
+    *arguments = defaults;
+    if (read_config(config, argv[0]) != 0)
+    {
+        return -1;
+    }
+    ret = argp_parse(&argp, config_argc, config_argv, 0, 0, arguments);
+    if (ret != 0)
+    {
+        return ret;
+    }
     return argp_parse(&argp, argc, argv, 0, 0, arguments);
 }
 
@@ -138,8 +604,37 @@ int main(int argc, char **argv) {
         .port = DEFAULT_PORT,
         .quiet = false,
         .verbose = false,
-        .daemonize = 0
+        .daemonize = 0,
+        .progress_interval = DEFAULT_PROGRESS_INTERVAL,
+        .partial_results = false,
+        .load_shedding = false,
+        .max_sessions = 0,
+        .max_inflight = 0,
+        .memory_budget = 0,
+        .log_file = NULL,
+        .syslog = false,
+        .metrics_port = 0,
+        .trace_dir = NULL,
+        .record_dir = NULL,
+        .spool_dir = NULL,
+        .jobs_dir = NULL,
+        .workers = 0,
+        .upgrade_socket = NULL,
+        .worker_fd = -1,
+        .spool_policy = SPOOL_DELETE,
+        .spool_threshold = 0,
+        .batch = {NULL, 0, NULL, BATCH_FORMAT_CSV, 0},
+        .perf_counters = false,
+        .indicators_lib = NULL,
+        .config = NULL,
+        .control_socket = NULL,
+        .deadline = 0,
+        .max_file_size = 0,
+        .chunk_size = 0,
+        .worker_cpus = NULL,
+        .io_cpus = NULL
     };
+    server_options_t options;
 
     int operation = -1;
     int ret = parse_parameters(argc, argv, &arguments);
@@ -158,7 +653,15 @@ int main(int argc, char **argv) {
     }
 
     operation--;
-    if(arguments.daemonize == 1)
+    ret = log_open(arguments.log_file, arguments.syslog);
+    if(ret != 0)
+    {
+        goto exit;
+    }
+
+    operation--;
+    /* worker stays child of coordinator */
+    if(arguments.daemonize == 1 && arguments.worker_fd == -1)
     {
         ret = daemon(0, 0); //don't change working dir. Silent
         if(ret != 0)
@@ -170,9 +673,85 @@ int main(int argc, char **argv) {
     set_debug(arguments.verbose);
     set_quiet(arguments.quiet);
 
-    server_run(arguments.ip, arguments.port);
+    operation--;
+    ret = log_start();
+    if(ret != 0)
+    {
+        perror("Can't start logger\n");
+        goto exit;
+    }
+
+    options.ip                   = arguments.ip;
+    options.port                 = arguments.port;
+    options.progress_interval_ms = arguments.progress_interval;
+    options.partial_results      = arguments.partial_results;
+    options.load_shedding        = arguments.load_shedding;
+    options.max_sessions         = arguments.max_sessions;
+    options.max_inflight_bytes   = arguments.max_inflight;
+    options.memory_budget        = arguments.memory_budget;
+    options.metrics_port         = arguments.metrics_port;
+    options.trace_dir            = arguments.trace_dir;
+    options.record_dir           = arguments.record_dir;
+    options.spool_dir            = arguments.spool_dir;
+    options.spool_policy         = arguments.spool_policy;
+    options.spool_threshold      = arguments.spool_threshold;
+    options.jobs_dir             = arguments.jobs_dir;
+    options.perf_counters        = arguments.perf_counters;
+    options.upgrade_socket       = arguments.upgrade_socket;
+    options.worker_fd            = arguments.worker_fd;
+    options.deadline_s           = arguments.deadline;
+    options.max_file_size        = arguments.max_file_size;
+    options.chunk_size           = arguments.chunk_size;
+    options.control_socket       = arguments.control_socket;
+    if (arguments.workers != 0 && arguments.worker_fd == -1 && arguments.batch.paths_count == 0)
+    {
+        operation--;
+        if (arguments.jobs_dir != NULL)
+        {
+            /* job ids and journal are owned by one process */
+            logger(ERROR, "Async sessions are not supported with workers");
+            ret = -1;
+            goto exit;
+        }
+        if (arguments.control_socket != NULL)
+        {
+            /* tunables are owned by every worker */
+            logger(ERROR, "Control socket is not supported with workers");
+            ret = -1;
+            goto exit;
+        }
+        ret = cluster_run(&options, arguments.workers, argc, argv);
+        goto exit;
+    }
+
+    operation--;
+    ret = affinity_init(arguments.worker_cpus, arguments.io_cpus);
+    if(ret != 0)
+    {
+        goto exit;
+    }
+
+    operation--;
+    /* batch is finished by one version of library */
+    ret = indicators_lib_init(arguments.indicators_lib, arguments.batch.paths_count == 0);
+    if(ret != 0)
+    {
+        goto exit;
+    }
+    if (arguments.batch.paths_count != 0)
+    {
+        ret = batch_run(&arguments.batch);
+    }
+    else
+    {
+        server_run(&options);
+    }
+    indicators_lib_deinit();
 
 exit:
+    free(arguments.batch.paths);
+    free_config();
+    log_stop();
     return ret == 0 ? ret : operation;
 }
 
@@ -0,0 +1,109 @@
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+#include "log.h"
+#include "memory_governor.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t released;
+static size_t budget = 0;
+static size_t used = 0;
+
+int memory_governor_init(size_t size)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&released, &attr) != 0)
+    {
+        logger(ERROR, "Can not init memory governor condition");
+        pthread_condattr_destroy(&attr);
+        return -1;
+    }
+    pthread_condattr_destroy(&attr);
+
+    budget = size;
+    used = 0;
+    logger(DEBUG, "Memory budget is %lu bytes", budget);
+    return 0;
+}
+
+void memory_governor_deinit(void)
+{
+    pthread_cond_destroy(&released);
+}
+
+memory_reserve_status_t memory_governor_reserve(size_t size, unsigned timeout_ms)
+{
+    memory_reserve_status_t ret = MEMORY_RESERVED;
+    struct timespec deadline = {0};
+
+    if (size > memory_governor_get_budget())
+    {
+        logger(ERROR, "%lu bytes do not fit into memory budget %lu", size, memory_governor_get_budget());
+        return MEMORY_NEVER_FITS;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec  += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&lock);
+    while (used + size > budget)
+    {
+        logger(DEBUG, "Memory budget is tight (%lu + %lu > %lu), waiting", used, size, budget);
+        if (pthread_cond_timedwait(&released, &lock, &deadline) == ETIMEDOUT)
+        {
+            ret = MEMORY_TIMEOUT;
+            goto exit;
+        }
+    }
+    used += size;
+
+exit:
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+void memory_governor_release(size_t size)
+{
+    pthread_mutex_lock(&lock);
+    used -= size;
+    pthread_cond_broadcast(&released);
+    pthread_mutex_unlock(&lock);
+}
+
+size_t memory_governor_get_used(void)
+{
+    size_t ret;
+    pthread_mutex_lock(&lock);
+    ret = used;
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+size_t memory_governor_get_budget(void)
+{
+    size_t ret;
+    pthread_mutex_lock(&lock);
+    ret = budget;
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+void memory_governor_set_budget(size_t size)
+{
+    pthread_mutex_lock(&lock);
+    budget = size;
+    /* waiting sessions could fit now */
+    pthread_cond_broadcast(&released);
+    pthread_mutex_unlock(&lock);
+    logger(DEBUG, "Memory budget is %lu bytes", size);
+}
@@ -0,0 +1,34 @@
+#ifndef MEMORY_GOVERNOR_H_
+#define MEMORY_GOVERNOR_H_
+
+#include <stddef.h>
+
+typedef enum memory_reserve_status_e {
+    MEMORY_RESERVED = 0,
+    MEMORY_TIMEOUT,     /* budget is still taken by other sessions */
+    MEMORY_NEVER_FITS   /* request is bigger than the whole budget */
+} memory_reserve_status_t;
+
+int memory_governor_init(size_t budget);
+void memory_governor_deinit(void);
+
+/**
+ * Reserve bytes from global memory budget
+ *
+ * If the budget is taken by other sessions, caller is blocked until enough
+ * bytes are released or timeout expires.
+ *
+ * @param[in]   size        bytes to reserve.
+ * @param[in]   timeout_ms  maximum time for waiting.
+ * @returns     MEMORY_RESERVED if success, reserved bytes must be released by
+ *              memory_governor_release().
+ */
+memory_reserve_status_t memory_governor_reserve(size_t size, unsigned timeout_ms);
+void memory_governor_release(size_t size);
+
+size_t memory_governor_get_used(void);
+size_t memory_governor_get_budget(void);
+/* Change budget at runtime, reserved bytes are kept even if they exceed it */
+void memory_governor_set_budget(size_t budget);
+
+#endif /* MEMORY_GOVERNOR_H_ */
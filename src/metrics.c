@@ -0,0 +1,410 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "log.h"
+#include "metrics.h"
+#include "server_utils.h"
+
+#define METRICS_SHARDS 16          /* threads are spread over shards, power of two */
+#define METRICS_SUB_BUCKETS_BITS 2 /* 4 buckets per power of two, error is below 25% */
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BUCKETS_BITS)
+#define METRICS_MAX_EXPONENT 39    /* values up to 2^40 */
+#define METRICS_BUCKETS ((METRICS_MAX_EXPONENT - METRICS_SUB_BUCKETS_BITS + 2) * METRICS_SUB_BUCKETS)
+#define METRICS_POLL_TIMEOUT 200   /* in milliseconds, stop flag is checked between polls */
+#define METRICS_REQUEST_TIMEOUT 1000 /* in milliseconds */
+#define METRICS_CACHE_LINE 64
+
+typedef struct metrics_counters_shard_s {
+    atomic_uint_fast64_t counters[METRICS_COUNTERS_COUNT];
+} __attribute__((aligned(METRICS_CACHE_LINE))) metrics_counters_shard_t;
+
+/* Log-linear histogram, like HDR histogram with 2 significant bits */
+typedef struct metrics_histogram_shard_s {
+    atomic_uint_fast64_t buckets[METRICS_BUCKETS];
+    atomic_uint_fast64_t sum;
+} __attribute__((aligned(METRICS_CACHE_LINE))) metrics_histogram_shard_t;
+
+typedef struct metrics_indicator_shard_s {
+    atomic_uint_fast64_t bytes;
+    atomic_uint_fast64_t time_us;
+} __attribute__((aligned(METRICS_CACHE_LINE))) metrics_indicator_shard_t;
+
+typedef struct metrics_histogram_desc_s {
+    const char *name;
+    const char *help;
+    double      scale; /* exported value is value / scale */
+} metrics_histogram_desc_t;
+
+static const char *counters_desc[METRICS_COUNTERS_COUNT][2] = {
+    {"dashcam_sessions_accepted_total",  "Sessions which took a slot"},
+    {"dashcam_sessions_failed_total",    "Sessions finished without results"},
+    {"dashcam_sessions_timed_out_total", "Sessions which reached the deadline"},
+    {"dashcam_sessions_rejected_total",  "Sessions answered by busy or too large status"},
+    {"dashcam_received_bytes_total",     "File bytes received from dash cams"},
+    {"dashcam_numa_local_bytes_total",   "Bytes read by indicators from receive buffer on their NUMA node"},
+    {"dashcam_numa_remote_bytes_total",  "Bytes read by indicators from receive buffer on other NUMA node"},
+};
+
+static const metrics_histogram_desc_t histograms_desc[METRICS_HISTOGRAMS_COUNT] = {
+    {"dashcam_task_wait_seconds",        "Time of task in thread pool queue", 1000000.0},
+    {"dashcam_response_latency_seconds", "Time from the last received byte to response", 1000000.0},
+    {"dashcam_receive_rate_bytes_per_second", "Upload speed of session", 1.0},
+};
+
+static metrics_counters_shard_t *counters = NULL;
+/* METRICS_HISTOGRAMS_COUNT histograms, then compute time of every indicator */
+static metrics_histogram_shard_t *histograms = NULL;
+static metrics_indicator_shard_t *indicators = NULL;
+static size_t indicators_count = 0;
+
+static pthread_key_t shard_key;
+static atomic_size_t next_shard = 0;
+
+static int server_fd = -1;
+static pthread_t server_thread;
+static atomic_bool server_running = false;
+static metrics_gauges_writer_t gauges_writer = NULL;
+
+static void *alloc_shards(size_t size)
+{
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, METRICS_CACHE_LINE, size) != 0)
+    {
+        return NULL;
+    }
+    memset(ptr, 0x00, size);
+    return ptr;
+}
+
+int metrics_init(size_t count)
+{
+    size_t histograms_count = METRICS_HISTOGRAMS_COUNT + count;
+
+    if (pthread_key_create(&shard_key, NULL) != 0)
+    {
+        logger(ERROR, "Can not create key for metrics shards");
+        return -1;
+    }
+    counters   = alloc_shards(sizeof(*counters) * METRICS_SHARDS);
+    histograms = alloc_shards(sizeof(*histograms) * METRICS_SHARDS * histograms_count);
+    indicators = alloc_shards(sizeof(*indicators) * METRICS_SHARDS * count);
+    if (counters == NULL || histograms == NULL || indicators == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for metrics");
+        metrics_deinit();
+        return -1;
+    }
+    indicators_count = count;
+    return 0;
+}
+
+void metrics_deinit(void)
+{
+    free(counters);
+    counters = NULL;
+    free(histograms);
+    histograms = NULL;
+    free(indicators);
+    indicators = NULL;
+    indicators_count = 0;
+}
+
+static size_t get_shard(void)
+{
+    size_t shard = (size_t)pthread_getspecific(shard_key);
+    if (shard == 0)
+    {
+        /* 0 means the thread has no shard yet */
+        shard = (atomic_fetch_add(&next_shard, 1) % METRICS_SHARDS) + 1;
+        pthread_setspecific(shard_key, (void *)shard);
+    }
+    return shard - 1;
+}
+
+static size_t get_bucket(uint64_t value)
+{
+    size_t exponent;
+    size_t bucket;
+
+    if (value < METRICS_SUB_BUCKETS)
+    {
+        return (size_t)value;
+    }
+    exponent = 63 - (size_t)__builtin_clzll(value);
+    if (exponent > METRICS_MAX_EXPONENT)
+    {
+        return METRICS_BUCKETS - 1;
+    }
+    bucket = (value >> (exponent - METRICS_SUB_BUCKETS_BITS)) & (METRICS_SUB_BUCKETS - 1);
+    return (exponent - METRICS_SUB_BUCKETS_BITS + 1) * METRICS_SUB_BUCKETS + bucket;
+}
+
+/* The biggest value which falls into bucket */
+static uint64_t get_bucket_bound(size_t bucket)
+{
+    size_t exponent;
+    uint64_t sub;
+
+    if (bucket < METRICS_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    exponent = bucket / METRICS_SUB_BUCKETS + METRICS_SUB_BUCKETS_BITS - 1;
+    sub = (METRICS_SUB_BUCKETS + bucket % METRICS_SUB_BUCKETS);
+    return ((sub + 1) << (exponent - METRICS_SUB_BUCKETS_BITS)) - 1;
+}
+
+static void histogram_record(size_t histogram, uint64_t value)
+{
+    metrics_histogram_shard_t *shard = &histograms[histogram * METRICS_SHARDS + get_shard()];
+    atomic_fetch_add_explicit(&shard->buckets[get_bucket(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->sum, value, memory_order_relaxed);
+}
+
+void metrics_count(metrics_counter_t id, uint64_t value)
+{
+    if (counters == NULL)
+    {
+        return;
+    }
+    atomic_fetch_add_explicit(&counters[get_shard()].counters[id], value, memory_order_relaxed);
+}
+
+void metrics_record(metrics_histogram_t id, uint64_t value)
+{
+    if (histograms == NULL)
+    {
+        return;
+    }
+    histogram_record(id, value);
+}
+
+void metrics_record_indicator(size_t index, uint64_t bytes, uint64_t time_us)
+{
+    metrics_indicator_shard_t *shard;
+    if (indicators == NULL || index >= indicators_count)
+    {
+        return;
+    }
+    shard = &indicators[index * METRICS_SHARDS + get_shard()];
+    atomic_fetch_add_explicit(&shard->bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->time_us, time_us, memory_order_relaxed);
+    histogram_record(METRICS_HISTOGRAMS_COUNT + index, time_us);
+}
+
+static void write_histogram(FILE *out, size_t histogram, const char *name, const char *labels, double scale)
+{
+    size_t i, k;
+    uint64_t buckets[METRICS_BUCKETS] = {0};
+    uint64_t sum = 0;
+    uint64_t count = 0;
+    size_t last = 0;
+
+    for (k = 0; k < METRICS_SHARDS; k++)
+    {
+        metrics_histogram_shard_t *shard = &histograms[histogram * METRICS_SHARDS + k];
+        for (i = 0; i < METRICS_BUCKETS; i++)
+        {
+            buckets[i] += atomic_load_explicit(&shard->buckets[i], memory_order_relaxed);
+        }
+        sum += atomic_load_explicit(&shard->sum, memory_order_relaxed);
+    }
+    for (i = 0; i < METRICS_BUCKETS; i++)
+    {
+        if (buckets[i] != 0)
+        {
+            last = i;
+        }
+    }
+    /* buckets above the biggest recorded value are covered by +Inf */
+    for (i = 0; i <= last; i++)
+    {
+        count += buckets[i];
+        fprintf(out, "%s_bucket{%s%sle=\"%g\"} %lu\n", name, labels, (labels[0] != '\0') ? "," : "",
+                (double)get_bucket_bound(i) / scale, count);
+    }
+    fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, (labels[0] != '\0') ? "," : "", count);
+    fprintf(out, "%s_sum%s%s%s %g\n", name, (labels[0] != '\0') ? "{" : "", labels,
+            (labels[0] != '\0') ? "}" : "", (double)sum / scale);
+    fprintf(out, "%s_count%s%s%s %lu\n", name, (labels[0] != '\0') ? "{" : "", labels,
+            (labels[0] != '\0') ? "}" : "", count);
+}
+
+void metrics_write(FILE *out)
+{
+    size_t i, k;
+    char labels[48];
+
+    for (i = 0; i < METRICS_COUNTERS_COUNT; i++)
+    {
+        uint64_t value = 0;
+        for (k = 0; k < METRICS_SHARDS; k++)
+        {
+            value += atomic_load_explicit(&counters[k].counters[i], memory_order_relaxed);
+        }
+        fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+                counters_desc[i][0], counters_desc[i][1], counters_desc[i][0], counters_desc[i][0], value);
+    }
+
+    for (i = 0; i < METRICS_HISTOGRAMS_COUNT; i++)
+    {
+        fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n",
+                histograms_desc[i].name, histograms_desc[i].help, histograms_desc[i].name);
+        write_histogram(out, i, histograms_desc[i].name, "", histograms_desc[i].scale);
+    }
+
+    fprintf(out, "# HELP dashcam_indicator_processed_bytes_total Bytes passed to indicator\n"
+                 "# TYPE dashcam_indicator_processed_bytes_total counter\n");
+    for (i = 0; i < indicators_count; i++)
+    {
+        uint64_t bytes = 0;
+        for (k = 0; k < METRICS_SHARDS; k++)
+        {
+            bytes += atomic_load_explicit(&indicators[i * METRICS_SHARDS + k].bytes, memory_order_relaxed);
+        }
+        fprintf(out, "dashcam_indicator_processed_bytes_total{indicator=\"%lu\"} %lu\n", i, bytes);
+    }
+
+    fprintf(out, "# HELP dashcam_indicator_compute_seconds_total Time spent in indicator\n"
+                 "# TYPE dashcam_indicator_compute_seconds_total counter\n");
+    for (i = 0; i < indicators_count; i++)
+    {
+        uint64_t time_us = 0;
+        for (k = 0; k < METRICS_SHARDS; k++)
+        {
+            time_us += atomic_load_explicit(&indicators[i * METRICS_SHARDS + k].time_us, memory_order_relaxed);
+        }
+        fprintf(out, "dashcam_indicator_compute_seconds_total{indicator=\"%lu\"} %g\n", i, (double)time_us / 1000000.0);
+    }
+
+    fprintf(out, "# HELP dashcam_indicator_task_seconds Time of one chunk in indicator\n"
+                 "# TYPE dashcam_indicator_task_seconds histogram\n");
+    for (i = 0; i < indicators_count; i++)
+    {
+        snprintf(labels, sizeof(labels), "indicator=\"%lu\"", i);
+        write_histogram(out, METRICS_HISTOGRAMS_COUNT + i, "dashcam_indicator_task_seconds", labels, 1000000.0);
+    }
+}
+
+static void serve_request(const int fd)
+{
+    char request[1024] = {0};
+    char header[128];
+    char *body = NULL;
+    size_t body_size = 0;
+    FILE *out = NULL;
+    struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+    ssize_t read_size;
+
+    if (poll(&pfd, 1, METRICS_REQUEST_TIMEOUT) <= 0)
+    {
+        return;
+    }
+    read_size = recv(fd, request, sizeof(request) - 1, 0);
+    if (read_size <= 0)
+    {
+        return;
+    }
+
+    if (strncmp(request, "GET /metrics ", strlen("GET /metrics ")) != 0 &&
+        strncmp(request, "GET / ", strlen("GET / ")) != 0)
+    {
+        const char *not_found = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        write_wrapper(fd, not_found, strlen(not_found));
+        return;
+    }
+
+    out = open_memstream(&body, &body_size);
+    if (out == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for metrics");
+        return;
+    }
+    metrics_write(out);
+    if (gauges_writer != NULL)
+    {
+        gauges_writer(out);
+    }
+    fclose(out);
+
+    snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+             "Content-Type: text/plain; version=0.0.4\r\n"
+             "Content-Length: %lu\r\nConnection: close\r\n\r\n", body_size);
+    if (write_wrapper(fd, header, strlen(header)) != 0 || write_wrapper(fd, body, body_size) != 0)
+    {
+        logger(DEBUG, "Metrics were not sent");
+    }
+    free(body);
+}
+
+static void *metrics_server(__attribute__((unused)) void *arg)
+{
+    struct pollfd pfd = {.fd = server_fd, .events = POLLIN, .revents = 0};
+
+    while (atomic_load(&server_running))
+    {
+        int fd;
+        if (poll(&pfd, 1, METRICS_POLL_TIMEOUT) <= 0)
+        {
+            continue;
+        }
+        fd = accept_connection(server_fd);
+        if (fd < 0)
+        {
+            continue;
+        }
+        serve_request(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int metrics_start(uint16_t port, metrics_gauges_writer_t writer)
+{
+    int ret;
+    sigset_t set;
+    sigset_t old_set;
+
+    server_fd = init_server("127.0.0.1", port, 8);
+    if (server_fd < 0)
+    {
+        logger(ERROR, "Can not listen metrics port %u", port);
+        return -1;
+    }
+    gauges_writer = writer;
+    atomic_store(&server_running, true);
+
+    /* signals are handled by main thread */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &old_set);
+    ret = pthread_create(&server_thread, NULL, metrics_server, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    if (ret != 0)
+    {
+        logger(ERROR, "Can not create metrics thread (%d:%s)", ret, strerror(ret));
+        atomic_store(&server_running, false);
+        close(server_fd);
+        server_fd = -1;
+        return -1;
+    }
+    logger(INFO, "Metrics are available on http://127.0.0.1:%u/metrics", port);
+    return 0;
+}
+
+void metrics_stop(void)
+{
+    if (!atomic_exchange(&server_running, false))
+    {
+        return;
+    }
+    pthread_join(server_thread, NULL);
+    close(server_fd);
+    server_fd = -1;
+}
@@ -0,0 +1,56 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum metrics_counter_e {
+    METRICS_SESSIONS_ACCEPTED = 0,
+    METRICS_SESSIONS_FAILED,
+    METRICS_SESSIONS_TIMED_OUT,
+    METRICS_SESSIONS_REJECTED,
+    METRICS_RECEIVED_BYTES,
+    METRICS_NUMA_LOCAL_BYTES,  /* bytes read by indicators from buffer on their NUMA node */
+    METRICS_NUMA_REMOTE_BYTES, /* bytes read by indicators from buffer on other node */
+    METRICS_COUNTERS_COUNT
+} metrics_counter_t;
+
+typedef enum metrics_histogram_e {
+    METRICS_TASK_WAIT = 0,    /* in microseconds, from queueing to start of task */
+    METRICS_RESPONSE_LATENCY, /* in microseconds, from the last received byte to response */
+    METRICS_RECEIVE_RATE,     /* in bytes per second, upload speed of session */
+    METRICS_HISTOGRAMS_COUNT
+} metrics_histogram_t;
+
+/* Writes gauges which are read at scrape time */
+typedef void (*metrics_gauges_writer_t)(FILE *out);
+
+int metrics_init(size_t indicators_count);
+void metrics_deinit(void);
+
+/*
+ * Hot path functions, they do not take locks. Every thread updates its own
+ * shard of counters and histograms, shards are summed at scrape time.
+ */
+void metrics_count(metrics_counter_t id, uint64_t value);
+void metrics_record(metrics_histogram_t id, uint64_t value);
+/* Indicator processed bytes during time_us microseconds */
+void metrics_record_indicator(size_t index, uint64_t bytes, uint64_t time_us);
+
+/* Counters and histograms in Prometheus text format, without gauges */
+void metrics_write(FILE *out);
+
+/**
+ * Start HTTP server with metrics in Prometheus text format
+ *
+ * Server is bound to localhost only.
+ *
+ * @param[in]   port            TCP port.
+ * @param[in]   gauges_writer   called for every scrape, could be NULL.
+ * @returns     Zero if success
+ */
+int metrics_start(uint16_t port, metrics_gauges_writer_t gauges_writer);
+void metrics_stop(void);
+
+#endif /* METRICS_H_ */
@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "log.h"
+#include "overload.h"
+
+#define OVERLOAD_SPEED_PERIOD_US 100000 /* speed is updated after 100ms of processing */
+#define OVERLOAD_SPEED_WEIGHT    4      /* new speed sample has weight 1/4 */
+#define OVERLOAD_DEADLINE_TARGET 80     /* in percents, part of deadline for processing */
+
+typedef struct overload_indicator_s {
+    atomic_size_t backlog;        /* bytes queued, but not processed yet */
+    atomic_uint_fast64_t speed;   /* bytes per second, 0 - not measured yet */
+} overload_indicator_t;
+
+/* Updated only by the lane worker */
+typedef struct overload_lane_s {
+    size_t   period_bytes;
+    uint64_t period_time_us;
+} overload_lane_t;
+
+static overload_indicator_t *indicators = NULL;
+static size_t indicators_count = 0;
+static overload_lane_t *lanes = NULL;
+
+int overload_init(size_t count, size_t lanes_count)
+{
+    size_t i;
+    indicators = calloc(sizeof(*indicators), count);
+    lanes = calloc(sizeof(*lanes), lanes_count);
+    if (indicators == NULL || lanes == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for overload statistics");
+        overload_deinit();
+        return -1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        atomic_init(&indicators[i].backlog, 0);
+        atomic_init(&indicators[i].speed, 0);
+    }
+    indicators_count = count;
+    return 0;
+}
+
+void overload_deinit(void)
+{
+    free(indicators);
+    indicators = NULL;
+    indicators_count = 0;
+    free(lanes);
+    lanes = NULL;
+}
+
+void overload_account_dispatch(size_t index, size_t bytes)
+{
+    atomic_fetch_add(&indicators[index].backlog, bytes);
+}
+
+void overload_account_drop(size_t index, size_t bytes)
+{
+    atomic_fetch_sub(&indicators[index].backlog, bytes);
+}
+
+void overload_account_processing(size_t index, size_t lane, size_t bytes, uint64_t time_us)
+{
+    overload_indicator_t *ind = &indicators[index];
+    overload_lane_t *period = &lanes[lane];
+    uint64_t sample, speed;
+
+    atomic_fetch_sub(&ind->backlog, bytes);
+
+    period->period_bytes   += bytes;
+    period->period_time_us += time_us;
+    if (period->period_time_us < OVERLOAD_SPEED_PERIOD_US)
+    {
+        return;
+    }
+
+    /* lanes of the same indicator could race here, any of samples is fine */
+    sample = (uint64_t)period->period_bytes * 1000000 / period->period_time_us;
+    speed  = atomic_load(&ind->speed);
+    speed  = (speed == 0) ? sample : speed - speed / OVERLOAD_SPEED_WEIGHT + sample / OVERLOAD_SPEED_WEIGHT;
+    atomic_store(&ind->speed, speed);
+
+    period->period_bytes   = 0;
+    period->period_time_us = 0;
+}
+
+uint32_t overload_get_sampling_ratio(size_t file_size, uint64_t deadline_ms)
+{
+    size_t i;
+    uint64_t ratio = 1;
+    uint64_t available_ms = deadline_ms * OVERLOAD_DEADLINE_TARGET / 100;
+
+    for (i = 0; i < indicators_count; i++)
+    {
+        uint64_t speed = atomic_load(&indicators[i].speed);
+        uint64_t backlog_ms, file_ms, needed;
+        if (speed == 0)
+        {
+            continue;
+        }
+        backlog_ms = (uint64_t)atomic_load(&indicators[i].backlog) * 1000 / speed;
+        file_ms    = (uint64_t)file_size * 1000 / speed;
+        if (backlog_ms >= available_ms)
+        {
+            ratio = OVERLOAD_MAX_SAMPLING_RATIO;
+            break;
+        }
+        needed = (file_ms + (available_ms - backlog_ms) - 1) / (available_ms - backlog_ms);
+        ratio  = (needed > ratio) ? needed : ratio;
+    }
+
+    if (ratio > OVERLOAD_MAX_SAMPLING_RATIO)
+    {
+        ratio = OVERLOAD_MAX_SAMPLING_RATIO;
+    }
+    return (uint32_t)ratio;
+}
+
+uint64_t overload_get_backlog_ms(void)
+{
+    size_t i;
+    uint64_t backlog_ms = 0;
+
+    for (i = 0; i < indicators_count; i++)
+    {
+        uint64_t speed = atomic_load(&indicators[i].speed);
+        uint64_t ms;
+        if (speed == 0)
+        {
+            continue;
+        }
+        ms = (uint64_t)atomic_load(&indicators[i].backlog) * 1000 / speed;
+        backlog_ms = (ms > backlog_ms) ? ms : backlog_ms;
+    }
+    return backlog_ms;
+}
+
+uint64_t overload_get_speed(size_t index)
+{
+    return (index < indicators_count) ? atomic_load(&indicators[index].speed) : 0;
+}
+
+size_t overload_get_backlog(size_t index)
+{
+    return (index < indicators_count) ? atomic_load(&indicators[index].backlog) : 0;
+}
@@ -0,0 +1,40 @@
+#ifndef OVERLOAD_H_
+#define OVERLOAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OVERLOAD_MAX_SAMPLING_RATIO 16
+
+int overload_init(size_t indicators_count, size_t lanes_count);
+void overload_deinit(void);
+
+/* Bytes queued for indicator, they would be processed before new session */
+void overload_account_dispatch(size_t index, size_t bytes);
+/* Bytes processed by indicator in pool lane during time_us microseconds */
+void overload_account_processing(size_t index, size_t lane, size_t bytes, uint64_t time_us);
+/* Queued bytes were dropped without processing */
+void overload_account_drop(size_t index, size_t bytes);
+
+/**
+ * Get sampling ratio for a new session
+ *
+ * Estimates time of processing already queued bytes and the new file with
+ * measured indicators speed. If it does not fit into the deadline, only every
+ * Nth frame of the new file should be processed.
+ *
+ * @param[in]   file_size     size of the new file.
+ * @param[in]   deadline_ms   time for processing of the new file.
+ * @returns     N - ratio of frames to process, 1 means all frames.
+ */
+uint32_t overload_get_sampling_ratio(size_t file_size, uint64_t deadline_ms);
+
+/* Time for processing of already queued bytes by the slowest indicator */
+uint64_t overload_get_backlog_ms(void);
+
+/* Measured speed of indicator in bytes per second, 0 - not measured yet */
+uint64_t overload_get_speed(size_t index);
+/* Bytes queued for indicator */
+size_t overload_get_backlog(size_t index);
+
+#endif /* OVERLOAD_H_ */
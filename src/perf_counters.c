@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "log.h"
+#include "perf_counters.h"
+
+typedef struct perf_thread_s {
+    int leader;                          /* -1 if no counter is available */
+    int fds[PERF_COUNTERS_COUNT];
+    int positions[PERF_COUNTERS_COUNT];  /* position of counter in group read, -1 - not available */
+    size_t count;
+} perf_thread_t;
+
+typedef struct perf_indicator_s {
+    atomic_uint_fast64_t values[PERF_COUNTERS_COUNT];
+    atomic_uint_fast64_t tasks;
+} perf_indicator_t;
+
+static const struct {
+    uint64_t    config;
+    const char *name;
+} counters_desc[PERF_COUNTERS_COUNT] = {
+    {PERF_COUNT_HW_CPU_CYCLES,    "cycles"},
+    {PERF_COUNT_HW_INSTRUCTIONS,  "instructions"},
+    {PERF_COUNT_HW_CACHE_MISSES,  "llc_misses"},
+    {PERF_COUNT_HW_BRANCH_MISSES, "branch_misses"},
+};
+
+static perf_indicator_t *indicators = NULL;
+static size_t indicators_count = 0;
+static pthread_key_t thread_key;
+static atomic_bool warned = false;
+
+static void close_thread_counters(void *arg)
+{
+    size_t i;
+    perf_thread_t *thread = arg;
+    for (i = 0; i < PERF_COUNTERS_COUNT; i++)
+    {
+        if (thread->fds[i] != -1)
+        {
+            close(thread->fds[i]);
+        }
+    }
+    free(thread);
+}
+
+int perf_counters_init(size_t count)
+{
+    size_t i, k;
+    if (pthread_key_create(&thread_key, close_thread_counters) != 0)
+    {
+        logger(ERROR, "Can not create key for perf counters");
+        return -1;
+    }
+    indicators = calloc(sizeof(*indicators), count);
+    if (indicators == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for perf counters");
+        return -1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        for (k = 0; k < PERF_COUNTERS_COUNT; k++)
+        {
+            atomic_init(&indicators[i].values[k], 0);
+        }
+        atomic_init(&indicators[i].tasks, 0);
+    }
+    indicators_count = count;
+    return 0;
+}
+
+void perf_counters_deinit(void)
+{
+    free(indicators);
+    indicators = NULL;
+    indicators_count = 0;
+}
+
+static int open_counter(uint64_t config, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0x00, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config;
+    attr.disabled       = (group_fd == -1) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/* Counters of the calling thread, they are opened on first use */
+static perf_thread_t *get_thread_counters(void)
+{
+    size_t i;
+    perf_thread_t *thread = pthread_getspecific(thread_key);
+    if (thread != NULL)
+    {
+        return thread;
+    }
+
+    thread = calloc(1, sizeof(*thread));
+    if (thread == NULL)
+    {
+        return NULL;
+    }
+    thread->leader = -1;
+    for (i = 0; i < PERF_COUNTERS_COUNT; i++)
+    {
+        thread->fds[i] = open_counter(counters_desc[i].config, thread->leader);
+        thread->positions[i] = -1;
+        if (thread->fds[i] == -1)
+        {
+            /* every thread gets the same error, report it once */
+            if (!atomic_load(&warned))
+            {
+                logger(INFO, "Perf counter %s is not available (%d:%s)", counters_desc[i].name, errno, strerror(errno));
+            }
+            continue;
+        }
+        if (thread->leader == -1)
+        {
+            thread->leader = thread->fds[i];
+        }
+        thread->positions[i] = (int)thread->count++;
+    }
+    atomic_store(&warned, true);
+    if (thread->leader != -1)
+    {
+        ioctl(thread->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(thread->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    pthread_setspecific(thread_key, thread);
+    return thread;
+}
+
+static void read_counters(perf_sample_t *sample)
+{
+    size_t i;
+    uint64_t buffer[1 + PERF_COUNTERS_COUNT];
+    perf_thread_t *thread;
+
+    sample->valid = false;
+    if (indicators == NULL || (thread = get_thread_counters()) == NULL || thread->leader == -1)
+    {
+        return;
+    }
+    if (read(thread->leader, buffer, sizeof(buffer)) < (ssize_t)((1 + thread->count) * sizeof(uint64_t)))
+    {
+        return;
+    }
+    for (i = 0; i < PERF_COUNTERS_COUNT; i++)
+    {
+        sample->values[i] = (thread->positions[i] != -1) ? buffer[1 + thread->positions[i]] : 0;
+    }
+    sample->valid = true;
+}
+
+void perf_counters_start(perf_sample_t *sample)
+{
+    read_counters(sample);
+}
+
+void perf_counters_account(size_t index, const perf_sample_t *start)
+{
+    size_t i;
+    perf_sample_t end;
+
+    if (!start->valid || index >= indicators_count)
+    {
+        return;
+    }
+    read_counters(&end);
+    if (!end.valid)
+    {
+        return;
+    }
+    for (i = 0; i < PERF_COUNTERS_COUNT; i++)
+    {
+        atomic_fetch_add_explicit(&indicators[index].values[i], end.values[i] - start->values[i], memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&indicators[index].tasks, 1, memory_order_relaxed);
+}
+
+void perf_counters_write_metrics(FILE *out)
+{
+    size_t i, k;
+    if (indicators == NULL)
+    {
+        return;
+    }
+    for (k = 0; k < PERF_COUNTERS_COUNT; k++)
+    {
+        fprintf(out, "# HELP dashcam_indicator_%s_total Hardware counter of indicator in user space\n"
+                     "# TYPE dashcam_indicator_%s_total counter\n", counters_desc[k].name, counters_desc[k].name);
+        for (i = 0; i < indicators_count; i++)
+        {
+            fprintf(out, "dashcam_indicator_%s_total{indicator=\"%lu\"} %lu\n", counters_desc[k].name, i,
+                    atomic_load_explicit(&indicators[i].values[k], memory_order_relaxed));
+        }
+    }
+}
+
+void perf_counters_dump(void)
+{
+    size_t i;
+    if (indicators == NULL)
+    {
+        return;
+    }
+    logger(INFO, "Perf counters of indicators:");
+    logger(INFO, "%9s %8s %14s %14s %6s %12s %12s", "indicator", "tasks", "cycles", "instructions", "IPC",
+           "llc_misses", "branch_miss");
+    for (i = 0; i < indicators_count; i++)
+    {
+        uint64_t cycles       = atomic_load(&indicators[i].values[PERF_CYCLES]);
+        uint64_t instructions = atomic_load(&indicators[i].values[PERF_INSTRUCTIONS]);
+        logger(INFO, "%9lu %8lu %14lu %14lu %6.2f %12lu %12lu", i, atomic_load(&indicators[i].tasks),
+               cycles, instructions, (cycles != 0) ? (double)instructions / (double)cycles : 0.0,
+               atomic_load(&indicators[i].values[PERF_LLC_MISSES]),
+               atomic_load(&indicators[i].values[PERF_BRANCH_MISSES]));
+    }
+}
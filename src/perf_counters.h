@@ -0,0 +1,45 @@
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+typedef enum perf_counter_e {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTERS_COUNT
+} perf_counter_t;
+
+/* Values of counters of the calling thread */
+typedef struct perf_sample_s {
+    bool     valid;
+    uint64_t values[PERF_COUNTERS_COUNT];
+} perf_sample_t;
+
+/**
+ * Enable hardware counters for indicators
+ *
+ * Counters are opened by perf_event_open() for every thread on first use. If
+ * kernel or hardware does not support some of them, they are reported as 0.
+ *
+ * @param[in]   indicators_count    count of indicators for aggregation.
+ * @returns     Zero if success
+ */
+int perf_counters_init(size_t indicators_count);
+void perf_counters_deinit(void);
+
+/* Read counters of the calling thread before the indicator task */
+void perf_counters_start(perf_sample_t *sample);
+/* Add counters of the calling thread since start to the indicator */
+void perf_counters_account(size_t index, const perf_sample_t *start);
+
+/* Counters per indicator in Prometheus text format */
+void perf_counters_write_metrics(FILE *out);
+/* Table of counters per indicator to the log */
+void perf_counters_dump(void);
+
+#endif /* PERF_COUNTERS_H_ */
@@ -0,0 +1,69 @@
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "log.h"
+#include "protocol.h"
+
+int protocol_check_header(const messageHeader_t *header)
+{
+    if (ntohl(header->magic) != HEADER_MAGIC)
+    {
+        logger(ERROR, "Magic was not found in received data");
+        return -1;
+    }
+
+    if (ntohl(header->version) != HEADER_VERSION)
+    {
+        logger(ERROR, "Unknown protocol version %d. Server uses %d", ntohl(header->version), HEADER_VERSION);
+        return -1;
+    }
+
+    /* fetch of job results has no payload */
+    if (header->type != MESSAGE_TYPE_FETCH && ntohl(header->size) == 0)
+    {
+        logger(ERROR, "Payload size is 0");
+        return -1;
+    }
+    return 0;
+}
+
+size_t protocol_get_file_size(const messageHeader_t *header, size_t max_size)
+{
+    size_t size = ntohl(header->size);
+
+    if (size > max_size)
+    {
+        logger(ERROR, "file size is too big (%lu). Max size is %lu", size, max_size);
+        size = 0;
+    }
+    return size;
+}
+
+size_t protocol_get_frame_size(const messageHeader_t *header)
+{
+    size_t size = ntohl(header->size);
+    size_t frame_size = ntohl(header->frame_size);
+
+    if (frame_size == 0 || frame_size > size)
+    {
+        logger(ERROR, "frame size is wrong (%lu). file size is %lu", frame_size, size);
+        return 0;
+    }
+    if (size%frame_size != 0)
+    {
+        logger(ERROR, "Can not divide size by frame size (%lu%%%lu != 0)", size, frame_size);
+        frame_size = 0;
+    }
+    return frame_size;
+}
+
+void protocol_fill_status(messageHeader_t *header, uint8_t status, uint16_t retry_after)
+{
+    memset(header, 0x00, sizeof(*header));
+    header->magic       = htonl(HEADER_MAGIC);
+    header->version     = htonl(HEADER_VERSION);
+    header->frame_size  = htonl(sizeof(uint64_t));
+    header->type        = MESSAGE_TYPE_RESULT;
+    header->status      = status;
+    header->retry_after = htons(retry_after);
+}
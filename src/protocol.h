@@ -0,0 +1,25 @@
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include <stddef.h>
+
+#include "dash_cam.h"
+
+/**
+ * Check header of data message
+ *
+ * @param[in]   header      received header, fields are in network byte order.
+ * @returns     Zero if magic, version and size are valid
+ */
+int protocol_check_header(const messageHeader_t *header);
+
+/* Size of file in data message, 0 if it is bigger than max_size */
+size_t protocol_get_file_size(const messageHeader_t *header, size_t max_size);
+
+/* Size of frame in data message, 0 if file can not be divided into frames */
+size_t protocol_get_frame_size(const messageHeader_t *header);
+
+/* Header of results message with status and without payload, for rejected sessions */
+void protocol_fill_status(messageHeader_t *header, uint8_t status, uint16_t retry_after);
+
+#endif /* PROTOCOL_H_ */
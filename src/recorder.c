@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "record.h"
+#include "log.h"
+#include "timer.h"
+#include "recorder.h"
+
+#define RECORD_BUFFER_SIZE ((size_t) (1024 * 1024)) /* reads are small, file is written by big blocks */
+
+struct recording_s {
+    FILE     *file;
+    char     *buffer;
+    uint64_t  last_us;  /* monotonic time of previous read */
+    bool      failed;   /* write error was reported */
+};
+
+static char *record_dir = NULL;
+static atomic_size_t next_recording = 0;
+
+int recorder_init(const char *dir)
+{
+    record_dir = strdup(dir);
+    if (record_dir == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for recorder");
+        return -1;
+    }
+    if (access(record_dir, W_OK) != 0)
+    {
+        logger(ERROR, "Can not write recordings to %s (%d:%s)", record_dir, errno, strerror(errno));
+        recorder_deinit();
+        return -1;
+    }
+    logger(INFO, "Recording is enabled, sessions are written to %s", record_dir);
+    return 0;
+}
+
+void recorder_deinit(void)
+{
+    free(record_dir);
+    record_dir = NULL;
+}
+
+recording_t *recorder_start(uint64_t accepted_us)
+{
+    char path[PATH_MAX];
+    struct timeval now;
+    uint64_t start_us;
+    recordHeader_t header;
+    recording_t *recording;
+
+    if (record_dir == NULL)
+    {
+        return NULL;
+    }
+    recording = calloc(1, sizeof(*recording));
+    if (recording == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for recording");
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "%s/session-%d-%lu" RECORD_FILE_SUFFIX, record_dir, (int)getpid(),
+             atomic_fetch_add(&next_recording, 1));
+    recording->file   = fopen(path, "wb");
+    recording->buffer = malloc(RECORD_BUFFER_SIZE);
+    if (recording->file == NULL || recording->buffer == NULL)
+    {
+        logger(ERROR, "Can not create recording %s (%d:%s)", path, errno, strerror(errno));
+        recorder_stop(recording);
+        return NULL;
+    }
+    setvbuf(recording->file, recording->buffer, _IOFBF, RECORD_BUFFER_SIZE);
+
+    /* wall clock of accept */
+    gettimeofday(&now, NULL);
+    start_us = (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_usec - (timer_get_monotonic_us() - accepted_us);
+    header.magic      = htonl(RECORD_MAGIC);
+    header.version    = htonl(RECORD_VERSION);
+    header.start_sec  = htonl((uint32_t)(start_us / 1000000));
+    header.start_usec = htonl((uint32_t)(start_us % 1000000));
+    recording->last_us = accepted_us;
+    if (fwrite(&header, sizeof(header), 1, recording->file) != 1)
+    {
+        recording->failed = true;
+    }
+    logger(DEBUG, "Recording session to %s", path);
+    return recording;
+}
+
+void recorder_write(recording_t *recording, const void *data, size_t size)
+{
+    recordChunk_t chunk;
+    uint64_t now_us;
+
+    if (recording == NULL || recording->failed)
+    {
+        return;
+    }
+    now_us = timer_get_monotonic_us();
+    chunk.delay_us = htonl((uint32_t)(now_us - recording->last_us));
+    chunk.size     = htonl((uint32_t)size);
+    recording->last_us = now_us;
+    if (fwrite(&chunk, sizeof(chunk), 1, recording->file) != 1 ||
+        fwrite(data, size, 1, recording->file) != 1)
+    {
+        logger(ERROR, "Can not write recording (%d:%s)", errno, strerror(errno));
+        recording->failed = true;
+    }
+}
+
+void recorder_stop(recording_t *recording)
+{
+    if (recording == NULL)
+    {
+        return;
+    }
+    if (recording->file != NULL)
+    {
+        fclose(recording->file);
+    }
+    free(recording->buffer);
+    free(recording);
+}
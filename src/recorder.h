@@ -0,0 +1,35 @@
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct recording_s recording_t;
+
+/**
+ * Enable recording of sessions
+ *
+ * Every session is written to <dir>/session-<pid>-<n>.rec in format of
+ * record.h, dash_cam --replay sends it back to server.
+ *
+ * @param[in]   dir     existing directory for recordings.
+ * @returns     Zero if success
+ */
+int recorder_init(const char *dir);
+void recorder_deinit(void);
+
+/**
+ * Start recording of session
+ *
+ * @param[in]   accepted_us     monotonic time of connection accept.
+ * @returns     NULL if recording is disabled or file can not be created
+ */
+recording_t *recorder_start(uint64_t accepted_us);
+
+/* Append data of one read, delay is counted since previous read */
+void recorder_write(recording_t *recording, const void *data, size_t size);
+
+/* Close recording, NULL is ignored */
+void recorder_stop(recording_t *recording);
+
+#endif /* RECORDER_H_ */
@@ -0,0 +1,64 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "affinity.h"
+#include "scratch.h"
+
+typedef struct scratch_thread_s {
+    indicator_scratch_t arena;
+    uint64_t            owner;
+} scratch_thread_t;
+
+static pthread_key_t thread_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static bool key_created = false;
+
+static void free_thread_scratch(void *arg)
+{
+    scratch_thread_t *thread = arg;
+    affinity_free(thread->arena.base, thread->arena.size);
+    free(thread);
+}
+
+static void create_key(void)
+{
+    key_created = (pthread_key_create(&thread_key, free_thread_scratch) == 0);
+}
+
+indicator_scratch_t *scratch_get(uint64_t owner)
+{
+    scratch_thread_t *thread;
+
+    pthread_once(&key_once, create_key);
+    if (!key_created)
+    {
+        return NULL;
+    }
+    thread = pthread_getspecific(thread_key);
+    if (thread == NULL)
+    {
+        thread = calloc(1, sizeof(*thread));
+        if (thread == NULL)
+        {
+            return NULL;
+        }
+        thread->arena.base = affinity_alloc(SCRATCH_SIZE, affinity_get_current_node());
+        if (thread->arena.base == NULL)
+        {
+            logger(ERROR, "Can not map scratch arena");
+            free(thread);
+            return NULL;
+        }
+        thread->arena.size = SCRATCH_SIZE;
+        thread->owner      = owner;
+        pthread_setspecific(thread_key, thread);
+    }
+    if (thread->owner != owner)
+    {
+        thread->arena.used = 0;
+        thread->owner      = owner;
+    }
+    return &thread->arena;
+}
@@ -0,0 +1,22 @@
+#ifndef SCRATCH_H_
+#define SCRATCH_H_
+
+#include <stdint.h>
+
+#include "indicators.h"
+
+#define SCRATCH_SIZE ((size_t) (1024 * 1024))
+
+/**
+ * Scratch arena of the calling thread
+ *
+ * Arena is mapped on the first use on NUMA node of the thread and is unmapped
+ * when the thread exits. It is reset when owner differs from the owner of the
+ * previous call, so temporaries of indicators live till the end of session.
+ *
+ * @param[in]   owner   id of session or file processed by the thread.
+ * @returns     Pointer to arena or NULL if no memory
+ */
+indicator_scratch_t *scratch_get(uint64_t owner);
+
+#endif /* SCRATCH_H_ */
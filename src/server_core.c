@@ -8,183 +8,718 @@
 #include <pthread.h>
 #include <signal.h>
 #include <semaphore.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/queue.h>
 
 #include "dash_cam.h"
 
 #include "indicators.h"
+#include "indicators_lib.h"
 #include "threadpool.h"
 #include "log.h"
 #include "server_core.h"
 #include "timer.h"
-
-#define MAX_CLIENTS_COUNT 1
-#define TIME_FOR_PROCESSING 35 /* in seconds */
-#define MAX_FILE_SIZE ((size_t) (1000 * 1000 * 80)) /* 80MB */
-#define MAX_RECEIVED_SIZE (sizeof(messageHeader_t) + MAX_FILE_SIZE)
+#include "overload.h"
+#include "admission.h"
+#include "memory_governor.h"
+#include "metrics.h"
+#include "trace.h"
+#include "perf_counters.h"
+#include "scratch.h"
+#include "protocol.h"
+#include "recorder.h"
+#include "spool.h"
+#include "jobs.h"
+#include "crc32.h"
+#include "cluster.h"
+#include "handoff.h"
+#include "control.h"
+#include "affinity.h"
+
+#define MAX_CLIENTS_COUNT 1 /* default of --max-sessions */
+#define LISTEN_BACKLOG 64 /* excess connections are accepted and answered by busy status */
+#define TIME_FOR_PROCESSING 35 /* in seconds, default of --deadline */
+#define HEADER_TIMEOUT 2000 /* in milliseconds, connection without header is dropped */
+#define MAX_FILE_SIZE ((size_t) (1000 * 1000 * 80)) /* 80MB, default of --max-file-size */
+#define PARTIAL_RESULTS_GRACE 2 /* in seconds, waiting for running chunks after deadline */
+#define SAMPLING_BLOCK_SIZE ((size_t) (64 * 1024)) /* frames are sampled by blocks of this size */
+#define MEMORY_WAIT_TIMEOUT (deadline_s * 1000 / 2) /* in milliseconds, upload waits for memory budget */
+#define MEMORY_WAIT_SLICE 100 /* in milliseconds, server stop is checked between waits */
+#define LIBRARY_CHECK_INTERVAL 1000 /* in milliseconds, idle slots move to reloaded library */
+
+/* Output of preprocessor for chunk, it is shared by indicators tasks of the chunk */
+typedef struct derived_chunk_s {
+    atomic_size_t refs;   /* indicators tasks which are not finished */
+    size_t        runs;   /* runs of frames passed to indicators, outputs of runs follow each other */
+    size_t       *sizes;  /* output size of every run */
+    uint8_t      *data;
+    LIST_ENTRY(derived_chunk_s) next;
+} derived_chunk_t;
+
+typedef struct indicator_task_s {
+    struct session_s *session;
+    size_t          index;
+    size_t          frame_size;
+    size_t          frame_number; /* number of the first frame in data */
+    uint32_t        sampling;     /* process every Nth block of frames */
+    size_t          work;         /* bytes which would be passed to indicator */
+    derived_chunk_t *derived;     /* NULL - chunk is not preprocessed */
+    indicator_arg_t arg;
+} indicator_task_t;
+
+typedef struct preprocess_task_s {
+    struct session_s *session;
+    const uint8_t  *data;
+    size_t          size;
+    size_t          frame_size;
+    size_t          frame_number;
+    size_t          work;
+} preprocess_task_t;
+
+/* Snapshot or finalize passes preprocessing lane, so it stays behind chunks queued before */
+typedef struct stage_task_s {
+    struct session_s *session;
+    sem_t *sem;  /* semaphore of finalize, NULL - snapshot */
+} stage_task_t;
+
+/* Interim results of progressive session, only one snapshot in flight */
+typedef struct progress_snapshot_s {
+    atomic_size_t   pending;   /* lanes which did not reach snapshot yet */
+    atomic_bool     in_flight; /* msg is used till the last lane sent it */
+    pthread_mutex_t send_lock; /* interim and final messages share socket */
+    message_t      *msg;
+} progress_snapshot_t;
+
+typedef struct snapshot_task_s {
+    struct session_s *session;
+    size_t index;
+} snapshot_task_t;
+
+typedef struct finalize_task_s {
+    sem_t *sem;
+} finalize_task_t;
+
+/*
+ * Session slot
+ *
+ * Every slot has its own buffers, indicators contexts and lanes in thread pool,
+ * so sessions in different slots are processed independently.
+ */
+typedef struct session_s {
+    size_t            id;
+    atomic_bool       active;       /* slot is taken by connection */
+    pthread_t         thread;
+    bool              joinable;
+    int               fd;
+    timer_t           timer;
+    uint64_t          deadline_ms;  /* monotonic time of deadline */
+    atomic_int        deadline_expired; /* set by signal handler of timer on any thread */
+    bool              rejected;     /* answered by busy or too large status */
+    uint64_t          received_us;  /* monotonic time of the last received byte */
+    uint64_t          trace_id;     /* id of session in trace */
+    recording_t      *recording;    /* NULL if sessions are not recorded */
+
+    int               node;         /* home NUMA node of slot, -1 - host is not NUMA */
+    message_t        *msg;          /* receive buffer, allocated from memory budget */
+    size_t            msg_mapped;   /* size of msg if it is mapped on msg_node, 0 - allocated by malloc */
+    int               msg_node;     /* NUMA node of msg, -1 - unknown */
+    size_t            reserved_size; /* bytes reserved from memory budget */
+    spool_file_t      spool;        /* msg is mapped spool file if spool.fd != -1 */
+    message_t        *response;
+    size_t            first_lane;   /* lanes of indicators in thread pool */
+    size_t            preprocess_lane; /* lane of preprocessor, used if library has it */
+    pthread_mutex_t   derived_lock;
+    LIST_HEAD(, derived_chunk_s) derived; /* outputs of preprocessor in use */
+    indicators_lib_t *lib;          /* version of indicators library which owns ctx */
+    indicator_ctx_t **ctx;
+    atomic_size_t    *coverage;     /* bytes processed by every indicator */
+    atomic_size_t    *pending_work; /* bytes queued for every indicator */
+
+    sem_t             finish_sem;
+    sem_t             drain_sem;
+
+    bool              progressive;
+    uint32_t          sampling;
+    size_t            admitted_size; /* bytes accounted by admission controller */
+    progress_snapshot_t snapshot;
+} session_t;
 
 bool server_running = true;
-message_t *msg = NULL;
-message_t *response = NULL;
 thread_pool_t *tp = NULL;
-indicators_handlers_t *indicators_handlers;
 size_t indicators_count = 0;
-indicator_ctx_t **indicators_ctx;
-
-int clint_fd = -1;
-
-sem_t indicators_finish_sem;
+bool preprocessing = false;      /* library has preprocessor, every slot has lane for it */
+
+session_t *sessions = NULL;
+size_t sessions_count = 0;
+
+/* Tunables, they could be changed by control socket while sessions are running */
+atomic_uint progress_interval_ms = 0;
+atomic_bool partial_results = false;
+atomic_bool load_shedding = false;
+atomic_size_t spool_threshold = 0;
+atomic_uint deadline_s = TIME_FOR_PROCESSING;
+atomic_size_t max_file_size = MAX_FILE_SIZE;
+atomic_size_t chunk_size = 0;      /* received frames are dispatched by chunks of at least this size */
+atomic_size_t sessions_limit = 0;  /* slots which could be taken, up to sessions_count */
+uint16_t metrics_port = 0;
 
 void server_exit(void)
 {
     server_running = 0;
 }
 
-static void timer_expired_handler(int sig, __attribute__((unused)) siginfo_t *si, __attribute__((unused)) void *uc)
+static void timer_expired_handler(__attribute__((unused)) int sig, siginfo_t *si, __attribute__((unused)) void *uc)
 {
     size_t i;
+    session_t *session = si->si_value.sival_ptr;
+
+    /* signal could be queued before timer was disarmed for previous session in slot */
+    if (session == NULL || !atomic_load(&session->active) || timer_get_monotonic_ms() < session->deadline_ms)
+    {
+        return;
+    }
+
+    /* flag is set before session thread is woken up, so it sees expiry instead of error */
+    atomic_store(&session->deadline_expired, 1);
     for (i = 0; i < indicators_count + 1; i++)
     {
-        sem_post(&indicators_finish_sem);
+        sem_post(&session->finish_sem);
     }
-    close(clint_fd);
-    signal(sig, SIG_IGN);
+    /* wake up receiving, socket is closed by session thread */
+    shutdown(session->fd, partial_results ? SHUT_RD : SHUT_RDWR);
 }
 
 static int check_header(const int fd, const messageHeader_t *header)
 {
-    int ret = -1;
-    size_t read_size = read_wrapper(fd, (uint8_t *)header, sizeof(*header), true);
+    size_t read_size = read_with_timeout(fd, (uint8_t *)header, sizeof(*header), HEADER_TIMEOUT);
     if (read_size != sizeof(*header))
     {
-        logger(ERROR, "read_wrapper error");
-        goto exit;
+        logger(ERROR, "[fd %d] Header was not received in %d ms", fd, HEADER_TIMEOUT);
+        return -1;
     }
+    return protocol_check_header(header);
+}
 
-    if (ntohl(header->magic) != HEADER_MAGIC)
+static int alloc_message_buffers(session_t *session)
+{
+    /* partial results carry value and coverage for every indicator */
+    size_t response_size = sizeof(messageHeader_t) + (2 * sizeof(uint64_t) * indicators_count);
+    size_t snapshot_size = sizeof(messageHeader_t) + (sizeof(uint64_t) * indicators_count);
+
+    session->response = malloc(response_size);
+    if(session->response == NULL)
     {
-        logger(ERROR, "Magic was not found in received data");
-        goto exit;
+        logger(ERROR, "Can not allocate memory for response buffer (size %lu)", response_size);
+        return -1;
     }
 
-    if (ntohl(header->version) != HEADER_VERSION)
+    session->snapshot.msg = malloc(snapshot_size);
+    if(session->snapshot.msg == NULL)
     {
-        logger(ERROR, "Unknown protocol version %d. Server uses %d", ntohl(header->version), HEADER_VERSION);
-        goto exit;
+        logger(ERROR, "Can not allocate memory for snapshot buffer (size %lu)", snapshot_size);
+        return -1;
     }
+    return 0;
+}
+
+static void free_message_buffers(session_t *session)
+{
+    free(session->response);
+    session->response = NULL;
+
+    free(session->snapshot.msg);
+    session->snapshot.msg = NULL;
+}
+
+/*
+ * Allocate receive buffer of the session from memory budget
+ *
+ * Data is not read from socket while the budget is taken by other sessions,
+ * so uploads are throttled by TCP flow control instead of server memory.
+ * Big files are received to spool file, page cache buffers them instead.
+ */
+static memory_reserve_status_t alloc_receive_buffer(session_t *session, const messageHeader_t *header, const size_t file_size)
+{
+    size_t size = sizeof(messageHeader_t) + file_size;
+    uint64_t wait_end = timer_get_monotonic_ms() + MEMORY_WAIT_TIMEOUT;
+    memory_reserve_status_t ret;
 
-    if (ntohl(header->size) == 0)
+    if (spool_enabled() && (file_size > spool_threshold || file_size > max_file_size))
     {
-        logger(ERROR, "Payload size is 0");
-        goto exit;
+        if (spool_create(&session->spool, header, file_size) != 0)
+        {
+            return MEMORY_TIMEOUT;
+        }
+        session->msg = session->spool.msg;
+        return MEMORY_RESERVED;
     }
 
-    ret = 0;
-exit:
-    return ret;
+    while ((ret = memory_governor_reserve(size, MEMORY_WAIT_SLICE)) == MEMORY_TIMEOUT)
+    {
+        if (!server_running || timer_get_monotonic_ms() >= wait_end)
+        {
+            logger(INFO, "[fd %d] Memory budget is taken (%lu of %lu bytes)", session->fd,
+                   memory_governor_get_used(), memory_governor_get_budget());
+            return ret;
+        }
+    }
+    if (ret != MEMORY_RESERVED)
+    {
+        return ret;
+    }
+    session->reserved_size = size;
+
+    if (session->node >= 0)
+    {
+        /* buffer is local for receiving thread and for lanes of the slot */
+        session->msg_node   = affinity_get_current_node();
+        session->msg        = affinity_alloc(size, session->msg_node);
+        session->msg_mapped = size;
+    }
+    else
+    {
+        session->msg = malloc(size);
+    }
+    if (session->msg == NULL)
+    {
+        logger(ERROR, "Can not allocate memory for receive buffer (size %lu)", size);
+        return MEMORY_TIMEOUT;
+    }
+    memcpy(&session->msg->header, header, sizeof(*header));
+    return MEMORY_RESERVED;
 }
 
-static size_t get_file_size(const messageHeader_t *header)
+static void free_receive_buffer(session_t *session, bool success)
 {
-    size_t size = ntohl(header->size);
-
-    if (size > MAX_FILE_SIZE)
+    if (session->spool.fd != -1)
+    {
+        spool_release(&session->spool, success);
+    }
+    else if (session->msg_mapped != 0)
+    {
+        affinity_free(session->msg, session->msg_mapped);
+    }
+    else
+    {
+        free(session->msg);
+    }
+    session->msg = NULL;
+    session->msg_mapped = 0;
+    session->msg_node = -1;
+    if (session->reserved_size != 0)
     {
-        logger(ERROR, "file size is too big (%lu). Max size is %lu", size, MAX_FILE_SIZE);
-        size = 0;
+        memory_governor_release(session->reserved_size);
+        session->reserved_size = 0;
     }
-    return size;
 }
 
-static size_t get_frame_size(const messageHeader_t *header)
+static void fill_response_header(messageHeader_t *header, uint8_t type, uint32_t offset)
+{
+    uint32_t payload_size = (uint32_t)(sizeof(uint64_t) * indicators_count);
+
+    memset(header, 0x00, sizeof(*header));
+    header->magic      = htonl(HEADER_MAGIC);
+    header->size       = htonl(payload_size);
+    header->frame_size = htonl(sizeof(uint64_t));
+    header->version    = htonl(HEADER_VERSION);
+    header->type       = type;
+    header->offset     = htonl(offset);
+}
+
+/*
+ * Find next run of frames to process with sampling
+ *
+ * Frames are grouped into blocks of SAMPLING_BLOCK_SIZE and only every Nth
+ * block is processed, so indicator is not called for every single frame.
+ *
+ * @param[in,out]   frame   number of frame to start search, on return the first frame of run.
+ * @returns         count of frames in run before end, zero if there is no run.
+ */
+static size_t get_sampled_run(size_t *frame, const size_t end, const size_t frame_size, const uint32_t sampling)
 {
-    size_t size = ntohl(header->size);
-    size_t frame_size = ntohl(header->frame_size);
+    size_t block_frames = (SAMPLING_BLOCK_SIZE > frame_size) ? SAMPLING_BLOCK_SIZE / frame_size : 1;
+    size_t block = *frame / block_frames;
+    size_t run_end;
 
-    if (frame_size > size)
+    if (block % sampling != 0)
     {
-        logger(ERROR, "frame size is too big (%lu). file size is %lu", frame_size, size);
-        frame_size = 0;
+        block += sampling - block % sampling;
+        *frame = block * block_frames;
     }
-    if (size%frame_size != 0)
+    if (*frame >= end)
     {
-        logger(ERROR, "Can not divide size by frame size (%lu%%%lu != 0)", size, frame_size);
-        frame_size = 0;
+        return 0;
     }
-    return frame_size;
+    run_end = (block + 1) * block_frames;
+    return ((run_end < end) ? run_end : end) - *frame;
 }
 
-static int alloc_message_buffers(void)
+/* Runs of frames which indicator_task_handler() passes to indicator, the whole chunk without sampling */
+static size_t get_task_run(size_t *frame, const size_t end, const size_t frame_size, const uint32_t sampling)
 {
-    size_t response_size = sizeof(messageHeader_t) + (sizeof(uint64_t) * indicators_count);
-    msg = malloc(MAX_RECEIVED_SIZE);
-    if(msg == NULL)
+    if (sampling == 1)
     {
-        logger(ERROR, "Can not allocate memory for receive buffer (size %lu)", MAX_RECEIVED_SIZE);
-        return -1;
+        return (*frame < end) ? end - *frame : 0;
     }
+    return get_sampled_run(frame, end, frame_size, sampling);
+}
+
+static void release_derived(session_t *session, derived_chunk_t *derived)
+{
+    int cancel_state;
 
-    response = malloc(response_size);
-    if(response == NULL)
+    if (derived == NULL || atomic_fetch_sub(&derived->refs, 1) != 1)
     {
-        logger(ERROR, "Can not allocate memory for response buffer (size %lu)", response_size);
-        return -1;
+        return;
     }
-    return 0;
+    /* worker could be cancelled on deadline, lock must not stay taken */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+    pthread_mutex_lock(&session->derived_lock);
+    LIST_REMOVE(derived, next);
+    pthread_mutex_unlock(&session->derived_lock);
+    pthread_setcancelstate(cancel_state, NULL);
+    free(derived);
 }
 
-static void free_message_buffers(void)
+/* Outputs of chunks dropped from queues, lanes of session must be idle */
+static void free_derived(session_t *session)
 {
-    free(msg);
-    msg = NULL;
+    derived_chunk_t *derived;
+    pthread_mutex_lock(&session->derived_lock);
+    while ((derived = LIST_FIRST(&session->derived)) != NULL)
+    {
+        LIST_REMOVE(derived, next);
+        free(derived);
+    }
+    pthread_mutex_unlock(&session->derived_lock);
+}
+
+static void *indicator_task_handler(void *arg)
+{
+    indicator_task_t *task = arg;
+    session_t *session = task->session;
+    derived_chunk_t *derived = task->derived;
+    uint64_t start_us = timer_get_monotonic_us();
+    size_t frame = task->frame_number;
+    size_t end   = task->frame_number + task->arg.size / task->frame_size;
+    size_t run, r = 0, offset = 0;
+    uint64_t time_us;
+    perf_sample_t perf_start;
+
+    task->arg.scratch = scratch_get(session->trace_id);
+    perf_counters_start(&perf_start);
+    while ((run = get_task_run(&frame, end, task->frame_size, task->sampling)) != 0)
+    {
+        indicator_arg_t run_arg = {
+            .ctx = task->arg.ctx,
+            .data = task->arg.data + (frame - task->frame_number) * task->frame_size,
+            .size = run * task->frame_size,
+            .scratch = task->arg.scratch,
+            .derived = (derived != NULL) ? derived->data + offset : NULL,
+            .derived_size = (derived != NULL) ? derived->sizes[r] : 0
+        };
+        session->lib->handlers[task->index].indicator(&run_arg);
+        if (derived != NULL)
+        {
+            offset += derived->sizes[r++];
+        }
+        frame += run;
+    }
+    release_derived(session, derived);
 
-    free(response);
-    response = NULL;
+    if (session->msg_node >= 0)
+    {
+        metrics_count((affinity_get_current_node() == session->msg_node) ? METRICS_NUMA_LOCAL_BYTES :
+                      METRICS_NUMA_REMOTE_BYTES, task->arg.size);
+    }
+    perf_counters_account(task->index, &perf_start);
+    time_us = timer_get_monotonic_us() - start_us;
+    trace_span(session->trace_id, "indicator", start_us, "indicator", (int64_t)task->index);
+    overload_account_processing(task->index, session->first_lane + task->index, task->work, time_us);
+    metrics_record_indicator(task->index, task->work, time_us);
+    atomic_fetch_sub(&session->pending_work[task->index], task->work);
+    atomic_fetch_add(&session->coverage[task->index], task->arg.size);
+    return NULL;
 }
 
-void calc_indicators(const uint8_t *data, const size_t size)
+/* Queue chunk for every indicator, work is already accounted */
+static void dispatch_chunk(session_t *session, const uint8_t *data, const size_t size, const size_t frame_size,
+                           const size_t frame_number, const size_t work, derived_chunk_t *derived)
 {
     size_t i;
-    indicator_arg_t arg_pattern = {
-        .ctx = NULL,
-        .data = data,
-        .size = size
+    indicator_task_t task_pattern = {
+        .session = session,
+        .index = 0,
+        .frame_size = frame_size,
+        .frame_number = frame_number,
+        .sampling = session->sampling,
+        .work = work,
+        .derived = derived,
+        .arg = {
+            .ctx = NULL,
+            .data = data,
+            .size = size
+        }
     };
     for (i = 0; i < indicators_count; i++)
     {
-        indicator_arg_t *arg = malloc(sizeof(*arg));
-        if (arg == NULL)
+        indicator_task_t *task = malloc(sizeof(*task));
+        if (task == NULL)
+        {
+            logger(ERROR, "Failed to allocate memory");
+            overload_account_drop(i, work);
+            atomic_fetch_sub(&session->pending_work[i], work);
+            release_derived(session, derived);
+            continue;
+        }
+        memcpy(task, &task_pattern, sizeof(task_pattern));
+        task->index   = i;
+        task->arg.ctx = session->ctx[i];
+        thread_pool_add_task(tp, indicator_task_handler, task, session->first_lane + i);
+    }
+}
+
+/*
+ * Preprocess chunk once for all indicators
+ *
+ * Every run of frames passed to indicators gets own output. If there is no
+ * memory for outputs, indicators get raw data only.
+ */
+static void *preprocess_task_handler(void *arg)
+{
+    preprocess_task_t *task = arg;
+    session_t *session = task->session;
+    const indicators_preprocessor_t *preprocessor = session->lib->preprocessor;
+    indicator_scratch_t *scratch = scratch_get(session->trace_id);
+    uint64_t trace_time = trace_start();
+    size_t end = task->frame_number + task->size / task->frame_size;
+    size_t frame, run, r, runs = 0, capacity = 0, offset = 0;
+    derived_chunk_t *derived;
+    int cancel_state;
+
+    for (frame = task->frame_number; (run = get_task_run(&frame, end, task->frame_size, session->sampling)) != 0;
+         frame += run)
+    {
+        runs++;
+        capacity += preprocessor->derived_size(run * task->frame_size);
+    }
+    derived = malloc(sizeof(*derived) + runs * sizeof(*derived->sizes) + capacity);
+    if (derived == NULL)
+    {
+        logger(ERROR, "Can not allocate memory for preprocessed chunk");
+    }
+    else
+    {
+        derived->runs  = runs;
+        derived->sizes = (size_t *)(derived + 1);
+        derived->data  = (uint8_t *)(derived->sizes + runs);
+        atomic_init(&derived->refs, indicators_count);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+        pthread_mutex_lock(&session->derived_lock);
+        LIST_INSERT_HEAD(&session->derived, derived, next);
+        pthread_mutex_unlock(&session->derived_lock);
+        pthread_setcancelstate(cancel_state, NULL);
+
+        r = 0;
+        for (frame = task->frame_number; (run = get_task_run(&frame, end, task->frame_size, session->sampling)) != 0;
+             frame += run)
+        {
+            derived->sizes[r] = preprocessor->preprocess(task->data + (frame - task->frame_number) * task->frame_size,
+                                                         run * task->frame_size, derived->data + offset, scratch);
+            offset += derived->sizes[r++];
+        }
+    }
+    trace_span(session->trace_id, "preprocess", trace_time, "bytes", (int64_t)task->size);
+    dispatch_chunk(session, task->data, task->size, task->frame_size, task->frame_number, task->work, derived);
+    return NULL;
+}
+
+/*
+ * Queue chunk of frames for every indicator
+ *
+ * frame_number is the number of the first frame in the chunk, it is used for
+ * choosing frames with sampling. If library has preprocessor, chunk passes
+ * preprocessing lane of session first.
+ */
+void calc_indicators(session_t *session, const uint8_t *data, const size_t size, const size_t frame_size, const size_t frame_number)
+{
+    size_t i;
+    size_t frame = frame_number;
+    size_t end   = frame_number + size / frame_size;
+    size_t work  = 0;
+    size_t run;
+    preprocess_task_t *task;
+
+    while ((run = get_sampled_run(&frame, end, frame_size, session->sampling)) != 0)
+    {
+        work  += run * frame_size;
+        frame += run;
+    }
+    /* work is queued from now, even if it waits for preprocessing */
+    for (i = 0; i < indicators_count; i++)
+    {
+        overload_account_dispatch(i, work);
+        atomic_fetch_add(&session->pending_work[i], work);
+    }
+
+    if (!preprocessing || (task = malloc(sizeof(*task))) == NULL)
+    {
+        dispatch_chunk(session, data, size, frame_size, frame_number, work, NULL);
+        return;
+    }
+    task->session      = session;
+    task->data         = data;
+    task->size         = size;
+    task->frame_size   = frame_size;
+    task->frame_number = frame_number;
+    task->work         = work;
+    thread_pool_add_task(tp, preprocess_task_handler, task, session->preprocess_lane);
+}
+
+static void *calc_indicators_snapshot_handler(void *arg)
+{
+    snapshot_task_t *task = arg;
+    session_t *session = task->session;
+    progress_snapshot_t *snapshot = &session->snapshot;
+    uint64_t *payload_ptr = (uint64_t *)snapshot->msg->payload;
+    size_t    msg_size    = sizeof(messageHeader_t) + (sizeof(uint64_t) * indicators_count);
+    uint64_t  trace_time;
+    int       cancel_state;
+
+    /* Lane reached snapshot point, all previous chunks are in ctx */
+    payload_ptr[task->index] = htobe64(session->lib->handlers[task->index].extract(session->ctx[task->index]));
+
+    if (atomic_fetch_sub(&snapshot->pending, 1) != 1)
+    {
+        return NULL;
+    }
+
+    /*
+     * The last lane sends the interim message. Worker could be cancelled on
+     * deadline, lock must not stay taken, so cancellation waits for the send.
+     */
+    trace_time = trace_start();
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+    pthread_mutex_lock(&snapshot->send_lock);
+    if (write_wrapper(session->fd, snapshot->msg, msg_size) != 0)
+    {
+        logger(ERROR, "error while sending interim results");
+    }
+    pthread_mutex_unlock(&snapshot->send_lock);
+    trace_span(session->trace_id, "send interim", trace_time, "offset", ntohl(snapshot->msg->header.offset));
+    logger(DEBUG, "[fd %d] Interim results for offset %u were sent", session->fd, ntohl(snapshot->msg->header.offset));
+    /* msg could be filled by the next snapshot only now */
+    atomic_store(&snapshot->in_flight, false);
+    pthread_setcancelstate(cancel_state, NULL);
+    return NULL;
+}
+
+static void dispatch_snapshot(session_t *session)
+{
+    size_t i;
+    for (i = 0; i < indicators_count; i++)
+    {
+        snapshot_task_t *task = malloc(sizeof(*task));
+        if (task == NULL)
         {
             logger(ERROR, "Failed to allocate memory");
+            if (atomic_fetch_sub(&session->snapshot.pending, 1) == 1)
+            {
+                /* nobody sends this snapshot */
+                atomic_store(&session->snapshot.in_flight, false);
+            }
             continue;
         }
-        memcpy(arg, &arg_pattern, sizeof(arg_pattern));
-        arg->ctx  = indicators_ctx[i];
-        job_func_t fun_ptr = (job_func_t)indicators_handlers[i].indicator;
-        thread_pool_add_task(tp, fun_ptr, arg, i);
+        task->session = session;
+        task->index   = i;
+        thread_pool_add_task(tp, calc_indicators_snapshot_handler, task, session->first_lane + i);
     }
 }
 
 void *calc_indicators_finalize_handler(void *arg)
 {
-    sem_t **sem = arg;
-    sem_post(*sem);
+    finalize_task_t *task = arg;
+    sem_post(task->sem);
     return NULL;
 }
 
-void calc_indicators_finalize(void)
+static void dispatch_finalize(session_t *session, sem_t *sem)
 {
     size_t i;
     for (i = 0; i < indicators_count; i++)
     {
-        sem_t **arg = malloc(sizeof(*arg));
-        if (arg == NULL)
+        finalize_task_t *task = malloc(sizeof(*task));
+        if (task == NULL)
         {
             logger(ERROR, "Failed to allocate memory");
             continue;
         }
-        *arg = &indicators_finish_sem;
-        thread_pool_add_task(tp, calc_indicators_finalize_handler, arg, i);
+        task->sem = sem;
+        thread_pool_add_task(tp, calc_indicators_finalize_handler, task, session->first_lane + i);
+    }
+}
+
+/* Preprocessing lane reached snapshot or finalize, chunks before it are in lanes of indicators */
+static void *stage_task_handler(void *arg)
+{
+    stage_task_t *task = arg;
+    if (task->sem == NULL)
+    {
+        dispatch_snapshot(task->session);
     }
+    else
+    {
+        dispatch_finalize(task->session, task->sem);
+    }
+    return NULL;
+}
+
+static void add_stage_task(session_t *session, sem_t *sem)
+{
+    stage_task_t *task = malloc(sizeof(*task));
+    if (task == NULL)
+    {
+        /* order with chunks in preprocessing is lost, but waiters are not stuck */
+        logger(ERROR, "Failed to allocate memory");
+        stage_task_handler(&(stage_task_t){.session = session, .sem = sem});
+        return;
+    }
+    task->session = session;
+    task->sem     = sem;
+    thread_pool_add_task(tp, stage_task_handler, task, session->preprocess_lane);
+}
+
+/* Queue extraction of indicators values after all chunks dispatched so far */
+static void calc_indicators_snapshot(session_t *session, const size_t offset)
+{
+    progress_snapshot_t *snapshot = &session->snapshot;
+    if (atomic_load(&snapshot->in_flight))
+    {
+        logger(DEBUG, "Previous snapshot is not sent yet, skipping offset %lu", offset);
+        return;
+    }
+    fill_response_header(&snapshot->msg->header, MESSAGE_TYPE_INTERIM, (uint32_t)offset);
+    snapshot->msg->header.library_id = htonl(session->lib->id);
+    atomic_store(&snapshot->pending, indicators_count);
+    atomic_store(&snapshot->in_flight, true);
+    if (preprocessing)
+    {
+        add_stage_task(session, NULL);
+        return;
+    }
+    dispatch_snapshot(session);
+}
+
+void calc_indicators_finalize(session_t *session, sem_t *sem)
+{
+    if (preprocessing)
+    {
+        add_stage_task(session, sem);
+        return;
+    }
+    dispatch_finalize(session, sem);
 }
 
 static inline size_t get_received_frames(size_t cur_size, size_t prev_size, size_t frame_size)
@@ -192,7 +727,7 @@ static inline size_t get_received_frames(size_t cur_size, size_t prev_size, size
     return ((cur_size - prev_size) / frame_size);
 }
 
-int get_file_and_calc_indicators(const int fd, uint8_t *data_ptr, const size_t size, const size_t frame_size)
+int get_file_and_calc_indicators(session_t *session, uint8_t *data_ptr, const size_t size, const size_t frame_size)
 {
     int ret = -1;
     uint8_t *current_ptr     = data_ptr;
@@ -200,214 +735,1269 @@ int get_file_and_calc_indicators(const int fd, uint8_t *data_ptr, const size_t s
     size_t   current_size    = 0;
     size_t   prev_size       = 0;
     size_t   frames_received = 0;
+    uint64_t last_snapshot   = timer_get_monotonic_ms();
+    uint64_t start_us        = timer_get_monotonic_us();
 
     while(current_size != size)
     {
-        size_t read_size = read_wrapper(fd, current_ptr, size, false);
+        uint64_t trace_time = trace_start();
+        size_t read_size = read_wrapper(session->fd, current_ptr, size - current_size, false);
+        trace_span(session->trace_id, "read", trace_time, "bytes", (int64_t)read_size);
         if (read_size == 0)
         {
             logger(ERROR, "Error while receiving data");
             goto exit;
         }
+        recorder_write(session->recording, current_ptr, read_size);
         current_size += read_size;
+        metrics_count(METRICS_RECEIVED_BYTES, read_size);
 
         current_ptr =  data_ptr + current_size;
 
         frames_received = get_received_frames(current_size, prev_size, frame_size);
         logger(DEBUG, "current_size %lu frames_received %lu", current_size, frames_received);
-        if (frames_received > 0)
+        /* small reads are accumulated to chunk, the last one is dispatched as is */
+        if (frames_received > 0 && (frames_received * frame_size >= chunk_size || current_size == size))
         {
             size_t size_to_process = frames_received * frame_size;
             logger(DEBUG, "size_to_process %lu", size_to_process);
-            calc_indicators(prev_ptr, size_to_process);
+            trace_time = trace_start();
+            calc_indicators(session, prev_ptr, size_to_process, frame_size, prev_size / frame_size);
+            trace_span(session->trace_id, "dispatch", trace_time, "bytes", (int64_t)size_to_process);
             prev_size += size_to_process;
             prev_ptr = data_ptr + prev_size;
+
+            if (session->progressive && prev_size != size &&
+                timer_get_monotonic_ms() - last_snapshot >= progress_interval_ms)
+            {
+                calc_indicators_snapshot(session, prev_size);
+                last_snapshot = timer_get_monotonic_ms();
+            }
         }
     }
-    calc_indicators_finalize();
+    calc_indicators_finalize(session, &session->finish_sem);
 
+    session->received_us = timer_get_monotonic_us();
+    metrics_record(METRICS_RECEIVE_RATE, (uint64_t)size * 1000000 / (session->received_us - start_us + 1));
     ret = 0;
 exit:
     return ret;
 }
 
-static void init_indicators_ctx(void)
+/* Receive file of async session, it is computed by jobs worker instead of session lanes */
+static int receive_async_job(session_t *session, const size_t size, uint32_t *crc)
+{
+    uint8_t *data_ptr = session->msg->payload;
+    size_t   current_size = 0;
+    uint64_t start_us = timer_get_monotonic_us();
+
+    *crc = 0;
+    while (current_size != size)
+    {
+        uint64_t trace_time = trace_start();
+        size_t read_size = read_wrapper(session->fd, data_ptr + current_size, size - current_size, false);
+        trace_span(session->trace_id, "read", trace_time, "bytes", (int64_t)read_size);
+        if (read_size == 0)
+        {
+            logger(ERROR, "Error while receiving data");
+            return -1;
+        }
+        recorder_write(session->recording, data_ptr + current_size, read_size);
+        /* data is still in cache right after read */
+        *crc = crc32_update(*crc, data_ptr + current_size, read_size);
+        current_size += read_size;
+        metrics_count(METRICS_RECEIVED_BYTES, read_size);
+    }
+    session->received_us = timer_get_monotonic_us();
+    metrics_record(METRICS_RECEIVE_RATE, (uint64_t)size * 1000000 / (session->received_us - start_us + 1));
+    return 0;
+}
+
+static void init_indicators_ctx(session_t *session)
+{
+    size_t i;
+    for (i = 0; i < indicators_count; i++)
+    {
+        session->lib->handlers[i].ctx_initializer(session->ctx[i]);
+        atomic_store(&session->coverage[i], 0);
+        atomic_store(&session->pending_work[i], 0);
+    }
+}
+
+static int waiting_for_indicators_finish(session_t *session)
 {
     size_t i;
     for (i = 0; i < indicators_count; i++)
     {
-        indicators_handlers[i].ctx_initializer(indicators_ctx[i]);
+        sem_wait(&session->finish_sem);
     }
+    return (sem_trywait(&session->finish_sem) == 0) ? -1 : 0;
 }
 
-static int waiting_for_indicators_finish()
+/* Queued work of the session was dropped, workers must not process it anymore */
+static void drop_indicators_pending_work(session_t *session)
 {
     size_t i;
     for (i = 0; i < indicators_count; i++)
     {
-        sem_wait(&indicators_finish_sem);
+        overload_account_drop(i, atomic_exchange(&session->pending_work[i], 0));
     }
-    return (sem_trywait(&indicators_finish_sem) == 0) ? -1 : 0;
 }
 
-static void clear_indicators_finish_sem(void)
+static void clear_indicators_finish_sem(session_t *session)
 {
-    while (sem_trywait(&indicators_finish_sem) == 0)
+    while (sem_trywait(&session->finish_sem) == 0)
     {
         ;
     }
+    while (sem_trywait(&session->drain_sem) == 0)
+    {
+        ;
+    }
+}
+
+/*
+ * Drop chunks which are still in queues and wait for chunks being processed
+ * right now, after that every ctx is consistent and could be extracted as-is.
+ */
+static int drain_indicators(session_t *session)
+{
+    size_t i;
+    struct timespec deadline = {0};
+
+    if (preprocessing)
+    {
+        /* chunk being preprocessed is queued to indicators before finalize */
+        thread_pool_remove_queued_tasks(tp, session->preprocess_lane, 1);
+    }
+    thread_pool_remove_queued_tasks(tp, session->first_lane, indicators_count);
+    /* dropped snapshot tasks will never complete */
+    atomic_store(&session->snapshot.pending, 0);
+    atomic_store(&session->snapshot.in_flight, false);
+
+    calc_indicators_finalize(session, &session->drain_sem);
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += PARTIAL_RESULTS_GRACE;
+    for (i = 0; i < indicators_count; i++)
+    {
+        while (sem_timedwait(&session->drain_sem, &deadline) != 0)
+        {
+            if (errno != EINTR)
+            {
+                logger(ERROR, "Indicators were not stopped in %d seconds", PARTIAL_RESULTS_GRACE);
+                return -1;
+            }
+        }
+    }
+    drop_indicators_pending_work(session);
+    return 0;
 }
 
-int send_indicators_metrics_to_client(const int fd)
+int send_indicators_metrics_to_client(session_t *session)
 {
-    ssize_t ret = -1;
+    int ret = -1;
     size_t i = 0;
+    message_t *response     = session->response;
     uint32_t  payload_size  = (uint32_t)(sizeof(uint64_t) * indicators_count);
     size_t    response_size = sizeof(messageHeader_t) + payload_size;
     uint64_t *payload_ptr   = (uint64_t *)response->payload;
 
-    logger(DEBUG, "Payload size %lu", payload_size);
-    memset(response, 0x00, sizeof(response->header) + payload_size);
-
-    response->header.magic      = htonl(HEADER_MAGIC);
-    response->header.size       = htonl(payload_size);
-    response->header.frame_size = htonl(sizeof(uint64_t));
-    response->header.version    = htonl(HEADER_VERSION);
+    logger(DEBUG, "Payload size %u", payload_size);
+    fill_response_header(&response->header, MESSAGE_TYPE_RESULT, ntohl(session->msg->header.size));
+    response->header.status     = MESSAGE_STATUS_OK;
+    response->header.sampling   = (uint8_t)session->sampling;
+    response->header.library_id = htonl(session->lib->id);
 
     for (i = 0; i < indicators_count; i++)
     {
-        payload_ptr[i] = htobe64(indicators_handlers->extract(indicators_ctx[i]));
+        payload_ptr[i] = htobe64(session->lib->handlers[i].extract(session->ctx[i]));
     }
 
-    ret = write(fd, response, response_size);
-    if (ret < 0 || ((size_t) ret) < response_size)
+    pthread_mutex_lock(&session->snapshot.send_lock);
+    ret = write_wrapper(session->fd, response, response_size);
+    pthread_mutex_unlock(&session->snapshot.send_lock);
+    if (ret != 0)
     {
-        logger(ERROR, "error while sending response (%d:%s)",  errno, strerror(errno));
+        logger(ERROR, "error while sending response");
         return -1;
     }
     return 0;
 }
 
-
-static int process_messages(const int fd)
+/* Send values of drained indicators with bytes processed by each of them */
+static int send_partial_indicators_metrics_to_client(session_t *session)
 {
     int ret = -1;
-    messageHeader_t  *header = NULL;
-    size_t file_size  = 0;
-    size_t frame_size = 0;
-    memset(msg, 0x00, MAX_RECEIVED_SIZE);
-
-    logger(DEBUG, "Start processing message");
+    size_t i = 0;
+    message_t *response     = session->response;
+    uint32_t  payload_size  = (uint32_t)(2 * sizeof(uint64_t) * indicators_count);
+    size_t    response_size = sizeof(messageHeader_t) + payload_size;
+    uint64_t *payload_ptr   = (uint64_t *)response->payload;
+    size_t    covered       = ntohl(session->msg->header.size);
 
-    header = &msg->header;
-    ret = check_header(fd, header);
-    if (ret != 0) {
-        logger(ERROR, "Bad header");
-        goto exit;
+    for (i = 0; i < indicators_count; i++)
+    {
+        size_t coverage = atomic_load(&session->coverage[i]);
+        payload_ptr[2 * i]     = htobe64(session->lib->handlers[i].extract(session->ctx[i]));
+        payload_ptr[2 * i + 1] = htobe64(coverage);
+        covered = (coverage < covered) ? coverage : covered;
     }
 
-    file_size = get_file_size(header);
-    if (file_size == 0)
+    fill_response_header(&response->header, MESSAGE_TYPE_RESULT, (uint32_t)covered);
+    response->header.size       = htonl(payload_size);
+    response->header.frame_size = htonl(2 * sizeof(uint64_t));
+    response->header.status     = MESSAGE_STATUS_PARTIAL;
+    response->header.sampling   = (uint8_t)session->sampling;
+    response->header.library_id = htonl(session->lib->id);
+
+    logger(INFO, "[fd %d] Sending partial results, %lu of %u bytes covered by all indicators",
+           session->fd, covered, ntohl(session->msg->header.size));
+
+    pthread_mutex_lock(&session->snapshot.send_lock);
+    ret = write_wrapper(session->fd, response, response_size);
+    pthread_mutex_unlock(&session->snapshot.send_lock);
+    if (ret != 0)
     {
-        logger(ERROR, "Bad file size");
-        ret = -1;
-        goto exit;
+        logger(ERROR, "error while sending partial response");
+        return -1;
     }
+    return 0;
+}
 
-    frame_size = get_frame_size(header);
-    if (frame_size == 0)
+static int deadline_partial_results(session_t *session)
+{
+    if (!partial_results || !atomic_load(&session->deadline_expired))
     {
-        logger(ERROR, "Bad frame size");
-        ret = -1;
-        goto exit;
+        return -1;
     }
-
-    logger(DEBUG, "Starting to read file with size %lu", file_size);
-
-    init_indicators_ctx();
-
-    ret = get_file_and_calc_indicators(fd, msg->payload, file_size, frame_size);
-    if (ret != 0) {
-        logger(ERROR, "Error while calculating indicators");
-        goto cleanup;
+    logger(INFO, "[fd %d] Deadline expired, collecting partial results", session->fd);
+    if (drain_indicators(session) != 0)
+    {
+        return -1;
     }
+    return send_partial_indicators_metrics_to_client(session);
+}
 
-    logger(DEBUG, "Waiting for indicators finish");
-    ret = waiting_for_indicators_finish();
-    if (ret != 0) {
-        logger(ERROR, "Calculating was not finished in time slot");
-        goto cleanup;
-    }
-    logger(DEBUG, "Indicators are finished");
+/* Estimate when the server could accept one more session */
+static uint16_t get_retry_after(void)
+{
+    size_t i;
+    uint64_t now = timer_get_monotonic_ms();
+    uint64_t retry_ms = deadline_s * 1000;
+    uint64_t backlog_ms = overload_get_backlog_ms();
 
-    ret = send_indicators_metrics_to_client(fd);
-    if (ret != 0) {
-        logger(ERROR, "Calculating was not finished in time slot");
-        goto exit;
+    for (i = 0; i < sessions_count; i++)
+    {
+        uint64_t deadline = sessions[i].deadline_ms;
+        if (atomic_load(&sessions[i].active) && deadline > now && deadline - now < retry_ms)
+        {
+            retry_ms = deadline - now;
+        }
     }
-    logger(DEBUG, "Indicators metrics were sent to client");
+    /* queued data could be processed before deadlines of active sessions */
+    if (backlog_ms != 0 && backlog_ms < retry_ms)
+    {
+        retry_ms = backlog_ms;
+    }
+    return (uint16_t)((retry_ms + 999) / 1000 + 1);
+}
 
-    goto exit;
+static int send_busy_status_to_client(const int fd)
+{
+    messageHeader_t header;
+    uint16_t retry_after = get_retry_after();
 
-cleanup:
-    thread_pool_remove_all_tasks(tp);
-exit:
+    fill_response_header(&header, MESSAGE_TYPE_RESULT, 0);
+    header.size        = 0;
+    header.status      = MESSAGE_STATUS_BUSY;
+    header.retry_after = htons(retry_after);
 
-    return ret;
+    logger(INFO, "[fd %d] Server is busy, retry after %u seconds", fd, retry_after);
+    metrics_count(METRICS_SESSIONS_REJECTED, 1);
+    return write_wrapper(fd, &header, sizeof(header));
 }
 
-static void polling(const int server_fd)
+static int send_too_large_status_to_client(const int fd)
 {
-    int ret = 0;
+    messageHeader_t header;
 
-    while(server_running)
-    {
-        logger(DEBUG, "Clear data before next client...");
-        timer_disarm();
-        if (clint_fd != -1)
-        {
-            close(clint_fd);
-        }
-        clear_indicators_finish_sem();
+    fill_response_header(&header, MESSAGE_TYPE_RESULT, 0);
+    header.size   = 0;
+    header.status = MESSAGE_STATUS_TOO_LARGE;
 
-        logger(INFO, "Waiting for new connection...");
-        ret = waiting_connection(server_fd);
-        if (ret < 0)
+    logger(INFO, "[fd %d] File is too large for server", fd);
+    metrics_count(METRICS_SESSIONS_REJECTED, 1);
+    return write_wrapper(fd, &header, sizeof(header));
+}
+
+static int send_job_status_to_client(const int fd, uint8_t type, uint8_t status, uint64_t job_id, uint32_t crc)
+{
+    messageHeader_t header;
+
+    fill_response_header(&header, type, 0);
+    header.size   = 0;
+    header.status = status;
+    header.crc32  = htonl(crc);
+    header.job_id = htobe64(job_id);
+    if (status == MESSAGE_STATUS_PENDING)
+    {
+        header.retry_after = htons(jobs_get_retry_after());
+    }
+    return write_wrapper(fd, &header, sizeof(header));
+}
+
+/* Answer fetch message by stored results or status of the job */
+static int send_job_results_to_client(const int fd, const messageHeader_t *header)
+{
+    int ret;
+    uint64_t job_id = be64toh(header->job_id);
+    message_t *result = NULL;
+    size_t size = 0;
+    job_status_t status = jobs_enabled() ? jobs_fetch(job_id, &result, &size) : JOB_NOT_FOUND;
+
+    switch (status)
+    {
+    case JOB_DONE:
+        logger(INFO, "[fd %d] Sending results of job %lu", fd, job_id);
+        ret = write_wrapper(fd, result, size);
+        free(result);
+        return ret;
+    case JOB_PENDING:
+        logger(INFO, "[fd %d] Job %lu is pending", fd, job_id);
+        return send_job_status_to_client(fd, MESSAGE_TYPE_RESULT, MESSAGE_STATUS_PENDING, job_id, 0);
+    default:
+        logger(INFO, "[fd %d] Job %lu is not found", fd, job_id);
+        return send_job_status_to_client(fd, MESSAGE_TYPE_RESULT, MESSAGE_STATUS_NOT_FOUND, job_id, 0);
+    }
+}
+
+/* Store received file to jobs journal and acknowledge it */
+static int submit_async_job(session_t *session, const messageHeader_t *header, const size_t file_size)
+{
+    int ret;
+    uint32_t crc = 0;
+    uint64_t job_id = 0;
+    uint64_t trace_time;
+    int fd = session->fd;
+
+    ret = receive_async_job(session, file_size, &crc);
+    if (ret != 0)
+    {
+        return ret;
+    }
+    if (header->crc32 != 0 && ntohl(header->crc32) != crc)
+    {
+        logger(ERROR, "[fd %d] Bad crc32 of payload 0x%08x, expected 0x%08x", fd, crc, ntohl(header->crc32));
+        send_job_status_to_client(fd, MESSAGE_TYPE_RESULT, MESSAGE_STATUS_BAD_CRC, 0, crc);
+        return -1;
+    }
+
+    trace_time = trace_start();
+    ret = jobs_submit(session->msg, &job_id);
+    trace_span(session->trace_id, "journal", trace_time, "bytes", (int64_t)file_size);
+    if (ret != 0)
+    {
+        send_busy_status_to_client(fd);
+        session->rejected = true;
+        return -1;
+    }
+    logger(INFO, "[fd %d] File is stored as job %lu", fd, job_id);
+    return send_job_status_to_client(fd, MESSAGE_TYPE_ACK, MESSAGE_STATUS_OK, job_id, crc);
+}
+
+/* Decide if the server has resources for the session, sessions slot is taken already */
+static bool admit_session(session_t *session, const size_t file_size)
+{
+    uint64_t backlog_ms = overload_get_backlog_ms();
+    if (backlog_ms >= deadline_s * 1000)
+    {
+        logger(INFO, "[fd %d] Queued data needs %lu ms for processing", session->fd, backlog_ms);
+        return false;
+    }
+    if (!admission_acquire(file_size))
+    {
+        logger(INFO, "[fd %d] Too many bytes in flight (%lu)", session->fd, admission_get_inflight_bytes());
+        return false;
+    }
+    session->admitted_size = file_size;
+    return true;
+}
+
+static int process_messages(session_t *session)
+{
+    int ret = -1;
+    messageHeader_t  header_buf;
+    messageHeader_t  *header = &header_buf;
+    size_t file_size  = 0;
+    size_t frame_size = 0;
+    int fd = session->fd;
+    uint64_t trace_time;
+    uint64_t accepted_us = timer_get_monotonic_us();
+
+    logger(DEBUG, "Start processing message");
+
+    memset(header, 0x00, sizeof(*header));
+    trace_time = trace_start();
+    ret = check_header(fd, header);
+    trace_span(session->trace_id, "header", trace_time, NULL, 0);
+    if (ret != 0) {
+        logger(ERROR, "Bad header");
+        goto exit;
+    }
+    if (header->type == MESSAGE_TYPE_FETCH)
+    {
+        ret = send_job_results_to_client(fd, header);
+        goto exit;
+    }
+    session->recording = recorder_start(accepted_us);
+    recorder_write(session->recording, header, sizeof(*header));
+
+    file_size = protocol_get_file_size(header, spool_enabled() ? SPOOL_MAX_FILE_SIZE : max_file_size);
+    if (file_size == 0)
+    {
+        logger(ERROR, "Bad file size");
+        send_too_large_status_to_client(fd);
+        session->rejected = true;
+        ret = -1;
+        goto exit;
+    }
+
+    frame_size = protocol_get_frame_size(header);
+    if (frame_size == 0)
+    {
+        logger(ERROR, "Bad frame size");
+        ret = -1;
+        goto exit;
+    }
+
+    if (!admit_session(session, file_size))
+    {
+        send_busy_status_to_client(fd);
+        session->rejected = true;
+        ret = -1;
+        goto exit;
+    }
+
+    trace_time = trace_start();
+    ret = alloc_receive_buffer(session, header, file_size);
+    trace_span(session->trace_id, "memory wait", trace_time, "bytes", (int64_t)file_size);
+    switch (ret)
+    {
+    case MEMORY_RESERVED:
+        break;
+    case MEMORY_NEVER_FITS:
+        send_too_large_status_to_client(fd);
+        session->rejected = true;
+        ret = -1;
+        goto exit;
+    default:
+        send_busy_status_to_client(fd);
+        session->rejected = true;
+        ret = -1;
+        goto exit;
+    }
+
+    if ((header->flags & MESSAGE_FLAG_ASYNC) && jobs_enabled())
+    {
+        ret = submit_async_job(session, header, file_size);
+        goto exit;
+    }
+
+    session->progressive = (header->flags & MESSAGE_FLAG_PROGRESSIVE) && progress_interval_ms != 0;
+    session->sampling = load_shedding ? overload_get_sampling_ratio(file_size, deadline_s * 1000) : 1;
+    if (session->sampling != 1)
+    {
+        logger(INFO, "[fd %d] Server is overloaded, processing every %u block of frames", fd, session->sampling);
+    }
+    logger(DEBUG, "Starting to read file with size %lu%s", file_size,
+           session->progressive ? " (progressive)" : "");
+
+    init_indicators_ctx(session);
+
+    ret = get_file_and_calc_indicators(session, session->msg->payload, file_size, frame_size);
+    if (ret != 0) {
+        logger(ERROR, "Error while calculating indicators");
+        goto deadline;
+    }
+
+    logger(DEBUG, "Waiting for indicators finish");
+    trace_time = trace_start();
+    ret = waiting_for_indicators_finish(session);
+    trace_span(session->trace_id, "finalize", trace_time, NULL, 0);
+    if (ret != 0) {
+        logger(ERROR, "Calculating was not finished in time slot");
+        goto deadline;
+    }
+    logger(DEBUG, "Indicators are finished");
+
+    trace_time = trace_start();
+    ret = send_indicators_metrics_to_client(session);
+    trace_span(session->trace_id, "send", trace_time, NULL, 0);
+    if (ret != 0) {
+        logger(ERROR, "Calculating was not finished in time slot");
+        goto exit;
+    }
+    logger(DEBUG, "Indicators metrics were sent to client");
+    metrics_record(METRICS_RESPONSE_LATENCY, timer_get_monotonic_us() - session->received_us);
+
+    goto exit;
+
+deadline:
+    trace_time = trace_start();
+    ret = deadline_partial_results(session);
+    trace_span(session->trace_id, "partial results", trace_time, NULL, 0);
+    if (ret == 0)
+    {
+        /* work was not finished, but results were delivered */
+        ret = 0;
+        goto exit;
+    }
+    /* worker sending interim results is not cancelled, it must not wait for client */
+    shutdown(session->fd, SHUT_WR);
+    if (preprocessing)
+    {
+        thread_pool_remove_lanes_tasks(tp, session->preprocess_lane, 1);
+    }
+    thread_pool_remove_lanes_tasks(tp, session->first_lane, indicators_count);
+    /* workers were restarted, nobody will finish dropped snapshot */
+    atomic_store(&session->snapshot.pending, 0);
+    atomic_store(&session->snapshot.in_flight, false);
+    drop_indicators_pending_work(session);
+exit:
+
+    return ret;
+}
+
+/* Contexts are allocated by the current version of library, it is kept till they are freed */
+static int alloc_indicators_ctx(session_t *session)
+{
+    size_t i;
+
+    session->lib = indicators_lib_acquire();
+    if (session->lib == NULL)
+    {
+        logger(ERROR, "Indicators library is not loaded");
+        return -1;
+    }
+    for (i = 0; i < indicators_count; i++)
+    {
+        session->ctx[i] = indicators_lib_ctx_alloc(session->lib, i);
+        if (session->ctx[i] == NULL)
+        {
+            logger(ERROR, "Can not allocate indicator context");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void free_indicators_ctx(session_t *session)
+{
+    size_t i;
+
+    if (session->lib == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < indicators_count; i++)
+    {
+        if (session->ctx[i] != NULL)
+        {
+            indicators_lib_ctx_free(session->lib, i, session->ctx[i]);
+            session->ctx[i] = NULL;
+        }
+    }
+    indicators_lib_release(session->lib);
+    session->lib = NULL;
+}
+
+/* Move free slot to the current version of library, the old one is unloaded by its last user */
+static int update_indicators_ctx(session_t *session)
+{
+    if (session->lib != NULL && session->lib->generation == indicators_lib_get_generation())
+    {
+        return 0;
+    }
+    free_indicators_ctx(session);
+    if (alloc_indicators_ctx(session) != 0)
+    {
+        free_indicators_ctx(session);
+        return -1;
+    }
+    return 0;
+}
+
+/* Free slots do not keep old version of library after reload */
+static void update_free_sessions(void)
+{
+    size_t i;
+    for (i = 0; i < sessions_count; i++)
+    {
+        if (!atomic_load(&sessions[i].active))
+        {
+            update_indicators_ctx(&sessions[i]);
+        }
+    }
+}
+
+/* Release old version of library from idle slots once reload is noticed by the main thread */
+static void check_library_generation(uint32_t *seen)
+{
+    uint32_t current = indicators_lib_get_generation();
+    if (current != *seen)
+    {
+        *seen = current;
+        update_free_sessions();
+    }
+}
+
+static void *session_thread(void *arg)
+{
+    session_t *session = arg;
+    int ret;
+    int fd = session->fd;
+
+    trace_set_thread_name("session", session->id);
+    affinity_bind_io(session->node);
+    logger(INFO, "[fd %d] Process incoming data from client...", fd);
+    ret = process_messages(session);
+    logger(INFO, "[fd %d] Processing finished. %s", fd, ret == 0 ? "Success" : "Fail");
+    if (atomic_load(&session->deadline_expired))
+    {
+        metrics_count(METRICS_SESSIONS_TIMED_OUT, 1);
+    }
+    else if (ret != 0 && !session->rejected)
+    {
+        metrics_count(METRICS_SESSIONS_FAILED, 1);
+    }
+
+    logger(DEBUG, "Clear data before next client...");
+    timer_disarm(session->timer);
+    if (session->admitted_size != 0)
+    {
+        admission_release(session->admitted_size);
+        session->admitted_size = 0;
+    }
+    free_derived(session);
+    free_receive_buffer(session, ret == 0);
+    recorder_stop(session->recording);
+    session->recording = NULL;
+
+    session->fd = -1;
+    close_connection_gracefully(fd);
+    trace_dump_session(session->trace_id);
+    if (session->lib->generation != indicators_lib_get_generation())
+    {
+        /* library was reloaded during session, old version is not needed by slot anymore */
+        free_indicators_ctx(session);
+    }
+    atomic_store(&session->active, false);
+    return NULL;
+}
+
+static session_t *get_free_session(void)
+{
+    size_t i;
+    size_t active = 0;
+
+    for (i = 0; i < sessions_count; i++)
+    {
+        active += atomic_load(&sessions[i].active) ? 1 : 0;
+    }
+    if (active >= sessions_limit)
+    {
+        return NULL;
+    }
+    for (i = 0; i < sessions_count; i++)
+    {
+        session_t *session = &sessions[i];
+        if (atomic_load(&session->active))
+        {
+            continue;
+        }
+        if (session->joinable)
+        {
+            pthread_join(session->thread, NULL);
+            session->joinable = false;
+        }
+        return session;
+    }
+    return NULL;
+}
+
+static int start_session(session_t *session, const int fd, const uint64_t trace_id)
+{
+    int ret;
+    sigset_t set;
+    unsigned deadline;
+
+    /* timer of previous session could expire right before it was disarmed */
+    clear_indicators_finish_sem(session);
+    atomic_store(&session->deadline_expired, 0);
+    session->rejected = false;
+
+    session->fd = fd;
+    session->trace_id = trace_id;
+    deadline = deadline_s;
+    session->deadline_ms = timer_get_monotonic_ms() + deadline * 1000;
+    atomic_store(&session->active, true);
+    logger(DEBUG, "Arming timer for session %lu", session->id);
+    timer_arm(session->timer, deadline);
+
+    /* timer signals are handled by main thread only */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    ret = pthread_create(&session->thread, NULL, session_thread, session);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+    if (ret != 0)
+    {
+        logger(ERROR, "Can not create session thread (%d:%s)", ret, strerror(ret));
+        timer_disarm(session->timer);
+        session->fd = -1;
+        atomic_store(&session->active, false);
+        return -1;
+    }
+    session->joinable = true;
+    metrics_count(METRICS_SESSIONS_ACCEPTED, 1);
+    return 0;
+}
+
+static void stop_sessions(void)
+{
+    size_t i;
+    for (i = 0; i < sessions_count; i++)
+    {
+        session_t *session = &sessions[i];
+        if (!session->joinable)
+        {
+            continue;
+        }
+        if (atomic_load(&session->active))
+        {
+            shutdown(session->fd, SHUT_RDWR);
+        }
+        pthread_join(session->thread, NULL);
+        session->joinable = false;
+    }
+}
+
+/* Start session for connection or answer by busy status if all slots are taken */
+static void serve_connection(const int fd, const uint64_t trace_id)
+{
+    session_t *session;
+
+    update_free_sessions();
+    session = get_free_session();
+    if (session == NULL || session->lib == NULL)
+    {
+        send_busy_status_to_client(fd);
+        close_connection_gracefully(fd);
+        return;
+    }
+
+    if (start_session(session, fd, trace_id) != 0)
+    {
+        close(fd);
+    }
+}
+
+static void write_server_gauges(FILE *out);
+
+/* Pass listening socket to new server, metrics port is released for it too */
+static bool hand_off_listener(const int handoff_fd, const int server_fd)
+{
+    int channel = handoff_accept(handoff_fd);
+    if (channel == -1)
+    {
+        return false;
+    }
+    metrics_stop();
+    if (handoff_pass(channel, server_fd) == 0)
+    {
+        logger(INFO, "Listening socket is passed to new server, draining sessions...");
+        return true;
+    }
+    if (metrics_port != 0 && metrics_start(metrics_port, write_server_gauges) != 0)
+    {
+        logger(ERROR, "Error while starting metrics server");
+    }
+    return false;
+}
+
+/* Wait for sessions without interrupting them, deadline limits every session */
+static void drain_sessions(void)
+{
+    size_t i;
+    for (i = 0; i < sessions_count; i++)
+    {
+        if (sessions[i].joinable)
+        {
+            pthread_join(sessions[i].thread, NULL);
+            sessions[i].joinable = false;
+        }
+    }
+}
+
+/* Returns true if listening socket was passed to new server */
+static bool polling(const int server_fd, const int handoff_fd)
+{
+    int ret = 0;
+    int fd = -1;
+    uint64_t trace_id;
+    uint64_t trace_time;
+    bool handed_off = false;
+    uint32_t generation = indicators_lib_get_generation();
+    struct pollfd fds[2] = {
+        {.fd = server_fd,  .events = POLLIN},
+        {.fd = handoff_fd, .events = POLLIN}, /* negative fd is ignored */
+    };
+
+    trace_set_thread_name("main", 0);
+    while(server_running)
+    {
+        logger(INFO, "Waiting for new connection...");
+        do
+        {
+            ret = poll(fds, 2, LIBRARY_CHECK_INTERVAL);
+            check_library_generation(&generation);
+        } while (ret == 0 && server_running);
+        /* dump is requested by signal, it interrupts waiting */
+        trace_poll();
+        if (ret <= 0)
+        {
+            continue;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            handed_off = hand_off_listener(handoff_fd, server_fd);
+            if (handed_off)
+            {
+                break;
+            }
+        }
+        if (!(fds[0].revents & POLLIN))
+        {
+            continue;
+        }
+
+        trace_id = trace_new_session();
+        trace_time = trace_start();
+        fd = accept_connection(server_fd);
+        trace_span(trace_id, "accept", trace_time, "fd", fd);
+        if (fd < 0)
+        {
+            logger(DEBUG, "Connection is not established");
+            continue;
+        }
+        serve_connection(fd, trace_id);
+    }
+    if (handed_off)
+    {
+        drain_sessions();
+        /* jobs of drained sessions are not known to new server yet */
+        jobs_drain();
+    }
+    else
+    {
+        stop_sessions();
+    }
+    return handed_off;
+}
+
+/* Load of worker for coordinator */
+static void report_load(const int channel, const uint64_t connections)
+{
+    size_t i;
+    cluster_message_t msg;
+
+    memset(&msg, 0x00, sizeof(msg));
+    msg.type = CLUSTER_LOAD;
+    for (i = 0; i < sessions_count; i++)
+    {
+        msg.active_sessions += atomic_load(&sessions[i].active) ? 1 : 0;
+    }
+    msg.max_sessions   = (uint32_t)sessions_limit;
+    msg.inflight_bytes = admission_get_inflight_bytes();
+    msg.backlog_ms     = overload_get_backlog_ms();
+    msg.connections    = connections;
+    cluster_send(channel, &msg, -1);
+}
+
+/* Worker gets connections from coordinator over control channel instead of accept */
+static void polling_channel(const int channel)
+{
+    int ret;
+    int fd;
+    struct pollfd pfd = {.fd = channel, .events = POLLIN};
+    cluster_message_t msg;
+    uint64_t connections = 0;
+    uint64_t last_report = 0;
+    uint32_t generation = indicators_lib_get_generation();
+
+    trace_set_thread_name("main", 0);
+    while(server_running)
+    {
+        ret = poll(&pfd, 1, CLUSTER_REPORT_INTERVAL);
+        trace_poll();
+        check_library_generation(&generation);
+        if (ret > 0)
         {
-            continue;
+            ret = cluster_recv(channel, &msg, &fd);
+            if (ret == 0)
+            {
+                logger(INFO, "Coordinator closed control channel");
+                break;
+            }
+            if (ret > 0 && msg.type == CLUSTER_CONNECTION && fd != -1)
+            {
+                connections++;
+                serve_connection(fd, trace_new_session());
+            }
+            else if (fd != -1)
+            {
+                close(fd);
+            }
+        }
+        /* answer to ping and to every connection, so coordinator sees fresh load */
+        if (ret > 0 || timer_get_monotonic_ms() - last_report >= CLUSTER_REPORT_INTERVAL)
+        {
+            report_load(channel, connections);
+            last_report = timer_get_monotonic_ms();
         }
+    }
+    stop_sessions();
+}
+
+/* Gauges of server state for metrics endpoint */
+static void write_server_gauges(FILE *out)
+{
+    size_t i;
+    size_t active = 0;
+
+    fprintf(out, "# HELP dashcam_lane_queued_tasks Tasks waiting in thread pool lane\n"
+                 "# TYPE dashcam_lane_queued_tasks gauge\n");
+    for (i = 0; i < indicators_count * sessions_count; i++)
+    {
+        fprintf(out, "dashcam_lane_queued_tasks{lane=\"%lu\",session=\"%lu\",indicator=\"%lu\"} %lu\n",
+                i, i / indicators_count, i % indicators_count, thread_pool_get_queued_tasks(tp, i));
+    }
+
+    fprintf(out, "# HELP dashcam_indicator_speed_bytes_per_second Measured speed of indicator\n"
+                 "# TYPE dashcam_indicator_speed_bytes_per_second gauge\n");
+    for (i = 0; i < indicators_count; i++)
+    {
+        fprintf(out, "dashcam_indicator_speed_bytes_per_second{indicator=\"%lu\"} %lu\n", i, overload_get_speed(i));
+    }
+    fprintf(out, "# HELP dashcam_indicator_backlog_bytes Bytes queued for indicator\n"
+                 "# TYPE dashcam_indicator_backlog_bytes gauge\n");
+    for (i = 0; i < indicators_count; i++)
+    {
+        fprintf(out, "dashcam_indicator_backlog_bytes{indicator=\"%lu\"} %lu\n", i, overload_get_backlog(i));
+    }
+
+    for (i = 0; i < sessions_count; i++)
+    {
+        active += atomic_load(&sessions[i].active) ? 1 : 0;
+    }
+    fprintf(out, "# HELP dashcam_sessions_active Sessions which take slots\n"
+                 "# TYPE dashcam_sessions_active gauge\n"
+                 "dashcam_sessions_active %lu\n", active);
+    fprintf(out, "# HELP dashcam_inflight_bytes Files bytes of admitted sessions\n"
+                 "# TYPE dashcam_inflight_bytes gauge\n"
+                 "dashcam_inflight_bytes %lu\n", admission_get_inflight_bytes());
+    fprintf(out, "# HELP dashcam_memory_used_bytes Memory reserved for receive buffers\n"
+                 "# TYPE dashcam_memory_used_bytes gauge\n"
+                 "dashcam_memory_used_bytes %lu\n", memory_governor_get_used());
+    fprintf(out, "# HELP dashcam_memory_budget_bytes Memory budget for receive buffers\n"
+                 "# TYPE dashcam_memory_budget_bytes gauge\n"
+                 "dashcam_memory_budget_bytes %lu\n", memory_governor_get_budget());
+    if (jobs_enabled())
+    {
+        fprintf(out, "# HELP dashcam_jobs_pending Async jobs waiting for computing\n"
+                     "# TYPE dashcam_jobs_pending gauge\n"
+                     "dashcam_jobs_pending %lu\n", jobs_get_pending());
+    }
+    perf_counters_write_metrics(out);
+}
+
+#define MB ((size_t) (1000 * 1000))
+#define KB ((size_t) 1000)
+
+/*
+ * Tunables of control socket
+ *
+ * Names and units are the same as of command line options, value is a number
+ * or one of names if they are given.
+ */
+typedef struct tunable_s {
+    const char  *name;
+    size_t       min;
+    size_t       max;
+    const char *const *names; /* names of values from 0, NULL - only number */
+    size_t     (*get)(void);
+    void       (*set)(size_t value);
+} tunable_t;
+
+static const char *const bool_names[] = {"off", "on", NULL};
+static const char *const log_level_names[] = {"debug", "info", "error", NULL};
+
+static size_t get_log_level(void)
+{
+    return (size_t)atomic_load_explicit(&log_level, memory_order_relaxed);
+}
+
+static void set_log_level(size_t value)
+{
+    log_set_level((int)value);
+}
+
+static size_t get_deadline(void)
+{
+    return deadline_s;
+}
+
+static void set_deadline(size_t value)
+{
+    deadline_s = (unsigned)value;
+}
+
+static size_t get_max_sessions(void)
+{
+    return sessions_limit;
+}
+
+static void set_max_sessions(size_t value)
+{
+    sessions_limit = value;
+}
+
+static size_t get_max_inflight(void)
+{
+    return admission_get_limit() / MB;
+}
+
+static void set_max_inflight(size_t value)
+{
+    admission_set_limit(value * MB);
+}
+
+static size_t get_memory_budget(void)
+{
+    return memory_governor_get_budget() / MB;
+}
+
+static void set_memory_budget(size_t value)
+{
+    memory_governor_set_budget(value * MB);
+}
+
+static size_t get_max_file_size(void)
+{
+    return max_file_size / MB;
+}
+
+static void set_max_file_size(size_t value)
+{
+    max_file_size = value * MB;
+}
+
+static size_t get_chunk_size(void)
+{
+    return chunk_size / KB;
+}
+
+static void set_chunk_size(size_t value)
+{
+    chunk_size = value * KB;
+}
+
+static size_t get_progress_interval(void)
+{
+    return progress_interval_ms;
+}
+
+static void set_progress_interval(size_t value)
+{
+    progress_interval_ms = (unsigned)value;
+}
+
+static size_t get_partial_results(void)
+{
+    return partial_results;
+}
+
+static void set_partial_results(size_t value)
+{
+    partial_results = value != 0;
+}
+
+static size_t get_load_shedding(void)
+{
+    return load_shedding;
+}
+
+static void set_load_shedding(size_t value)
+{
+    load_shedding = value != 0;
+}
+
+static size_t get_spool_threshold(void)
+{
+    return spool_threshold / MB;
+}
+
+static void set_spool_threshold(size_t value)
+{
+    spool_threshold = value * MB;
+}
 
-        logger(DEBUG, "Arming timer before accepting connection");
-        timer_arm(TIME_FOR_PROCESSING);
-        clint_fd = accept_connection(server_fd);
-        if (clint_fd < 0)
+static tunable_t tunables[] = {
+    {"log-level",         DEBUG, ERROR,          log_level_names, get_log_level,         set_log_level},
+    {"deadline",          1,     3600,           NULL,            get_deadline,          set_deadline},
+    {"max-sessions",      1,     0,              NULL,            get_max_sessions,      set_max_sessions},
+    {"max-inflight",      1,     1000 * 1000,    NULL,            get_max_inflight,      set_max_inflight},
+    {"memory-budget",     1,     1000 * 1000,    NULL,            get_memory_budget,     set_memory_budget},
+    {"max-file-size",     1,     4000,           NULL,            get_max_file_size,     set_max_file_size},
+    {"chunk-size",        0,     1000 * 1000,    NULL,            get_chunk_size,        set_chunk_size},
+    {"progress-interval", 0,     3600 * 1000,    NULL,            get_progress_interval, set_progress_interval},
+    {"partial-results",   0,     1,              bool_names,      get_partial_results,   set_partial_results},
+    {"load-shedding",     0,     1,              bool_names,      get_load_shedding,     set_load_shedding},
+    {"spool-threshold",   0,     1000 * 1000,    NULL,            get_spool_threshold,   set_spool_threshold},
+};
+
+static tunable_t *find_tunable(const char *name)
+{
+    size_t i;
+    for (i = 0; i < sizeof(tunables) / sizeof(tunables[0]); i++)
+    {
+        if (strcmp(tunables[i].name, name) == 0)
         {
-            logger(DEBUG, "Connection is not established");
-            continue;
+            return &tunables[i];
         }
+    }
+    return NULL;
+}
+
+int server_get_tunable_bounds(const char *name, size_t *min, size_t *max)
+{
+    const tunable_t *tunable = find_tunable(name);
+    if (tunable == NULL)
+    {
+        return -1;
+    }
+    *min = tunable->min;
+    *max = tunable->max;
+    return 0;
+}
+
+static void write_tunable(const tunable_t *tunable, FILE *out)
+{
+    size_t value = tunable->get();
+    if (tunable->names != NULL)
+    {
+        fprintf(out, "%s %s\n", tunable->name, tunable->names[value]);
+    }
+    else
+    {
+        fprintf(out, "%s %lu\n", tunable->name, value);
+    }
+}
+
+static void control_list(FILE *out)
+{
+    size_t i;
+    for (i = 0; i < sizeof(tunables) / sizeof(tunables[0]); i++)
+    {
+        write_tunable(&tunables[i], out);
+    }
+}
+
+static int control_get(const char *name, FILE *out)
+{
+    tunable_t *tunable = find_tunable(name);
+    if (tunable == NULL)
+    {
+        return -1;
+    }
+    write_tunable(tunable, out);
+    return 0;
+}
+
+static int control_set(const char *name, const char *value, FILE *out)
+{
+    size_t i;
+    size_t number = 0;
+    char *end = NULL;
+    bool found = false;
+    tunable_t *tunable = find_tunable(name);
 
-        /* process data from client */
-        logger(INFO, "[fd %d] Process incoming data from client...", clint_fd);
-        ret = process_messages(clint_fd);
-        logger(INFO, "[fd %d] Processing finished. %s", clint_fd, ret == 0 ? "Success" : "Fail");
+    if (tunable == NULL)
+    {
+        fprintf(out, "error unknown tunable %s\n", name);
+        return -1;
+    }
+    for (i = 0; tunable->names != NULL && tunable->names[i] != NULL; i++)
+    {
+        if (strcmp(tunable->names[i], value) == 0)
+        {
+            number = i;
+            found  = true;
+        }
+    }
+    if (!found)
+    {
+        errno  = 0;
+        number = strtoul(value, &end, 10);
+        if (errno != 0 || *end != '\0' || value[0] == '-')
+        {
+            fprintf(out, "error %s is not a number\n", value);
+            return -1;
+        }
+    }
+    if (number < tunable->min || number > tunable->max)
+    {
+        fprintf(out, "error %s must be in [%lu, %lu]\n", name, tunable->min, tunable->max);
+        return -1;
     }
+    tunable->set(number);
+    return 0;
+}
+
+static void control_stats(FILE *out)
+{
+    metrics_write(out);
+    write_server_gauges(out);
 }
 
+static const control_handlers_t control_handlers = {
+    .list   = control_list,
+    .get    = control_get,
+    .set    = control_set,
+    .stats  = control_stats,
+    .reload = indicators_lib_reload,
+};
+
 int init_thread_pool(void)
 {
     int ret = -1;
     size_t i;
-    thread_pool_lane_conf_t *lanes = calloc(sizeof(*lanes),indicators_count);
+    size_t lanes_count = indicators_count * sessions_count + (preprocessing ? sessions_count : 0);
+    thread_pool_lane_conf_t *lanes = calloc(sizeof(*lanes), lanes_count);
     if (lanes == NULL)
     {
         logger(ERROR, "Error while allocating memory");
         goto exit;
     }
-    for (i = 0; i < indicators_count; i++)
+    /* one worker per lane keeps chunks of every ctx in order */
+    for (i = 0; i < lanes_count; i++)
     {
-        lanes[i].size = MAX_CLIENTS_COUNT;
+        lanes[i].size = 1;
+        /* lanes of slot work on its node */
+        lanes[i].node = affinity_get_slot_node((i < indicators_count * sessions_count) ? i / indicators_count :
+                                               i - indicators_count * sessions_count);
     }
-    tp = thread_pool_create(lanes, indicators_count);
+    tp = thread_pool_create(lanes, lanes_count);
     if (tp != NULL)
     {
         ret = 0;
@@ -419,46 +2009,193 @@ exit:
 }
 
 int init_indicators_lib()
+{
+    /* count of indicators is the same for every version of library */
+    indicators_lib_t *lib = indicators_lib_acquire();
+    if (lib == NULL)
+    {
+        return -1;
+    }
+    indicators_count = lib->count;
+    preprocessing    = (lib->preprocessor != NULL);
+    indicators_lib_release(lib);
+    return overload_init(indicators_count, indicators_count * sessions_count);
+}
+
+void deinit_indicators_lib()
+{
+    overload_deinit();
+}
+
+static int init_session(session_t *session, size_t id)
+{
+    session->id = id;
+    session->fd = -1;
+    session->spool.fd = -1;
+    session->first_lane = id * indicators_count;
+    /* lanes of preprocessing follow lanes of indicators of all slots */
+    session->preprocess_lane = indicators_count * sessions_count + id;
+    session->node = affinity_get_slot_node(id);
+    session->msg_node = -1;
+    atomic_init(&session->active, false);
+    atomic_init(&session->snapshot.pending, 0);
+    atomic_init(&session->snapshot.in_flight, false);
+    pthread_mutex_init(&session->snapshot.send_lock, NULL);
+    pthread_mutex_init(&session->derived_lock, NULL);
+    LIST_INIT(&session->derived);
+
+    session->ctx = calloc(sizeof(*session->ctx), indicators_count);
+    session->coverage = calloc(sizeof(*session->coverage), indicators_count);
+    session->pending_work = calloc(sizeof(*session->pending_work), indicators_count);
+    if (session->ctx == NULL || session->coverage == NULL || session->pending_work == NULL)
+    {
+        logger(ERROR, "Can not allocate memory for session");
+        return -1;
+    }
+    if (alloc_indicators_ctx(session) != 0)
+    {
+        return -1;
+    }
+
+    if (alloc_message_buffers(session) != 0)
+    {
+        logger(ERROR, "Can not allocate memory for message buffers");
+        return -1;
+    }
+
+    if (sem_init(&session->finish_sem, 0, 0) != 0 || sem_init(&session->drain_sem, 0, 0) != 0)
+    {
+        logger(ERROR, "Failed on sem_init");
+        return -1;
+    }
+
+    if (init_timer(&session->timer, session, timer_expired_handler) != 0)
+    {
+        logger(ERROR, "Error while initializing timer");
+        return -1;
+    }
+    return 0;
+}
+
+static void deinit_session(session_t *session)
+{
+    deinit_timer(&session->timer);
+    free_receive_buffer(session, false);
+    free_message_buffers(session);
+    if (session->ctx != NULL)
+    {
+        free_indicators_ctx(session);
+    }
+    free(session->ctx);
+    session->ctx = NULL;
+    free(session->coverage);
+    session->coverage = NULL;
+    free(session->pending_work);
+    session->pending_work = NULL;
+    sem_destroy(&session->finish_sem);
+    sem_destroy(&session->drain_sem);
+    pthread_mutex_destroy(&session->snapshot.send_lock);
+    pthread_mutex_destroy(&session->derived_lock);
+}
+
+static int init_sessions(size_t count)
 {
     size_t i;
-    indicators_count = get_indicators_count();
-    indicators_handlers = get_indicators_handlers();
-    if (indicators_handlers == NULL || indicators_count == 0)
+    sessions = calloc(sizeof(*sessions), count);
+    if (sessions == NULL)
     {
+        logger(ERROR, "Can not allocate memory for sessions");
         return -1;
     }
-    indicators_ctx = calloc(sizeof(*indicators_ctx), indicators_count);
-    for (i = 0; i < indicators_count; i++)
+    sessions_count = count;
+    for (i = 0; i < count; i++)
     {
-        indicators_ctx[i] = indicators_handlers[i].ctx_allocator();
+        if (init_session(&sessions[i], i) != 0)
+        {
+            return -1;
+        }
     }
     return 0;
 }
 
-void deinit_indicators_lib()
+static void deinit_sessions(void)
 {
     size_t i;
-    if (indicators_handlers == NULL || indicators_count == 0 || indicators_ctx == NULL)
+    if (sessions == NULL)
     {
         return;
     }
-    for (i = 0; i < indicators_count; i++)
+    for (i = 0; i < sessions_count; i++)
     {
-        indicators_handlers[i].ctx_free(indicators_ctx[i]);
-        indicators_ctx[i] = NULL;
+        deinit_session(&sessions[i]);
     }
-    free(indicators_ctx);
-    indicators_ctx = NULL;
+    free(sessions);
+    sessions = NULL;
+    sessions_count = 0;
 }
 
-void server_run(char *ip, uint16_t  port)
+void server_run(const server_options_t *options)
 {
     int server_fd = -1;
+    int takeover_fd = -1; /* channel to running server which passes listening socket */
+    int handoff_fd = -1;  /* listener for the next server */
+    bool handed_off = false;
 
     logger(INFO, "Preparing all server's resources...");
 
-    server_fd = init_server(ip, port, MAX_CLIENTS_COUNT);
-    if(server_fd < 0)
+    if (options->trace_dir != NULL && trace_init(options->trace_dir) != 0)
+    {
+        logger(ERROR, "Error while initializing tracing");
+        return;
+    }
+
+    if (options->record_dir != NULL && recorder_init(options->record_dir) != 0)
+    {
+        logger(ERROR, "Error while initializing session recording");
+        trace_deinit();
+        return;
+    }
+
+    progress_interval_ms = options->progress_interval_ms;
+    partial_results      = options->partial_results;
+    load_shedding        = options->load_shedding;
+    sessions_count       = (options->max_sessions != 0) ? options->max_sessions : MAX_CLIENTS_COUNT;
+    sessions_limit       = sessions_count;
+    spool_threshold      = options->spool_threshold;
+    deadline_s           = (options->deadline_s != 0) ? options->deadline_s : TIME_FOR_PROCESSING;
+    max_file_size        = (options->max_file_size != 0) ? options->max_file_size : MAX_FILE_SIZE;
+    chunk_size           = options->chunk_size;
+    /* slots are allocated once, limit could be only lowered and raised back */
+    find_tunable("max-sessions")->max = sessions_count;
+    if (options->spool_dir != NULL && spool_init(options->spool_dir, options->spool_policy) != 0)
+    {
+        logger(ERROR, "Error while initializing spool");
+        return;
+    }
+    admission_init((options->max_inflight_bytes != 0) ? options->max_inflight_bytes :
+                   sessions_count * (spool_enabled() ? SPOOL_MAX_FILE_SIZE : max_file_size));
+    if (memory_governor_init((options->memory_budget != 0) ? options->memory_budget :
+                             sessions_count * (sizeof(messageHeader_t) + max_file_size)) != 0)
+    {
+        logger(ERROR, "Error while initializing memory governor");
+        return;
+    }
+
+    /* worker of cluster gets connections from coordinator */
+    if (options->worker_fd == -1 && options->upgrade_socket != NULL)
+    {
+        takeover_fd = handoff_connect(options->upgrade_socket);
+    }
+    if (options->worker_fd != -1)
+    {
+        server_fd = options->worker_fd;
+    }
+    else if (takeover_fd == -1)
+    {
+        server_fd = init_server(options->ip, options->port, LISTEN_BACKLOG);
+    }
+    /* running server accepts connections till this one is ready */
+    if(server_fd < 0 && takeover_fd == -1)
     {
         logger(ERROR, "Error while create server socket descriptor");
         goto exit;
@@ -470,9 +2207,21 @@ void server_run(char *ip, uint16_t  port)
         goto exit;
     }
 
-    if (alloc_message_buffers() != 0)
+    if (metrics_init(indicators_count) != 0)
     {
-        logger(ERROR, "Can not allocate memory for message buffers");
+        logger(ERROR, "Error while initializing metrics");
+        goto exit;
+    }
+
+    if (options->perf_counters && perf_counters_init(indicators_count) != 0)
+    {
+        logger(ERROR, "Error while initializing perf counters");
+        goto exit;
+    }
+
+    if (init_sessions(sessions_count) != 0)
+    {
+        logger(ERROR, "Can not prepare sessions");
         goto exit;
     }
 
@@ -482,30 +2231,80 @@ void server_run(char *ip, uint16_t  port)
         goto exit;
     }
 
-    if (init_timer(timer_expired_handler) != 0)
+    if (options->jobs_dir != NULL && jobs_init(options->jobs_dir, indicators_count) != 0)
     {
-        logger(ERROR, "Error while initializing timer");
+        logger(ERROR, "Error while initializing jobs");
         goto exit;
     }
 
-    if (sem_init(&indicators_finish_sem, 0, 0) != 0)
+    if (takeover_fd != -1)
     {
-        logger(ERROR, "Failed on sem_init");
+        server_fd = handoff_takeover(takeover_fd);
+        if (server_fd < 0)
+        {
+            logger(ERROR, "Error while taking over listening socket");
+            goto exit;
+        }
+    }
+
+    if (options->worker_fd == -1 && options->upgrade_socket != NULL &&
+        (handoff_fd = handoff_listen(options->upgrade_socket)) < 0)
+    {
+        logger(ERROR, "Error while listening handoff socket");
+        goto exit;
+    }
+
+    metrics_port = options->metrics_port;
+    if (options->metrics_port != 0 && metrics_start(options->metrics_port, write_server_gauges) != 0)
+    {
+        logger(ERROR, "Error while starting metrics server");
+        goto exit;
+    }
+
+    if (options->control_socket != NULL && control_start(options->control_socket, &control_handlers) != 0)
+    {
+        logger(ERROR, "Error while starting control socket");
         goto exit;
     }
 
-    logger(INFO, "Server prepared, start to polling...");
+    logger(INFO, "Server prepared for %lu sessions, start to polling...", sessions_count);
+    affinity_bind_io(-1);
     /* working loop */
-    polling(server_fd);
+    if (options->worker_fd != -1)
+    {
+        polling_channel(server_fd);
+    }
+    else
+    {
+        handed_off = polling(server_fd, handoff_fd);
+    }
 
 exit:
 
-    free_message_buffers();
-    deinit_timer();
-    deinit_indicators_lib();
+    control_stop();
+    metrics_stop();
+    jobs_deinit();
     thread_pool_destroy(tp);
+    perf_counters_dump();
+    perf_counters_deinit();
+    deinit_sessions();
+    metrics_deinit();
+    deinit_indicators_lib();
+    trace_deinit();
+    recorder_deinit();
+    spool_deinit();
+    memory_governor_deinit();
     if (server_fd != -1)
     {
         close(server_fd);
     }
+    if (handoff_fd != -1)
+    {
+        close(handoff_fd);
+        /* path belongs to new server after handoff */
+        if (!handed_off)
+        {
+            unlink(options->upgrade_socket);
+        }
+    }
 }
@@ -2,10 +2,51 @@
 #define SERVER_CORE_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 #include "server_utils.h"
+#include "spool.h"
 
-void server_run(char *ip, uint16_t  port);
+typedef struct server_options_s {
+    char     *ip;
+    uint16_t  port;
+    unsigned  progress_interval_ms; /* period of interim results, 0 - disabled */
+    bool      partial_results;      /* send partial results when deadline expires */
+    bool      load_shedding;        /* sample frames of new sessions under overload */
+    size_t    max_sessions;         /* sessions processed in parallel, 0 - default */
+    size_t    max_inflight_bytes;   /* limit of files bytes in admitted sessions, 0 - default */
+    size_t    memory_budget;        /* bytes for receive buffers of all sessions, 0 - default */
+    unsigned  deadline_s;           /* time for processing of session, 0 - default */
+    size_t    max_file_size;        /* files bigger than this are not received to memory, 0 - default */
+    size_t    chunk_size;           /* minimum bytes dispatched to indicators at once, 0 - every read */
+    uint16_t  metrics_port;         /* port of metrics endpoint on localhost, 0 - disabled */
+    char     *trace_dir;            /* directory for traces of sessions, NULL - disabled */
+    char     *record_dir;           /* directory for recordings of sessions, NULL - disabled */
+    char     *spool_dir;            /* directory for spool files, NULL - files are received to memory */
+    spool_policy_t spool_policy;    /* delete or retain spool files after session */
+    size_t    spool_threshold;      /* files bigger than this are spooled */
+    char     *jobs_dir;             /* directory for journal and results of async sessions, NULL - disabled */
+    bool      perf_counters;        /* collect hardware counters of indicators */
+    char     *upgrade_socket;       /* Unix socket path for handoff of listening socket, NULL - disabled */
+    int       worker_fd;            /* control channel from cluster coordinator, -1 - standalone server */
+    char     *control_socket;       /* Unix socket path for runtime tuning, NULL - disabled */
+} server_options_t;
+
+void server_run(const server_options_t *options);
+
+/**
+ * Bounds of option which could be changed by control socket
+ *
+ * Command line and configuration file are checked by the same bounds, so
+ * every value accepted on start could be set at runtime and back.
+ *
+ * @param[in]   name    long option without dashes.
+ * @param[out]  min     minimal value in units of the option.
+ * @param[out]  max     maximal value in units of the option.
+ * @returns     Zero if option is tunable
+ */
+int server_get_tunable_bounds(const char *name, size_t *min, size_t *max);
 void server_exit(void);
 
 #endif /* SERVER_CORE_H_ */
@@ -6,9 +6,11 @@
 #include <string.h>
 #include <fcntl.h>
 #include <stdbool.h>
+#include <poll.h>
 
 #include "log.h"
 #include "server_utils.h"
+#include "timer.h"
 
 static int init_server_address(struct sockaddr_in *addr, char *ip, uint16_t port);
 static int init_server_socket(struct sockaddr_in *serv_addr, int max_client_count);
@@ -196,3 +198,84 @@ size_t read_wrapper(int fd, uint8_t *ptr, size_t size, bool read_full_size)
 exit:
     return bytes_read;
 }
+
+int write_wrapper(int fd, const void *ptr, size_t size)
+{
+    size_t bytes_written = 0;
+    while (bytes_written != size)
+    {
+        /* peer could close connection, do not die from SIGPIPE */
+        ssize_t count = send(fd, (const uint8_t *)ptr + bytes_written, size - bytes_written, MSG_NOSIGNAL);
+        if (count == -1)
+        {
+            if(errno == EINTR || errno == EAGAIN || (EWOULDBLOCK != EAGAIN && errno == EWOULDBLOCK))
+            {
+                continue;
+            }
+            logger(ERROR, "Error while writing to socket(%d:%s)",  errno, strerror(errno));
+            return -1;
+        }
+        bytes_written += (size_t)count;
+    }
+    return 0;
+}
+
+/* Read exactly size bytes, give up if the whole data is not received in timeout_ms */
+size_t read_with_timeout(int fd, uint8_t *ptr, size_t size, int timeout_ms)
+{
+    size_t bytes_read = 0;
+    uint64_t deadline = timer_get_monotonic_ms() + (uint64_t)timeout_ms;
+    struct pollfd pfd = {
+        .fd = fd,
+        .events = POLLIN
+    };
+
+    while (bytes_read != size)
+    {
+        uint64_t now = timer_get_monotonic_ms();
+        int ret;
+        if (now >= deadline)
+        {
+            logger(DEBUG, "[fd %d] Timeout while reading %lu bytes", fd, size);
+            break;
+        }
+        ret = poll(&pfd, 1, (int)(deadline - now));
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret <= 0)
+        {
+            continue;
+        }
+        ssize_t count = read(fd, ptr + bytes_read, size - bytes_read);
+        if (count == -1 && (errno == EINTR || errno == EAGAIN || (EWOULDBLOCK != EAGAIN && errno == EWOULDBLOCK)))
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            break;
+        }
+        bytes_read += (size_t)count;
+    }
+    return bytes_read;
+}
+
+/*
+ * Close connection after response was sent
+ *
+ * Unread data in socket makes close() send RST, and dash cam could lose the
+ * response. So the sending side is shut down first and received data is dropped.
+ */
+void close_connection_gracefully(int fd)
+{
+    uint8_t buf[4096];
+    shutdown(fd, SHUT_WR);
+    make_socket_non_blocking(fd);
+    while (read(fd, buf, sizeof(buf)) > 0)
+    {
+        ;
+    }
+    close(fd);
+}
@@ -8,6 +8,9 @@ int make_socket_non_blocking(int fd);
 int accept_connection(const int server_fd);
 int waiting_connection(const int server_fd);
 size_t read_wrapper(int fd, uint8_t *ptr, size_t size, bool read_full_size);
+int write_wrapper(int fd, const void *ptr, size_t size);
+size_t read_with_timeout(int fd, uint8_t *ptr, size_t size, int timeout_ms);
+void close_connection_gracefully(int fd);
 int init_server(char *ip, uint16_t port, int max_client_count);
 
 #endif // SERVER_UTILS_H_
@@ -0,0 +1,140 @@
+#define _GNU_SOURCE /* fallocate() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+#include "log.h"
+#include "spool.h"
+
+static char *spool_dir = NULL;
+static spool_policy_t spool_policy = SPOOL_DELETE;
+static atomic_size_t next_spool = 0;
+
+int spool_init(const char *dir, spool_policy_t policy)
+{
+    if (access(dir, W_OK) != 0)
+    {
+        logger(ERROR, "Can not write spool files to %s (%d:%s)", dir, errno, strerror(errno));
+        return -1;
+    }
+    spool_dir = strdup(dir);
+    if (spool_dir == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for spool");
+        return -1;
+    }
+    spool_policy = policy;
+    logger(INFO, "Spooling is enabled, files are received to %s", spool_dir);
+    return 0;
+}
+
+void spool_deinit(void)
+{
+    free(spool_dir);
+    spool_dir = NULL;
+}
+
+bool spool_enabled(void)
+{
+    return spool_dir != NULL;
+}
+
+/* Reserve blocks, so disk full is reported before upload instead of SIGBUS while receiving */
+static int preallocate(int fd, size_t size)
+{
+    if (fallocate(fd, 0, 0, (off_t)size) == 0)
+    {
+        return 0;
+    }
+    if (errno != EOPNOTSUPP)
+    {
+        return -1;
+    }
+    return posix_fallocate(fd, 0, (off_t)size) == 0 ? 0 : -1;
+}
+
+int spool_create(spool_file_t *spool, const messageHeader_t *header, size_t file_size)
+{
+    char path[PATH_MAX];
+    void *map;
+
+    spool->fd   = -1;
+    spool->msg  = NULL;
+    spool->size = sizeof(*header) + file_size;
+    snprintf(path, sizeof(path), "%s/spool-%d-%lu.msg", spool_dir, (int)getpid(), atomic_fetch_add(&next_spool, 1));
+    spool->path = strdup(path);
+    if (spool->path == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for spool");
+        return -1;
+    }
+
+    spool->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (spool->fd == -1)
+    {
+        logger(ERROR, "Can not create spool file %s (%d:%s)", path, errno, strerror(errno));
+        goto error;
+    }
+    if (preallocate(spool->fd, spool->size) != 0)
+    {
+        logger(ERROR, "Can not allocate %lu bytes for %s (%d:%s)", spool->size, path, errno, strerror(errno));
+        goto error;
+    }
+    map = mmap(NULL, spool->size, PROT_READ | PROT_WRITE, MAP_SHARED, spool->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        logger(ERROR, "Can not map spool file %s (%d:%s)", path, errno, strerror(errno));
+        goto error;
+    }
+    /* payload is written once and read by lanes right behind socket */
+    madvise(map, spool->size, MADV_SEQUENTIAL);
+    spool->msg = map;
+    memcpy(&spool->msg->header, header, sizeof(*header));
+    logger(DEBUG, "Receiving %lu bytes to %s", file_size, path);
+    return 0;
+
+error:
+    /* broken file is never retained */
+    if (spool->fd != -1)
+    {
+        close(spool->fd);
+        spool->fd = -1;
+        unlink(path);
+    }
+    free(spool->path);
+    spool->path = NULL;
+    return -1;
+}
+
+void spool_release(spool_file_t *spool, bool success)
+{
+    bool retain = (spool_policy == SPOOL_RETAIN) || (spool_policy == SPOOL_RETAIN_FAILED && !success);
+
+    if (spool->msg != NULL)
+    {
+        munmap(spool->msg, spool->size);
+        spool->msg = NULL;
+    }
+    if (spool->fd != -1)
+    {
+        close(spool->fd);
+        spool->fd = -1;
+        if (retain)
+        {
+            logger(INFO, "Spool file %s is retained", spool->path);
+        }
+        else
+        {
+            unlink(spool->path);
+        }
+    }
+    free(spool->path);
+    spool->path = NULL;
+}
@@ -0,0 +1,55 @@
+#ifndef SPOOL_H_
+#define SPOOL_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "dash_cam.h"
+
+/* Files bigger than RAM buffers are limited only by size field of header */
+#define SPOOL_MAX_FILE_SIZE ((size_t) (UINT32_MAX - sizeof(messageHeader_t)))
+
+typedef enum spool_policy_e {
+    SPOOL_DELETE = 0,     /* file is deleted after session */
+    SPOOL_RETAIN,         /* file is kept after every session */
+    SPOOL_RETAIN_FAILED,  /* file is kept if session failed */
+} spool_policy_t;
+
+typedef struct spool_file_s {
+    int        fd;      /* -1 if session is not spooled */
+    message_t *msg;     /* mapped file: header and payload */
+    size_t     size;
+    char      *path;
+} spool_file_t;
+
+/**
+ * Enable receiving to spool files
+ *
+ * Message is written to preallocated file in dir and mapped to memory, so
+ * page cache buffers payload instead of heap.
+ *
+ * @param[in]   dir     existing directory for spool files.
+ * @param[in]   policy  what to do with file after session.
+ * @returns     Zero if success
+ */
+int spool_init(const char *dir, spool_policy_t policy);
+void spool_deinit(void);
+bool spool_enabled(void);
+
+/**
+ * Create spool file for message
+ *
+ * File is <dir>/spool-<pid>-<n>.msg, it has the same layout as data sent by
+ * dash cam, so retained file could be processed by --batch again.
+ *
+ * @param[out]  spool       mapped file.
+ * @param[in]   header      received header, it is copied to the file.
+ * @param[in]   file_size   size of payload.
+ * @returns     Zero if success
+ */
+int spool_create(spool_file_t *spool, const messageHeader_t *header, size_t file_size);
+
+/* Unmap spool file and delete or retain it according to policy */
+void spool_release(spool_file_t *spool, bool success);
+
+#endif /* SPOOL_H_ */
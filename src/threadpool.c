@@ -4,6 +4,10 @@
 #include <signal.h>
 #include "threadpool.h"
 #include "log.h"
+#include "timer.h"
+#include "metrics.h"
+#include "trace.h"
+#include "affinity.h"
 
 typedef enum lanes_manage_action_e {
     LANES_FIRST_TIME_INIT = 0,
@@ -14,7 +18,8 @@ typedef enum lanes_manage_action_e {
 
 static void *processor(void *pool);
 static void thread_pool_cleanup_task(queued_task_t **task);
-static int manage_lanes_workers(thread_pool_t *pool, lanes_manage_action_t action, thread_pool_lane_conf_t *thread_pool_lanes);
+static int manage_lanes_workers(thread_pool_t *pool, lanes_manage_action_t action, thread_pool_lane_conf_t *thread_pool_lanes,
+                                size_t first_lane, size_t lanes_count);
 
 thread_pool_t *thread_pool_create(thread_pool_lane_conf_t *thread_pool_lanes, const size_t lanes_count)
 {
@@ -44,7 +49,7 @@ thread_pool_t *thread_pool_create(thread_pool_lane_conf_t *thread_pool_lanes, co
     }
 
     logger(DEBUG, "Creating %lu lanes in thread pool", lanes_count);
-    ret = manage_lanes_workers(pool, LANES_FIRST_TIME_INIT, thread_pool_lanes);
+    ret = manage_lanes_workers(pool, LANES_FIRST_TIME_INIT, thread_pool_lanes, 0, lanes_count);
     if (ret != 0)
     {
         logger(ERROR, "Error while init thread pool lanes");
@@ -83,11 +88,12 @@ int thread_pool_add_task(thread_pool_t *pool, job_func_t job, void* arg, size_t
     task = malloc(sizeof(*task));
     if (task == NULL)
     {
-        logger(ERROR, "Can't alloc memory!", __func__);
+        logger(ERROR, "%s: Can't alloc memory!", __func__);
         return ret;
     }
     task->job  = job;
     task->args = arg;
+    task->queued_us = timer_get_monotonic_us();
 
     pthread_mutex_lock(&pool->lock);
     if (lane_num >= pool->lanes_count)
@@ -100,6 +106,7 @@ int thread_pool_add_task(thread_pool_t *pool, job_func_t job, void* arg, size_t
         goto error_exit;
     }
     TAILQ_INSERT_TAIL(&pool->lanes[lane_num].queue, task, next);
+    pool->lanes[lane_num].queued++;
     sem_post(&pool->lanes[lane_num].queue_sem);
 
     goto exit;
@@ -163,7 +170,9 @@ static void *processor(void *arg) {
         return NULL;
     }
     logger(DEBUG, "My lane id is %lu", lane_id);
+    trace_set_thread_name("lane", lane_id);
     lane = &(pool->lanes[lane_id]);
+    affinity_bind_worker(lane->node);
 
     while (true) {
         sem_wait(&lane->queue_sem);
@@ -179,10 +188,12 @@ static void *processor(void *arg) {
             continue;
         }
         TAILQ_REMOVE(&lane->queue, task, next);
+        lane->queued--;
         pthread_cleanup_push((void (*) (void*))thread_pool_cleanup_task, &task);
         pthread_mutex_unlock(&pool->lock);
 
         logger(DEBUG, "Lane #%lu is starting job", lane_id);
+        metrics_record(METRICS_TASK_WAIT, timer_get_monotonic_us() - task->queued_us);
         task->job(task->args);
         pthread_cleanup_pop(1);
     }
@@ -202,7 +213,8 @@ static void thread_pool_create_worker(thread_pool_t *pool, pthread_t *thread_id)
     pthread_sigmask(SIG_UNBLOCK, &set, NULL);
 }
 
-static int manage_lanes_workers(thread_pool_t *pool, lanes_manage_action_t action, thread_pool_lane_conf_t *thread_pool_lanes)
+static int manage_lanes_workers(thread_pool_t *pool, lanes_manage_action_t action, thread_pool_lane_conf_t *thread_pool_lanes,
+                                size_t first_lane, size_t lanes_count)
 {
     int ret = -1;
     size_t i, k;
@@ -217,33 +229,41 @@ static int manage_lanes_workers(thread_pool_t *pool, lanes_manage_action_t actio
         goto exit;
     }
 
-    for (i = 0; i < pool->lanes_count; i++)
+    if (first_lane + lanes_count > pool->lanes_count)
+    {
+        logger(ERROR, "pool lanes are out of range (%lu+%lu:%lu)", first_lane, lanes_count, pool->lanes_count);
+        goto exit;
+    }
+
+    for (i = first_lane; i < first_lane + lanes_count; i++)
     {
         lane = &(pool->lanes[i]);
         if (action == LANES_FIRST_TIME_INIT)
         {
+            /* processors and queue are shared by all workers of lane */
             lane->size = thread_pool_lanes[i].size;
+            lane->node = thread_pool_lanes[i].node;
+            lane->processors = calloc(sizeof(*(lane->processors)), lane->size);
+            if (lane->processors == NULL)
+            {
+                logger(ERROR, "Can't alloc memory for processors!");
+                goto exit;
+            }
+
+            ret = sem_init(&lane->queue_sem, 0, 0);
+            if (ret)
+            {
+                logger(ERROR, "Failed on sem_init. ret = %d", ret);
+                goto exit;
+            }
+            logger(DEBUG, "INIT LANE QUEUE");
+            TAILQ_INIT(&lane->queue);
         }
         for (k = 0; k < lane->size; k++)
         {
             switch (action)
             {
             case LANES_FIRST_TIME_INIT:
-                lane->processors = calloc(sizeof(*(lane->processors)), lane->size);
-                if (lane->processors == NULL)
-                {
-                    logger(ERROR, "Can't alloc memory for processors!");
-                    goto exit;
-                }
-
-                ret = sem_init(&lane->queue_sem, 0, 0);
-                if (ret)
-                {
-                    logger(ERROR, "Failed on sem_init. ret = %d", ret);
-                    goto exit;
-                }
-                logger(DEBUG, "INIT LANE QUEUE");
-                TAILQ_INIT(&lane->queue);
                 thread_pool_create_worker(pool, &lane->processors[k]);
                 break;
             case LANES_CLEAN_ALL_TASKS:
@@ -253,20 +273,18 @@ static int manage_lanes_workers(thread_pool_t *pool, lanes_manage_action_t actio
                     TAILQ_REMOVE(&lane->queue, task, next);
                     thread_pool_cleanup_task(&task);
                 }
+                lane->queued = 0;
                 if (action == LANES_CLEAN_ALL_TASKS)
                 {
                     break;
                 }
                 pthread_cancel(lane->processors[k]);
+                /* pool lock is held by caller, worker could be waiting for it */
+                pthread_mutex_unlock(&pool->lock);
                 pthread_join(lane->processors[k], NULL);
+                pthread_mutex_lock(&pool->lock);
 
-                if (action == LANES_SHUTDOWN_ALL)
-                {
-                    sem_destroy(&lane->queue_sem);
-                    free(lane->processors);
-                    lane->processors = NULL;
-                }
-                else if (action == LANES_CLEAN_TASKS_AND_RESTART_WORKERS)
+                if (action == LANES_CLEAN_TASKS_AND_RESTART_WORKERS)
                 {
                     thread_pool_create_worker(pool, &lane->processors[k]);
                 }
@@ -276,6 +294,12 @@ static int manage_lanes_workers(thread_pool_t *pool, lanes_manage_action_t actio
                 break;
             }
         }
+        if (action == LANES_SHUTDOWN_ALL && lane->processors != NULL)
+        {
+            sem_destroy(&lane->queue_sem);
+            free(lane->processors);
+            lane->processors = NULL;
+        }
     }
     ret = 0;
 
@@ -286,7 +310,7 @@ static void thread_pool_shutdown_lanes(thread_pool_t *pool)
 {
     pthread_mutex_lock(&pool->lock);
     pool->work = false;
-    manage_lanes_workers(pool, LANES_SHUTDOWN_ALL, NULL);
+    manage_lanes_workers(pool, LANES_SHUTDOWN_ALL, NULL, 0, pool->lanes_count);
     pthread_mutex_unlock(&pool->lock);
 }
 
@@ -299,10 +323,49 @@ void thread_pool_remove_all_tasks(thread_pool_t *pool)
         return;
     }
     pthread_mutex_lock(&pool->lock);
-    manage_lanes_workers(pool, LANES_CLEAN_TASKS_AND_RESTART_WORKERS, NULL);
+    manage_lanes_workers(pool, LANES_CLEAN_TASKS_AND_RESTART_WORKERS, NULL, 0, pool->lanes_count);
     pthread_mutex_unlock(&pool->lock);
 }
 
+/* Same as thread_pool_remove_all_tasks(), but only for lanes in range */
+void thread_pool_remove_lanes_tasks(thread_pool_t *pool, size_t first_lane, size_t lanes_count)
+{
+    if (pool == NULL)
+    {
+        logger(ERROR, "pool pointer is NULL");
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    manage_lanes_workers(pool, LANES_CLEAN_TASKS_AND_RESTART_WORKERS, NULL, first_lane, lanes_count);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Drop tasks waiting in queues of lanes, tasks being processed are not interrupted */
+void thread_pool_remove_queued_tasks(thread_pool_t *pool, size_t first_lane, size_t lanes_count)
+{
+    if (pool == NULL)
+    {
+        logger(ERROR, "pool pointer is NULL");
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    manage_lanes_workers(pool, LANES_CLEAN_ALL_TASKS, NULL, first_lane, lanes_count);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+size_t thread_pool_get_queued_tasks(thread_pool_t *pool, size_t lane_num)
+{
+    size_t ret = 0;
+    if (pool == NULL || lane_num >= pool->lanes_count)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&pool->lock);
+    ret = pool->lanes[lane_num].queued;
+    pthread_mutex_unlock(&pool->lock);
+    return ret;
+}
+
 void thread_pool_destroy(thread_pool_t *pool)
 {
     if (pool == NULL)
@@ -5,19 +5,23 @@
 #include <stdatomic.h>
 #include <sys/queue.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef void * (*job_func_t)(void *);
 
 typedef struct queued_task_s {
     job_func_t job;
     void *args;
+    uint64_t queued_us; /* monotonic time of queueing */
     TAILQ_ENTRY(queued_task_s) next;
 } queued_task_t;
 
 typedef struct thread_pool_lane_s {
     size_t size;
+    int node;   /* NUMA node of workers, -1 - any */
     pthread_t *processors;
     sem_t queue_sem;
+    size_t queued; /* tasks in queue */
     TAILQ_HEAD(, queued_task_s) queue;
 } thread_pool_lane_t;
 
@@ -30,6 +34,7 @@ typedef struct thread_pool_s {
 
 typedef struct thread_pool_lane_conf_s {
     size_t size;
+    int node;   /* workers run on worker CPUs of this NUMA node, -1 - on all worker CPUs */
 } thread_pool_lane_conf_t;
 
 thread_pool_t *thread_pool_create(thread_pool_lane_conf_t *thread_pool_lanes, size_t lanes_count);
@@ -47,6 +52,10 @@ thread_pool_t *thread_pool_create(thread_pool_lane_conf_t *thread_pool_lanes, si
  */
 int thread_pool_add_task(thread_pool_t *pool, job_func_t job, void* arg, size_t lane_num);
 void thread_pool_remove_all_tasks(thread_pool_t *pool);
+void thread_pool_remove_lanes_tasks(thread_pool_t *pool, size_t first_lane, size_t lanes_count);
+void thread_pool_remove_queued_tasks(thread_pool_t *pool, size_t first_lane, size_t lanes_count);
+/* Count of tasks waiting in queue of lane */
+size_t thread_pool_get_queued_tasks(thread_pool_t *pool, size_t lane_num);
 void thread_pool_destroy(thread_pool_t *pool);
 
 #endif /* THREADPOOL_H_ */
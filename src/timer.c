@@ -7,12 +7,11 @@
 #include <string.h>
 
 #include "log.h"
+#include "timer.h"
 
 #define TIMER_SIGNAL SIGRTMIN
 
-timer_t timer_id = 0;
-
-int init_timer(void (*timer_expired_handler)(int, siginfo_t *, void *))
+int init_timer(timer_t *timer_id, void *ctx, void (*timer_expired_handler)(int, siginfo_t *, void *))
 {
     int ret = -1;
     struct sigevent sev;
@@ -34,9 +33,9 @@ int init_timer(void (*timer_expired_handler)(int, siginfo_t *, void *))
 
     sev.sigev_notify = SIGEV_SIGNAL;
     sev.sigev_signo = TIMER_SIGNAL;
-    sev.sigev_value.sival_ptr = &timer_id;
+    sev.sigev_value.sival_ptr = ctx;
 
-    ret = timer_create(CLOCK_REALTIME, &sev, &timer_id);
+    ret = timer_create(CLOCK_REALTIME, &sev, timer_id);
     if ( ret != 0)
     {
         logger(ERROR, "Error while timer create (%d:%s)", errno, strerror(errno));
@@ -46,17 +45,17 @@ exit:
     return ret;
 }
 
-void deinit_timer(void)
+void deinit_timer(timer_t *timer_id)
 {
-    if(timer_id == 0)
+    if(*timer_id == 0)
     {
         return;
     }
-    timer_delete(timer_id);
-    timer_id = 0;
+    timer_delete(*timer_id);
+    *timer_id = 0;
 }
 
-int timer_arm(time_t seconds)
+int timer_arm(timer_t timer_id, time_t seconds)
 {
     int ret = -1;
     struct itimerspec its = {0};
@@ -72,7 +71,21 @@ int timer_arm(time_t seconds)
     return ret;
 }
 
-int timer_disarm(void)
+int timer_disarm(timer_t timer_id)
+{
+    return timer_arm(timer_id, 0);
+}
+
+uint64_t timer_get_monotonic_ms(void)
+{
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+uint64_t timer_get_monotonic_us(void)
 {
-    return timer_arm(0);
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
 }
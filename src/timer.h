@@ -1,9 +1,24 @@
 #ifndef TIMER_H_
 #define TIMER_H_
 
-int init_timer(void (*timer_expired_handler)(int, siginfo_t *, void *));
-void deinit_timer(void);
-int timer_arm(time_t seconds);
-int timer_disarm(void);
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+
+/**
+ * Create timer
+ *
+ * Expired timer calls handler in signal context, si->si_value.sival_ptr is ctx.
+ *
+ * @param[out]  timer_id    created timer.
+ * @param[in]   ctx         pointer passed to handler.
+ * @returns     Zero if success
+ */
+int init_timer(timer_t *timer_id, void *ctx, void (*timer_expired_handler)(int, siginfo_t *, void *));
+void deinit_timer(timer_t *timer_id);
+int timer_arm(timer_t timer_id, time_t seconds);
+int timer_disarm(timer_t timer_id);
+uint64_t timer_get_monotonic_ms(void);
+uint64_t timer_get_monotonic_us(void);
 
 #endif // TIMER_H_
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+
+#include "log.h"
+#include "timer.h"
+#include "trace.h"
+
+#define TRACE_BUFFER_EVENTS 16384 /* per thread, the oldest events are overwritten */
+#define TRACE_THREAD_NAME_SIZE 32
+
+typedef struct trace_event_s {
+    const char *name;
+    const char *arg_name;
+    uint64_t    session;
+    uint64_t    ts_us;
+    uint64_t    dur_us;
+    int64_t     arg;
+} trace_event_t;
+
+/*
+ * Events of one thread
+ *
+ * Lock is taken by owner thread for every event and by dumping thread, so it
+ * is not contended in practice. Buffer of finished thread is reused by new one.
+ */
+typedef struct trace_buffer_s {
+    struct trace_buffer_s *next;
+    pthread_mutex_t lock;
+    atomic_bool     owned;
+    size_t          tid;
+    char            name[TRACE_THREAD_NAME_SIZE];
+    size_t          written; /* events ever written, position is written % TRACE_BUFFER_EVENTS */
+    trace_event_t   events[TRACE_BUFFER_EVENTS];
+} trace_buffer_t;
+
+bool trace_enabled = false;
+static char *trace_dir = NULL;
+
+static trace_buffer_t *buffers = NULL; /* list only grows, buffer->next is never changed */
+static size_t buffers_count = 0;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t buffer_key;
+
+static atomic_uint_fast64_t next_session = 1;
+static volatile sig_atomic_t dump_requested = 0;
+static size_t dumps_count = 0;
+
+static void buffer_release(void *arg)
+{
+    trace_buffer_t *buffer = arg;
+    atomic_store(&buffer->owned, false);
+}
+
+int trace_init(const char *dir)
+{
+    if (pthread_key_create(&buffer_key, buffer_release) != 0)
+    {
+        logger(ERROR, "Can not create key for trace buffers");
+        return -1;
+    }
+    trace_dir = strdup(dir);
+    if (trace_dir == NULL)
+    {
+        logger(ERROR, "Can't alloc memory for trace");
+        return -1;
+    }
+    trace_enabled = true;
+    logger(INFO, "Tracing is enabled, traces are written to %s", trace_dir);
+    return 0;
+}
+
+void trace_deinit(void)
+{
+    trace_buffer_t *buffer;
+
+    if (!trace_enabled)
+    {
+        return;
+    }
+    trace_enabled = false;
+    pthread_mutex_lock(&buffers_lock);
+    buffer = buffers;
+    while (buffer != NULL)
+    {
+        trace_buffer_t *next = buffer->next;
+        pthread_mutex_destroy(&buffer->lock);
+        free(buffer);
+        buffer = next;
+    }
+    buffers = NULL;
+    pthread_mutex_unlock(&buffers_lock);
+    free(trace_dir);
+    trace_dir = NULL;
+}
+
+static trace_buffer_t *get_thread_buffer(void)
+{
+    trace_buffer_t *buffer = pthread_getspecific(buffer_key);
+    if (buffer != NULL)
+    {
+        return buffer;
+    }
+
+    pthread_mutex_lock(&buffers_lock);
+    for (buffer = buffers; buffer != NULL; buffer = buffer->next)
+    {
+        bool owned = false;
+        if (atomic_compare_exchange_strong(&buffer->owned, &owned, true))
+        {
+            goto exit;
+        }
+    }
+
+    buffer = calloc(1, sizeof(*buffer));
+    if (buffer == NULL)
+    {
+        goto exit;
+    }
+    pthread_mutex_init(&buffer->lock, NULL);
+    atomic_init(&buffer->owned, true);
+    buffer->tid = ++buffers_count;
+    snprintf(buffer->name, sizeof(buffer->name), "thread %lu", buffer->tid);
+    buffer->next = buffers;
+    buffers = buffer;
+
+exit:
+    pthread_mutex_unlock(&buffers_lock);
+    if (buffer != NULL)
+    {
+        pthread_setspecific(buffer_key, buffer);
+    }
+    return buffer;
+}
+
+void trace_set_thread_name(const char *name, size_t index)
+{
+    trace_buffer_t *buffer;
+    if (!trace_enabled || (buffer = get_thread_buffer()) == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&buffer->lock);
+    snprintf(buffer->name, sizeof(buffer->name), "%s %lu", name, index);
+    pthread_mutex_unlock(&buffer->lock);
+}
+
+uint64_t trace_new_session(void)
+{
+    return atomic_fetch_add(&next_session, 1);
+}
+
+uint64_t trace_start(void)
+{
+    return trace_enabled ? timer_get_monotonic_us() : 0;
+}
+
+void trace_span(uint64_t session, const char *name, uint64_t start, const char *arg_name, int64_t arg)
+{
+    trace_buffer_t *buffer;
+    trace_event_t *event;
+
+    if (!trace_enabled || start == 0 || (buffer = get_thread_buffer()) == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&buffer->lock);
+    event = &buffer->events[buffer->written % TRACE_BUFFER_EVENTS];
+    event->name     = name;
+    event->arg_name = arg_name;
+    event->session  = session;
+    event->ts_us    = start;
+    event->dur_us   = timer_get_monotonic_us() - start;
+    event->arg      = arg;
+    buffer->written++;
+    pthread_mutex_unlock(&buffer->lock);
+}
+
+/* Write events of session, 0 - all events */
+static void dump(const char *path, uint64_t session)
+{
+    trace_buffer_t *buffer;
+    bool first = true;
+    pid_t pid = getpid();
+    FILE *out = fopen(path, "w");
+
+    if (out == NULL)
+    {
+        logger(ERROR, "Can not open trace file %s", path);
+        return;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    pthread_mutex_lock(&buffers_lock);
+    for (buffer = buffers; buffer != NULL; buffer = buffer->next)
+    {
+        size_t i;
+        size_t written;
+        size_t count = 0;
+
+        pthread_mutex_lock(&buffer->lock);
+        written = buffer->written;
+        i = (written > TRACE_BUFFER_EVENTS) ? written - TRACE_BUFFER_EVENTS : 0;
+        for (; i < written; i++)
+        {
+            trace_event_t *event = &buffer->events[i % TRACE_BUFFER_EVENTS];
+            if (session != 0 && event->session != session)
+            {
+                continue;
+            }
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"session %lu\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,"
+                    "\"pid\":%d,\"tid\":%lu,\"args\":{\"session\":%lu",
+                    first ? "" : ",\n", event->name, event->session, event->ts_us, event->dur_us,
+                    pid, buffer->tid, event->session);
+            if (event->arg_name != NULL)
+            {
+                fprintf(out, ",\"%s\":%ld", event->arg_name, event->arg);
+            }
+            fprintf(out, "}}");
+            first = false;
+            count++;
+        }
+        if (count != 0)
+        {
+            fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+                    pid, buffer->tid, buffer->name);
+        }
+        pthread_mutex_unlock(&buffer->lock);
+    }
+    pthread_mutex_unlock(&buffers_lock);
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    logger(DEBUG, "Trace was written to %s", path);
+}
+
+void trace_dump_session(uint64_t session)
+{
+    char path[PATH_MAX];
+    if (!trace_enabled)
+    {
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/session-%lu.json", trace_dir, session);
+    dump(path, session);
+}
+
+void trace_request_dump(void)
+{
+    dump_requested = 1;
+}
+
+void trace_poll(void)
+{
+    char path[PATH_MAX];
+    if (!trace_enabled || !dump_requested)
+    {
+        return;
+    }
+    dump_requested = 0;
+    snprintf(path, sizeof(path), "%s/trace-%d-%lu.json", trace_dir, getpid(), dumps_count++);
+    dump(path, 0);
+    logger(INFO, "Trace of all sessions was written to %s", path);
+}
@@ -0,0 +1,52 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Set by trace_init(), all functions return immediately when it is false */
+extern bool trace_enabled;
+
+/**
+ * Enable tracing
+ *
+ * Spans are kept in per-thread ring buffers and written in Chrome trace-event
+ * format to dir: per session by trace_dump_session() and for all threads after
+ * trace_request_dump().
+ *
+ * @param[in]   dir     directory for trace files.
+ * @returns     Zero if success
+ */
+int trace_init(const char *dir);
+void trace_deinit(void);
+
+/* Name of the calling thread in trace viewer, e.g. "lane 3" */
+void trace_set_thread_name(const char *name, size_t index);
+
+/* New id for spans of one session */
+uint64_t trace_new_session(void);
+
+/* Start time of span, 0 if tracing is disabled */
+uint64_t trace_start(void);
+
+/**
+ * Record span from start till now
+ *
+ * @param[in]   session     id of session from trace_new_session().
+ * @param[in]   name        static string, it is not copied.
+ * @param[in]   start       value of trace_start().
+ * @param[in]   arg_name    static string for argument, NULL - no argument.
+ * @param[in]   arg         argument value.
+ */
+void trace_span(uint64_t session, const char *name, uint64_t start, const char *arg_name, int64_t arg);
+
+/* Write spans of session to <dir>/session-<id>.json */
+void trace_dump_session(uint64_t session);
+
+/* Could be called from signal handler, dump is done by trace_poll() */
+void trace_request_dump(void);
+/* Write spans of all sessions to <dir>/trace-<pid>-<n>.json if dump was requested */
+void trace_poll(void);
+
+#endif /* TRACE_H_ */
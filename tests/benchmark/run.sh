@@ -0,0 +1,65 @@
+#!/bin/bash
+# Run all benchmarks and compare results with baseline
+# Usage: run.sh <baseline.json> <threshold> <benchmarks dir> <computation-server> <functional test library> <dash_cam>
+#               <reference indicators library>
+#
+# Results are written to results.json in benchmarks dir, one JSON object per line.
+# Benchmark fails if its value is lower than baseline value * (1 - threshold).
+#
+# Baseline numbers depend on hardware, regenerate them on the target machine from an idle
+# run and keep some margin for noise:
+#   cmake -DENABLE_BENCHMARKS=ON .. && make && ctest -L benchmark
+#   cp tests/benchmark/results.json <source>/tests/benchmark/baseline.json
+# or keep own file out of the tree and pass it by -DBENCH_BASELINE=<file>.
+
+BASELINE=$1
+THRESHOLD=$2
+RESULTS=$3/results.json
+
+: > $RESULTS
+for bench in $3/bench_threadpool $3/bench_receive $3/bench_header $3/bench_ctx $3/bench_kernels; do
+    if ! $bench >> $RESULTS; then
+        echo "$bench failed"
+        exit 1
+    fi
+done
+if ! bash $(dirname $0)/sessions.sh $4 $5 $6 >> $RESULTS; then
+    echo "sessions benchmark failed"
+    exit 1
+fi
+# the same load with indicators which really process data
+if ! bash $(dirname $0)/sessions.sh $4 $7 $6 sessions_reference >> $RESULTS; then
+    echo "sessions benchmark with reference indicators failed"
+    exit 1
+fi
+
+cat $RESULTS
+
+# both files have the same format: {"name":"...","unit":"...","value":...}
+awk -F'"' -v threshold=$THRESHOLD '
+    {
+        value = $0
+        sub(/.*"value":/, "", value)
+        sub(/}.*/, "", value)
+    }
+    FNR == NR { baseline[$4] = value; next }
+    {
+        seen[$4] = 1
+        if (!($4 in baseline)) {
+            printf "%s: %s %s, no baseline\n", $4, value, $8
+            next
+        }
+        limit = baseline[$4] * (1 - threshold)
+        status = (value + 0 < limit) ? "REGRESSION" : "ok"
+        printf "%s: %s %s, baseline %s, limit %.1f %s\n", $4, value, $8, baseline[$4], limit, status
+        if (status != "ok") failed = 1
+    }
+    END {
+        for (name in baseline) {
+            if (!(name in seen)) {
+                printf "%s: no result\n", name
+                failed = 1
+            }
+        }
+        exit failed
+    }' $BASELINE $RESULTS
@@ -0,0 +1,23 @@
+#!/bin/bash
+# End-to-end benchmark: sessions per second processed by server with indicators library
+# Usage: sessions.sh <computation-server> <indicators library> <dash_cam> [name of result]
+
+PORT=5100
+SESSIONS=400
+NAME=${4:-sessions}
+
+LD_PRELOAD=$2 $1 -q -p $PORT --max-sessions 4 &
+cs_pid=$!
+
+sleep 1
+STATS=$($3 --load -p $PORT -n 4 -N $SESSIONS -s 100000 -S 1000000 -f 1000 2>&1 >/dev/null)
+load_status=$?
+kill $cs_pid
+wait $cs_pid
+
+if [ $load_status != 0 ]; then
+    echo "$STATS" >&2
+    exit 1
+fi
+
+echo "$STATS" | awk -v name=$NAME '/^sessions:/ { printf "{\"name\":\"%s\",\"unit\":\"sessions/s\",\"value\":%.1f}\n", name, $2 / $6 }'
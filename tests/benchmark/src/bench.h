@@ -0,0 +1,24 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "timer.h"
+
+/*
+ * Every benchmark prints one JSON object per line, bigger value is better.
+ * run.sh compares them with baseline.json.
+ */
+static inline void bench_report(const char *name, const char *unit, double value)
+{
+    printf("{\"name\":\"%s\",\"unit\":\"%s\",\"value\":%.1f}\n", name, unit, value);
+    fflush(stdout);
+}
+
+static inline double bench_seconds_since(uint64_t start_us)
+{
+    return (double)(timer_get_monotonic_us() - start_us) / 1000000.0;
+}
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "log.h"
+#include "indicators_lib.h"
+
+#define UPDATES_COUNT 20000000 /* by every thread */
+
+typedef struct worker_s {
+    pthread_t          thread;
+    indicator_func_t   indicator;
+    indicator_ctx_t   *ctx;
+    pthread_barrier_t *start;
+} worker_t;
+
+static const uint8_t data[1];
+
+static void *worker_handler(void *arg)
+{
+    size_t i;
+    worker_t *worker = arg;
+    indicator_arg_t indicator_arg = {
+        .ctx  = worker->ctx,
+        .data = data,
+        .size = sizeof(data),
+    };
+
+    pthread_barrier_wait(worker->start);
+    for (i = 0; i < UPDATES_COUNT; i++)
+    {
+        worker->indicator(&indicator_arg);
+    }
+    return NULL;
+}
+
+/*
+ * Every indicator of functional test library updates its context in own thread,
+ * contexts are allocated by library in a row or by the server.
+ */
+static int run(const indicators_lib_t *lib, bool aligned, const char *name)
+{
+    int ret = -1;
+    size_t i, started = 0;
+    uint64_t start_us;
+    pthread_barrier_t start;
+    worker_t *workers = calloc(sizeof(*workers), lib->count);
+
+    if (workers == NULL || pthread_barrier_init(&start, NULL, (unsigned)lib->count + 1) != 0)
+    {
+        free(workers);
+        return -1;
+    }
+    for (i = 0; i < lib->count; i++)
+    {
+        workers[i].indicator = lib->handlers[i].indicator;
+        workers[i].start     = &start;
+        workers[i].ctx       = aligned ? indicators_lib_ctx_alloc(lib, i) : lib->handlers[i].ctx_allocator();
+        if (workers[i].ctx == NULL)
+        {
+            goto exit;
+        }
+        lib->handlers[i].ctx_initializer(workers[i].ctx);
+    }
+    for (i = 0; i < lib->count; i++)
+    {
+        if (pthread_create(&workers[i].thread, NULL, worker_handler, &workers[i]) != 0)
+        {
+            /* started threads are waiting on barrier, so they can not be released */
+            exit(EXIT_FAILURE);
+        }
+        started++;
+    }
+
+    start_us = timer_get_monotonic_us();
+    pthread_barrier_wait(&start);
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+    bench_report(name, "updates/s", (double)(UPDATES_COUNT * lib->count) / bench_seconds_since(start_us));
+
+    ret = 0;
+    for (i = 0; i < lib->count; i++)
+    {
+        if (lib->handlers[i].extract(workers[i].ctx) != UPDATES_COUNT * sizeof(data))
+        {
+            ret = -1;
+        }
+    }
+
+exit:
+    for (i = 0; i < lib->count; i++)
+    {
+        if (workers[i].ctx == NULL)
+        {
+            continue;
+        }
+        if (aligned)
+        {
+            indicators_lib_ctx_free(lib, i, workers[i].ctx);
+        }
+        else
+        {
+            lib->handlers[i].ctx_free(workers[i].ctx);
+        }
+    }
+    pthread_barrier_destroy(&start);
+    free(workers);
+    return ret;
+}
+
+/* Context updates per second with false sharing and without it */
+int main(void)
+{
+    int ret = 1;
+    indicators_lib_t *lib;
+
+    set_quiet(true);
+    /* library is linked to benchmark */
+    if (get_indicators_count() == 0 || indicators_lib_init(NULL, false) != 0)
+    {
+        return 1;
+    }
+    lib = indicators_lib_acquire();
+    if (lib->layouts != NULL && run(lib, false, "ctx_packed") == 0 && run(lib, true, "ctx_aligned") == 0)
+    {
+        ret = 0;
+    }
+    indicators_lib_release(lib);
+    indicators_lib_deinit();
+    return ret;
+}
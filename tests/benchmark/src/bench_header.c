@@ -0,0 +1,38 @@
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "bench.h"
+#include "log.h"
+#include "protocol.h"
+
+#define HEADERS_COUNT 20000000
+#define MAX_FILE_SIZE ((size_t) (1000 * 1000 * 80))
+
+/* Headers per second validated by protocol functions */
+int main(void)
+{
+    size_t i;
+    size_t total = 0;
+    uint64_t start_us;
+    volatile messageHeader_t header;
+
+    set_quiet(true);
+    memset((void *)&header, 0x00, sizeof(header));
+    header.magic      = htonl(HEADER_MAGIC);
+    header.version    = htonl(HEADER_VERSION);
+    header.frame_size = htonl(1000);
+
+    start_us = timer_get_monotonic_us();
+    for (i = 0; i < HEADERS_COUNT; i++)
+    {
+        /* header is volatile, so every iteration parses it again */
+        header.size = htonl((uint32_t)(1000 * (1 + i % 1000)));
+        if (protocol_check_header((const messageHeader_t *)&header) == 0)
+        {
+            total += protocol_get_file_size((const messageHeader_t *)&header, MAX_FILE_SIZE) /
+                     protocol_get_frame_size((const messageHeader_t *)&header);
+        }
+    }
+    bench_report("header_parsing", "headers/s", HEADERS_COUNT / bench_seconds_since(start_us));
+    return (total != 0) ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "kernels.h"
+
+#define BUFFER_SIZE ((size_t) (256 * 1024)) /* frames of footage fit to L2 cache */
+#define MIN_SECONDS 0.05
+
+typedef enum kernel_e {
+    KERNEL_HISTOGRAM = 0,
+    KERNEL_SUM,
+    KERNEL_MIN_MAX,
+    KERNEL_ABS_DIFF,
+    KERNEL_ABS_DIFF_SUM,
+    KERNEL_POPCOUNT,
+    KERNEL_COUNT_ABOVE,
+    KERNELS_COUNT
+} kernel_t;
+
+static const char *kernel_names[KERNELS_COUNT] = {
+    "histogram", "sum", "min_max", "abs_diff", "abs_diff_sum", "popcount", "count_above"
+};
+
+static uint8_t *a, *b, *out;
+static volatile uint64_t sink;
+
+static void run_kernel(kernel_t kernel)
+{
+    uint64_t hist[256];
+    uint8_t min, max;
+
+    switch (kernel)
+    {
+    case KERNEL_HISTOGRAM:
+        memset(hist, 0x00, sizeof(hist));
+        kernels_histogram(a, BUFFER_SIZE, hist);
+        sink = hist[0];
+        break;
+    case KERNEL_SUM:
+        sink = kernels_sum(a, BUFFER_SIZE);
+        break;
+    case KERNEL_MIN_MAX:
+        kernels_min_max(a, BUFFER_SIZE, &min, &max);
+        sink = (uint64_t)min + max;
+        break;
+    case KERNEL_ABS_DIFF:
+        kernels_abs_diff(a, b, out, BUFFER_SIZE);
+        sink = out[0];
+        break;
+    case KERNEL_ABS_DIFF_SUM:
+        sink = kernels_abs_diff_sum(a, b, BUFFER_SIZE);
+        break;
+    case KERNEL_POPCOUNT:
+        sink = kernels_popcount(a, BUFFER_SIZE);
+        break;
+    default:
+        sink = kernels_count_above(a, BUFFER_SIZE, 127);
+        break;
+    }
+}
+
+/* MB per second of the first buffer processed by kernel */
+static double measure(kernel_t kernel)
+{
+    size_t calls = 0;
+    double seconds;
+    uint64_t start_us;
+
+    run_kernel(kernel); /* warm up */
+    start_us = timer_get_monotonic_us();
+    do
+    {
+        run_kernel(kernel);
+        calls++;
+    } while ((seconds = bench_seconds_since(start_us)) < MIN_SECONDS);
+    return (double)(calls * BUFFER_SIZE) / seconds / 1000000.0;
+}
+
+/* MB/s of every kernel by every implementation supported by CPU, kernel_<name> is the selected one */
+int main(void)
+{
+    int isa;
+    size_t i;
+    char name[64];
+    kernels_isa_t best = kernels_get_isa();
+
+    a   = malloc(BUFFER_SIZE);
+    b   = malloc(BUFFER_SIZE);
+    out = malloc(BUFFER_SIZE);
+    if (a == NULL || b == NULL || out == NULL)
+    {
+        return 1;
+    }
+    srand(1);
+    for (i = 0; i < BUFFER_SIZE; i++)
+    {
+        a[i] = (uint8_t)rand();
+        b[i] = (uint8_t)rand();
+    }
+
+    for (i = 0; i < KERNELS_COUNT; i++)
+    {
+        snprintf(name, sizeof(name), "kernel_%s", kernel_names[i]);
+        kernels_set_isa(best);
+        bench_report(name, "MB/s", measure((kernel_t)i));
+        for (isa = KERNELS_ISA_SCALAR; isa < KERNELS_ISA_COUNT; isa++)
+        {
+            if (kernels_set_isa((kernels_isa_t)isa) == 0)
+            {
+                snprintf(name, sizeof(name), "kernel_%s_%s", kernel_names[i], kernels_isa_name((kernels_isa_t)isa));
+                bench_report(name, "MB/s", measure((kernel_t)i));
+            }
+        }
+    }
+    kernels_set_isa(best);
+    free(a);
+    free(b);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "bench.h"
+#include "log.h"
+#include "server_utils.h"
+
+#define RECEIVE_SIZE ((size_t) (1024 * 1024 * 1024)) /* 1GB */
+#define SEND_CHUNK_SIZE ((size_t) (64 * 1024))
+#define BUFFER_SIZE ((size_t) (80 * 1000 * 1000))
+
+static uint16_t port = 0;
+
+static void *sender(__attribute__((unused)) void *arg)
+{
+    size_t sent = 0;
+    struct sockaddr_in addr;
+    uint8_t *chunk = calloc(1, SEND_CHUNK_SIZE);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0x00, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (chunk == NULL || fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        exit(1);
+    }
+    while (sent < RECEIVE_SIZE)
+    {
+        if (write_wrapper(fd, chunk, SEND_CHUNK_SIZE) != 0)
+        {
+            break;
+        }
+        sent += SEND_CHUNK_SIZE;
+    }
+    close(fd);
+    free(chunk);
+    return NULL;
+}
+
+/* Bytes per second received by read_wrapper() from TCP loopback, like session receiving file */
+int main(void)
+{
+    int server_fd, fd;
+    size_t received = 0;
+    uint64_t start_us;
+    pthread_t thread;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    uint8_t *buffer = malloc(BUFFER_SIZE);
+
+    set_quiet(true);
+    server_fd = init_server("127.0.0.1", 0, 1);
+    if (buffer == NULL || server_fd < 0 || getsockname(server_fd, (struct sockaddr *)&addr, &addr_len) != 0)
+    {
+        return 1;
+    }
+    port = ntohs(addr.sin_port);
+    if (pthread_create(&thread, NULL, sender, NULL) != 0 || waiting_connection(server_fd) < 0)
+    {
+        return 1;
+    }
+    fd = accept_connection(server_fd);
+    if (fd < 0)
+    {
+        return 1;
+    }
+
+    start_us = timer_get_monotonic_us();
+    while (received < RECEIVE_SIZE)
+    {
+        size_t offset = received % BUFFER_SIZE;
+        size_t size = read_wrapper(fd, buffer + offset, BUFFER_SIZE - offset, false);
+        if (size == 0)
+        {
+            break;
+        }
+        received += size;
+    }
+    bench_report("receive_loopback", "MB/s", (double)received / bench_seconds_since(start_us) / 1000000.0);
+
+    pthread_join(thread, NULL);
+    close(fd);
+    close(server_fd);
+    free(buffer);
+    return (received == RECEIVE_SIZE) ? 0 : 1;
+}
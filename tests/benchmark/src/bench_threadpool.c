@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#include "bench.h"
+#include "log.h"
+#include "threadpool.h"
+
+#define LANES_COUNT 4
+#define TASKS_COUNT 400000
+
+static atomic_size_t done = 0;
+static sem_t finished;
+
+static void *task_handler(__attribute__((unused)) void *arg)
+{
+    if (atomic_fetch_add(&done, 1) + 1 == TASKS_COUNT)
+    {
+        sem_post(&finished);
+    }
+    return NULL;
+}
+
+/* Tasks per second queued by one thread and processed by LANES_COUNT workers */
+int main(void)
+{
+    size_t i;
+    uint64_t start_us;
+    thread_pool_t *tp;
+    thread_pool_lane_conf_t lanes[LANES_COUNT];
+
+    set_quiet(true);
+    for (i = 0; i < LANES_COUNT; i++)
+    {
+        lanes[i].size = 1;
+        lanes[i].node = -1;
+    }
+    tp = thread_pool_create(lanes, LANES_COUNT);
+    if (tp == NULL || sem_init(&finished, 0, 0) != 0)
+    {
+        return 1;
+    }
+
+    start_us = timer_get_monotonic_us();
+    for (i = 0; i < TASKS_COUNT; i++)
+    {
+        /* pool frees argument after task */
+        thread_pool_add_task(tp, task_handler, malloc(sizeof(size_t)), i % LANES_COUNT);
+    }
+    sem_wait(&finished);
+    bench_report("threadpool_dispatch", "tasks/s", TASKS_COUNT / bench_seconds_since(start_us));
+
+    thread_pool_destroy(tp);
+    sem_destroy(&finished);
+    return 0;
+}
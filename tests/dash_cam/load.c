@@ -0,0 +1,613 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "load.h"
+#include "crc32.h"
+
+#define SEND_CHUNK_SIZE ((size_t) (64 * 1024)) /* rate limit is applied after every chunk */
+#define FETCH_MIN_INTERVAL_MS 100 /* pending job is fetched again not earlier than this */
+
+typedef enum session_result_e {
+    SESSION_OK = 0,
+    SESSION_PARTIAL,
+    SESSION_BUSY,
+    SESSION_TOO_LARGE,
+    SESSION_TIMEOUT,
+    SESSION_FAILED,
+    SESSION_RESULTS_COUNT,
+    SESSION_PENDING /* async job is not computed yet, it is fetched again */
+} session_result_t;
+
+static const char *results_names[SESSION_RESULTS_COUNT] = {
+    "ok", "partial", "busy", "too large", "timeout", "failed"
+};
+
+typedef struct load_state_s {
+    const load_options_t *options;
+    atomic_size_t        next_session;
+    atomic_size_t        results[SESSION_RESULTS_COUNT];
+    atomic_uint_fast64_t sent_bytes;
+    atomic_uint_fast64_t processed_bytes; /* file bytes of sessions with results */
+    double              *latencies_ms;    /* of sessions with results, by session number */
+
+    pthread_mutex_t      last_lock;
+    uint64_t            *last_values;     /* values of the last successful response */
+    size_t               last_count;
+} load_state_t;
+
+typedef struct connection_s {
+    load_state_t *state;
+    size_t        id;
+    pthread_t     thread;
+    uint64_t      random;  /* state of xorshift generator */
+    message_t    *message; /* buffer for the biggest file */
+    uint16_t      retry_after; /* of the last pending status */
+} connection_t;
+
+static uint64_t get_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static uint64_t xorshift64(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+void fill_header(messageHeader_t *header, uint32_t size, uint32_t frame_size, uint8_t flags)
+{
+    memset(header, 0x00, sizeof(*header));
+
+    header->magic      = htonl(HEADER_MAGIC);
+    header->size       = htonl(size);
+    header->frame_size = htonl(frame_size);
+    header->version    = htonl(HEADER_VERSION);
+    header->flags      = flags;
+}
+
+void fill_payload(uint8_t *payload, size_t size, uint64_t seed)
+{
+    size_t i;
+    uint64_t state = seed | 1; /* xorshift must not start from zero */
+    for (i = 0; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t value = xorshift64(&state);
+        memcpy(payload + i, &value, sizeof(value));
+    }
+    for (; i < size; i++)
+    {
+        payload[i] = (uint8_t)xorshift64(&state);
+    }
+}
+
+static uint32_t get_uniform(connection_t *connection, uint32_t min, uint32_t max)
+{
+    if (max <= min)
+    {
+        return min;
+    }
+    return min + (uint32_t)(xorshift64(&connection->random) % ((uint64_t)max - min + 1));
+}
+
+static int connect_to_server(const load_options_t *options)
+{
+    struct sockaddr_in addr;
+    struct timeval timeout = {.tv_sec = options->timeout, .tv_usec = 0};
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+    memset(&addr, 0x00, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(options->port);
+    if (inet_pton(AF_INET, options->ip, &addr.sin_addr) != 1 ||
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Send data with link speed of rate bytes per second since start_us */
+static int send_limited(const int fd, const uint8_t *data, const size_t size, const uint64_t rate, const uint64_t start_us,
+                        atomic_uint_fast64_t *sent_bytes)
+{
+    size_t sent = 0;
+    while (sent < size)
+    {
+        size_t chunk = (size - sent < SEND_CHUNK_SIZE) ? size - sent : SEND_CHUNK_SIZE;
+        ssize_t ret = send(fd, data + sent, chunk, MSG_NOSIGNAL);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? SESSION_TIMEOUT : SESSION_FAILED;
+        }
+        sent += (size_t)ret;
+        atomic_fetch_add(sent_bytes, (uint64_t)ret);
+
+        if (rate != 0)
+        {
+            uint64_t target_us = start_us + (uint64_t)sent * 1000000 / rate;
+            uint64_t now_us = get_time_us();
+            if (target_us > now_us)
+            {
+                usleep((useconds_t)(target_us - now_us));
+            }
+        }
+    }
+    return SESSION_OK;
+}
+
+static int recv_full(const int fd, void *ptr, const size_t size)
+{
+    size_t received = 0;
+    while (received < size)
+    {
+        ssize_t ret = recv(fd, (uint8_t *)ptr + received, size - received, 0);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret < 0)
+        {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? SESSION_TIMEOUT : SESSION_FAILED;
+        }
+        if (ret == 0)
+        {
+            return SESSION_FAILED;
+        }
+        received += (size_t)ret;
+    }
+    return SESSION_OK;
+}
+
+/* Read messages till results, interim results are skipped */
+static session_result_t receive_results(connection_t *connection, const int fd, const uint32_t file_size)
+{
+    load_state_t *state = connection->state;
+    const load_options_t *options = state->options;
+    messageHeader_t header;
+    uint64_t *payload = NULL;
+    uint32_t size, frame_size, value_size, count, i;
+    session_result_t ret;
+
+    while (true)
+    {
+        ret = (session_result_t)recv_full(fd, &header, sizeof(header));
+        if (ret != SESSION_OK)
+        {
+            return ret;
+        }
+        if (ntohl(header.magic) != HEADER_MAGIC || ntohl(header.version) != HEADER_VERSION)
+        {
+            fprintf(stderr, "[connection %lu] wrong magic or version of response\n", connection->id);
+            return SESSION_FAILED;
+        }
+        if (header.status == MESSAGE_STATUS_BUSY)
+        {
+            return SESSION_BUSY;
+        }
+        if (header.status == MESSAGE_STATUS_TOO_LARGE)
+        {
+            return SESSION_TOO_LARGE;
+        }
+        if (header.status == MESSAGE_STATUS_PENDING)
+        {
+            connection->retry_after = ntohs(header.retry_after);
+            return SESSION_PENDING;
+        }
+        if (header.status == MESSAGE_STATUS_NOT_FOUND)
+        {
+            fprintf(stderr, "[connection %lu] job %" PRIu64 " is not found\n", connection->id, be64toh(header.job_id));
+            return SESSION_FAILED;
+        }
+
+        size       = ntohl(header.size);
+        frame_size = ntohl(header.frame_size);
+        value_size = (header.status == MESSAGE_STATUS_PARTIAL) ? 2 * sizeof(uint64_t) : sizeof(uint64_t);
+        if (frame_size != value_size || size == 0 || size % frame_size != 0)
+        {
+            fprintf(stderr, "[connection %lu] wrong size of response (%u:%u)\n", connection->id, size, frame_size);
+            return SESSION_FAILED;
+        }
+        payload = malloc(size);
+        if (payload == NULL)
+        {
+            return SESSION_FAILED;
+        }
+        ret = (session_result_t)recv_full(fd, payload, size);
+        if (ret != SESSION_OK || header.type != MESSAGE_TYPE_INTERIM)
+        {
+            break;
+        }
+        free(payload);
+        payload = NULL;
+    }
+    if (ret != SESSION_OK)
+    {
+        goto exit;
+    }
+    if (header.type != MESSAGE_TYPE_RESULT)
+    {
+        fprintf(stderr, "[connection %lu] unknown type of response %u\n", connection->id, header.type);
+        ret = SESSION_FAILED;
+        goto exit;
+    }
+
+    count = size / frame_size;
+    if (header.status == MESSAGE_STATUS_PARTIAL)
+    {
+        ret = SESSION_PARTIAL;
+        goto exit;
+    }
+    for (i = 0; i < count; i++)
+    {
+        payload[i] = be64toh(payload[i]);
+        /* sampled results are not comparable with expected value */
+        if (options->check_value && header.sampling <= 1 && payload[i] != options->expected_value)
+        {
+            fprintf(stderr, "[connection %lu] indicator %u value %" PRIu64 " is not expected %" PRIu64
+                    " (file size %u)\n", connection->id, i, payload[i], options->expected_value, file_size);
+            ret = SESSION_FAILED;
+            goto exit;
+        }
+    }
+
+    pthread_mutex_lock(&state->last_lock);
+    free(state->last_values);
+    state->last_values = payload;
+    state->last_count  = count;
+    payload = NULL;
+    pthread_mutex_unlock(&state->last_lock);
+
+exit:
+    free(payload);
+    return ret;
+}
+
+/* Send reads of recording with recorded delays divided by speed */
+static session_result_t send_recording(const int fd, const replay_recording_t *recording, const double speed,
+                                       const uint64_t start_us, atomic_uint_fast64_t *sent_bytes)
+{
+    size_t offset = 0;
+    size_t size;
+    uint32_t delay_us = 0;
+    uint64_t recorded_us = 0;
+    const uint8_t *data;
+    session_result_t ret = SESSION_OK;
+
+    while (ret == SESSION_OK && (size = replay_next_chunk(recording, &offset, &delay_us, &data)) != 0)
+    {
+        recorded_us += delay_us;
+        if (speed > 0)
+        {
+            uint64_t target_us = start_us + (uint64_t)((double)recorded_us / speed);
+            uint64_t now_us = get_time_us();
+            if (target_us > now_us)
+            {
+                usleep((useconds_t)(target_us - now_us));
+            }
+        }
+        ret = (session_result_t)send_limited(fd, data, size, 0, start_us, sent_bytes);
+    }
+    return ret;
+}
+
+/* Read acknowledge of async session */
+static session_result_t receive_ack(connection_t *connection, const int fd, uint64_t *job_id)
+{
+    messageHeader_t header;
+    session_result_t ret = (session_result_t)recv_full(fd, &header, sizeof(header));
+
+    if (ret != SESSION_OK)
+    {
+        return ret;
+    }
+    if (ntohl(header.magic) != HEADER_MAGIC || ntohl(header.version) != HEADER_VERSION)
+    {
+        fprintf(stderr, "[connection %lu] wrong magic or version of acknowledge\n", connection->id);
+        return SESSION_FAILED;
+    }
+    switch (header.status)
+    {
+    case MESSAGE_STATUS_BUSY:
+        return SESSION_BUSY;
+    case MESSAGE_STATUS_TOO_LARGE:
+        return SESSION_TOO_LARGE;
+    case MESSAGE_STATUS_BAD_CRC:
+        fprintf(stderr, "[connection %lu] server got crc32 0x%08x\n", connection->id, ntohl(header.crc32));
+        return SESSION_FAILED;
+    default:
+        break;
+    }
+    if (header.type != MESSAGE_TYPE_ACK)
+    {
+        fprintf(stderr, "[connection %lu] server does not accept async sessions\n", connection->id);
+        return SESSION_FAILED;
+    }
+    *job_id = be64toh(header.job_id);
+    return SESSION_OK;
+}
+
+/* Fetch results of job till they are ready or session timeout expires */
+static session_result_t fetch_results(connection_t *connection, const uint64_t job_id, const uint32_t file_size,
+                                      const uint64_t start_us)
+{
+    const load_options_t *options = connection->state->options;
+    uint64_t deadline_us = start_us + (uint64_t)options->timeout * 1000000;
+    messageHeader_t header;
+    session_result_t ret;
+
+    fill_header(&header, 0, 0, 0);
+    header.type   = MESSAGE_TYPE_FETCH;
+    header.job_id = htobe64(job_id);
+    while (true)
+    {
+        uint64_t now_us, wait_us;
+        int fd = connect_to_server(options);
+        if (fd < 0)
+        {
+            fprintf(stderr, "[connection %lu] can not connect (%d:%s)\n", connection->id, errno, strerror(errno));
+            return SESSION_FAILED;
+        }
+        ret = (send(fd, &header, sizeof(header), MSG_NOSIGNAL) == sizeof(header)) ?
+              receive_results(connection, fd, file_size) : SESSION_FAILED;
+        close(fd);
+        if (ret != SESSION_PENDING)
+        {
+            return ret;
+        }
+
+        /* server estimates time of pending jobs in seconds, small jobs are ready earlier */
+        now_us  = get_time_us();
+        wait_us = (uint64_t)connection->retry_after * 1000000 / 4;
+        wait_us = (wait_us > FETCH_MIN_INTERVAL_MS * 1000) ? wait_us : FETCH_MIN_INTERVAL_MS * 1000;
+        if (now_us + wait_us >= deadline_us)
+        {
+            return SESSION_TIMEOUT;
+        }
+        usleep((useconds_t)wait_us);
+    }
+}
+
+static session_result_t run_session(connection_t *connection, const size_t session, double *latency_ms,
+                                    uint32_t *file_size)
+{
+    load_state_t *state = connection->state;
+    const load_options_t *options = state->options;
+    uint32_t frame_size = get_uniform(connection, options->frame_size_min, options->frame_size_max);
+    uint32_t size = get_uniform(connection, options->size_min, options->size_max);
+    uint64_t start_us;
+    session_result_t ret;
+    int fd;
+    uint64_t job_id = 0;
+    const replay_recording_t *recording = NULL;
+
+    size = (size < frame_size) ? frame_size : size - size % frame_size;
+    if (options->replay != NULL)
+    {
+        /* recordings are sent in a loop if there are more sessions */
+        recording = &options->replay->recordings[session % options->replay->count];
+        size = recording->file_size;
+    }
+    *file_size = size;
+    fill_header(&connection->message->header, size, frame_size,
+                (options->progressive ? MESSAGE_FLAG_PROGRESSIVE : 0) | (options->async ? MESSAGE_FLAG_ASYNC : 0));
+    if (options->async)
+    {
+        connection->message->header.crc32 = htonl(crc32_update(0, connection->message->payload, size));
+    }
+
+    start_us = get_time_us();
+    fd = connect_to_server(options);
+    if (fd < 0)
+    {
+        fprintf(stderr, "[connection %lu] can not connect (%d:%s)\n", connection->id, errno, strerror(errno));
+        return SESSION_FAILED;
+    }
+
+    if (recording != NULL)
+    {
+        ret = send_recording(fd, recording, options->speed, start_us, &state->sent_bytes);
+    }
+    else
+    {
+        ret = (session_result_t)send_limited(fd, (uint8_t *)connection->message, sizeof(messageHeader_t) + size,
+                                             options->rate, start_us, &state->sent_bytes);
+    }
+    /* server could answer by busy status and close connection before the end of file */
+    if (ret != SESSION_TIMEOUT)
+    {
+        shutdown(fd, SHUT_WR);
+        ret = (options->async && recording == NULL) ? receive_ack(connection, fd, &job_id) :
+                                                      receive_results(connection, fd, size);
+    }
+    close(fd);
+    if (options->async && recording == NULL && ret == SESSION_OK)
+    {
+        ret = fetch_results(connection, job_id, size, start_us);
+    }
+    *latency_ms = (double)(get_time_us() - start_us) / 1000.0;
+    return ret;
+}
+
+static void *connection_thread(void *arg)
+{
+    connection_t *connection = arg;
+    load_state_t *state = connection->state;
+    size_t session;
+
+    while ((session = atomic_fetch_add(&state->next_session, 1)) < state->options->sessions)
+    {
+        double latency_ms = 0;
+        uint32_t file_size = 0;
+        session_result_t ret = run_session(connection, session, &latency_ms, &file_size);
+
+        atomic_fetch_add(&state->results[ret], 1);
+        if (ret == SESSION_OK || ret == SESSION_PARTIAL)
+        {
+            state->latencies_ms[session] = latency_ms;
+            atomic_fetch_add(&state->processed_bytes, file_size);
+        }
+    }
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double get_percentile(const double *sorted, size_t count, double percentile)
+{
+    size_t index = (size_t)(percentile * (double)count + 0.999999);
+    if (count == 0)
+    {
+        return 0;
+    }
+    index = (index == 0) ? 0 : index - 1;
+    return sorted[(index < count) ? index : count - 1];
+}
+
+static void print_report(load_state_t *state, double seconds)
+{
+    size_t i, count = 0;
+    const load_options_t *options = state->options;
+    double *sorted = malloc(sizeof(*sorted) * (options->sessions + 1));
+
+    fprintf(stderr, "sessions: %lu, connections: %lu, time: %.3f s\n", options->sessions, options->connections, seconds);
+    for (i = 0; i < SESSION_RESULTS_COUNT; i++)
+    {
+        fprintf(stderr, "%s%s: %lu", (i == 0) ? "" : ", ", results_names[i], atomic_load(&state->results[i]));
+    }
+    fprintf(stderr, "\n");
+    fprintf(stderr, "sent: %.2f MB/s, processed: %.2f MB/s\n",
+            (double)atomic_load(&state->sent_bytes) / seconds / 1000000.0,
+            (double)atomic_load(&state->processed_bytes) / seconds / 1000000.0);
+
+    if (sorted == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < options->sessions; i++)
+    {
+        if (state->latencies_ms[i] >= 0)
+        {
+            sorted[count++] = state->latencies_ms[i];
+        }
+    }
+    qsort(sorted, count, sizeof(*sorted), compare_doubles);
+    fprintf(stderr, "latency ms: p50 %.1f, p99 %.1f, p999 %.1f, max %.1f\n",
+            get_percentile(sorted, count, 0.5), get_percentile(sorted, count, 0.99),
+            get_percentile(sorted, count, 0.999), (count != 0) ? sorted[count - 1] : 0);
+    free(sorted);
+}
+
+int load_run(const load_options_t *options)
+{
+    int ret = -1;
+    size_t i;
+    load_state_t state;
+    connection_t *connections = NULL;
+    uint64_t start_us;
+
+    memset(&state, 0x00, sizeof(state));
+    state.options = options;
+    atomic_init(&state.next_session, 0);
+    atomic_init(&state.sent_bytes, 0);
+    atomic_init(&state.processed_bytes, 0);
+    for (i = 0; i < SESSION_RESULTS_COUNT; i++)
+    {
+        atomic_init(&state.results[i], 0);
+    }
+    pthread_mutex_init(&state.last_lock, NULL);
+
+    state.latencies_ms = malloc(sizeof(*state.latencies_ms) * options->sessions);
+    connections = calloc(sizeof(*connections), options->connections);
+    if (state.latencies_ms == NULL || connections == NULL)
+    {
+        fprintf(stderr, "Can not allocate memory\n");
+        goto exit;
+    }
+    for (i = 0; i < options->sessions; i++)
+    {
+        state.latencies_ms[i] = -1;
+    }
+
+    start_us = get_time_us();
+    for (i = 0; i < options->connections; i++)
+    {
+        connection_t *connection = &connections[i];
+        connection->state  = &state;
+        connection->id     = i;
+        connection->random = ((uint64_t)time(NULL) << 16) ^ (i + 1);
+        connection->message = malloc(sizeof(messageHeader_t) + options->size_max);
+        if (connection->message == NULL)
+        {
+            fprintf(stderr, "Can not allocate memory\n");
+            goto exit;
+        }
+        fill_payload(connection->message->payload, options->size_max, connection->random);
+        if (pthread_create(&connection->thread, NULL, connection_thread, connection) != 0)
+        {
+            fprintf(stderr, "Can not create connection thread\n");
+            free(connection->message);
+            connection->message = NULL;
+            goto exit;
+        }
+    }
+    ret = 0;
+
+exit:
+    for (i = 0; i < options->connections && connections != NULL; i++)
+    {
+        if (connections[i].message != NULL)
+        {
+            pthread_join(connections[i].thread, NULL);
+            free(connections[i].message);
+        }
+    }
+    if (ret == 0)
+    {
+        print_report(&state, (double)(get_time_us() - start_us) / 1000000.0);
+        for (i = 0; i < state.last_count; i++)
+        {
+            printf("%" PRIu64 " ", state.last_values[i]);
+        }
+        fflush(stdout);
+        ret = (atomic_load(&state.results[SESSION_FAILED]) != 0 ||
+               atomic_load(&state.results[SESSION_TIMEOUT]) != 0) ? 1 : 0;
+    }
+    free(state.last_values);
+    free(state.latencies_ms);
+    free(connections);
+    pthread_mutex_destroy(&state.last_lock);
+    return ret;
+}
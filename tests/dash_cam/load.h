@@ -0,0 +1,44 @@
+#ifndef LOAD_H_
+#define LOAD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dash_cam.h"
+#include "replay.h"
+
+typedef struct load_options_s {
+    const char *ip;
+    uint16_t    port;
+    size_t      connections;    /* concurrent connections */
+    size_t      sessions;       /* sessions sent by all connections */
+    uint32_t    size_min;       /* file size is uniform in [size_min, size_max] */
+    uint32_t    size_max;
+    uint32_t    frame_size_min; /* frame size is uniform in [frame_size_min, frame_size_max] */
+    uint32_t    frame_size_max;
+    uint64_t    rate;           /* link speed of every connection in bytes per second, 0 - unlimited */
+    unsigned    timeout;        /* in seconds, session without response is counted as timeout */
+    bool        progressive;
+    bool        async;          /* results of generated files are fetched by job id */
+    bool        check_value;    /* every indicator value must be equal to expected_value */
+    uint64_t    expected_value;
+    const replay_set_t *replay;  /* recorded sessions are sent instead of generated files, NULL - disabled */
+    double      speed;          /* replay pace relative to recording, 0 - without delays */
+} load_options_t;
+
+void fill_header(messageHeader_t *header, uint32_t size, uint32_t frame_size, uint8_t flags);
+/* Pseudo-random payload, the same seed gives the same data */
+void fill_payload(uint8_t *payload, size_t size, uint64_t seed);
+
+/**
+ * Send sessions to server from concurrent connections
+ *
+ * Values of the last successful response are printed to stdout in the same
+ * format as --read does, statistics are printed to stderr.
+ *
+ * @returns     Zero if all sessions got valid results
+ */
+int load_run(const load_options_t *options);
+
+#endif /* LOAD_H_ */
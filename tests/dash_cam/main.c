@@ -8,6 +8,8 @@
 #include <inttypes.h>
 
 #include "dash_cam.h"
+#include "load.h"
+#include "crc32.h"
 
 const char *argp_program_version = "1.0";
 const char *argp_program_bug_address = "<alexeyfonlapshin@gmail.com>";
@@ -17,11 +19,19 @@ struct arguments
     uint32_t size;
     uint32_t frame_size;
     bool     read;
+    bool     progressive;
+    bool     async;
+    bool     fetch;
+    uint64_t job_id;
+    bool     load;
+    load_options_t load_options;
+    replay_set_t   replay;
 };
 
 static error_t parse_opt (int key, char *arg, struct argp_state *state)
 {
     struct arguments *arguments = state->input;
+    load_options_t *load = &arguments->load_options;
 
     switch(key)
     {
@@ -34,6 +44,56 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
     case 'r':
         arguments->read = true;
         break;
+    case 'P':
+        arguments->progressive = true;
+        break;
+    case 'A':
+        arguments->async = true;
+        break;
+    case 'j':
+        arguments->fetch = true;
+        arguments->job_id = (uint64_t) strtoull(arg, NULL, 10);
+        break;
+    case 'l':
+        arguments->load = true;
+        break;
+    case 'a':
+        load->ip = arg;
+        break;
+    case 'p':
+        load->port = (uint16_t) atoi(arg);
+        break;
+    case 'n':
+        load->connections = (size_t) atoll(arg);
+        break;
+    case 'N':
+        load->sessions = (size_t) atoll(arg);
+        break;
+    case 'S':
+        load->size_max = (uint32_t) atoll(arg);
+        break;
+    case 'F':
+        load->frame_size_max = (uint32_t) atoll(arg);
+        break;
+    case 'R':
+        load->rate = (uint64_t) atoll(arg) * 1000;
+        break;
+    case 't':
+        load->timeout = (unsigned) atoi(arg);
+        break;
+    case 'e':
+        load->check_value = true;
+        load->expected_value = (uint64_t) strtoull(arg, NULL, 10);
+        break;
+    case 'y':
+        if (replay_load(&arguments->replay, arg) != 0)
+        {
+            argp_failure(state, 1, 0, "Can not load recordings from %s", arg);
+        }
+        break;
+    case 'x':
+        load->speed = strtod(arg, NULL);
+        break;
     default:
         return ARGP_ERR_UNKNOWN;
     }
@@ -46,6 +106,26 @@ static int parse_parameters(struct arguments *arguments, int argc, char **argv)
         {"size", 's', "size", 0,  "size of generated data in bytes", 0},
         {"frame-size", 'f', "frame-size", 0,  "size of one frame in bytes", 0},
         {"read", 'r', NULL, 0, "reaading data from stdout", 0},
+        {"progressive", 'P', NULL, 0, "request interim results, they are printed to stderr", 0},
+        {"async", 'A', NULL, 0, "request async session with crc32 of payload, server acknowledges file by "
+                                "job id", 0},
+        {"fetch", 'j', "job_id", 0, "generate request of results of async job", 0},
+        {"load", 'l', NULL, 0, "send files to server from concurrent connections and print statistics "
+                               "to stderr, values of the last results are printed to stdout", 0},
+        {"address", 'a', "ip", 0, "server ip address for load mode (default: 127.0.0.1)", 0},
+        {"port", 'p', "port", 0, "server port for load mode (default: 5000)", 0},
+        {"connections", 'n', "count", 0, "concurrent connections (default: 1)", 0},
+        {"sessions", 'N', "count", 0, "files sent by all connections (default: connections count)", 0},
+        {"size-max", 'S', "size", 0, "file size is uniform between --size and this value", 0},
+        {"frame-size-max", 'F', "frame-size", 0, "frame size is uniform between --frame-size and this value, "
+                                                 "file size is rounded down to frame size", 0},
+        {"rate", 'R', "KB/s", 0, "link speed of every connection (default: unlimited)", 0},
+        {"timeout", 't', "seconds", 0, "session without response is counted as timeout (default: 40)", 0},
+        {"expect", 'e', "value", 0, "every indicator of full results must be equal to value", 0},
+        {"replay", 'y', "path", 0, "send sessions recorded by server --record-dir in load mode, path is "
+                                   "recording or directory, option could be repeated", 0},
+        {"speed", 'x', "factor", 0, "replay pace relative to recording, 2 - twice faster, "
+                                    "0 - without delays (default: 1)", 0},
         { 0 }
     };
 
@@ -56,27 +136,17 @@ static int parse_parameters(struct arguments *arguments, int argc, char **argv)
     return argp_parse(&argp, argc, argv, 0, 0, arguments);
 }
 
-static void fill_header(messageHeader_t *header, uint32_t size, uint32_t frame_size)
-{
-    if (header == NULL)
-    {
-        perror("fill_header NULL pointer");
-        exit(1);
-    }
-    memset(header, 0x00, sizeof(*header));
-
-    header->magic      = htonl(HEADER_MAGIC);
-    header->size       = htonl(size);
-    header->frame_size = htonl(frame_size);
-    header->version    = htonl(HEADER_VERSION);
-}
-
 int dash_cam_read_indicators()
 {
     size_t i;
     int operation = 1;
     messageHeader_t header;
-    size_t read_size = fread(&header, sizeof(header), 1, stdin);
+    FILE *fout = stdout;
+    size_t read_size;
+
+next_message:
+    operation = 1;
+    read_size = fread(&header, sizeof(header), 1, stdin);
     if (read_size == 0)
     {
         printf("Error reading data from stdin\n");
@@ -88,7 +158,42 @@ int dash_cam_read_indicators()
     uint32_t frame_size = ntohl(header.frame_size);
     uint32_t indicators_count = 0;
     uint64_t *payload_ptr = NULL;
+    /* partial results carry processed bytes after every value */
+    uint32_t value_size = (header.status == MESSAGE_STATUS_PARTIAL) ? 2 * sizeof(uint64_t) : sizeof(uint64_t);
 
+    operation++;
+    if (header.status == MESSAGE_STATUS_BUSY)
+    {
+        fprintf(stderr, "server is busy, retry after %u seconds\n", ntohs(header.retry_after));
+        return operation;
+    }
+    if (header.status == MESSAGE_STATUS_TOO_LARGE)
+    {
+        fprintf(stderr, "file is too large for server\n");
+        return operation;
+    }
+    if (header.status == MESSAGE_STATUS_PENDING)
+    {
+        fprintf(stderr, "job %" PRIu64 " is pending, retry after %u seconds\n", be64toh(header.job_id),
+                ntohs(header.retry_after));
+        return operation;
+    }
+    if (header.status == MESSAGE_STATUS_NOT_FOUND)
+    {
+        fprintf(stderr, "job %" PRIu64 " is not found\n", be64toh(header.job_id));
+        return operation;
+    }
+    if (header.status == MESSAGE_STATUS_BAD_CRC)
+    {
+        fprintf(stderr, "server got bad crc32 0x%08x\n", ntohl(header.crc32));
+        return operation;
+    }
+    if (header.type == MESSAGE_TYPE_ACK)
+    {
+        /* results are fetched later by --fetch */
+        printf("job %" PRIu64 " crc32 0x%08x\n", be64toh(header.job_id), ntohl(header.crc32));
+        return 0;
+    }
     operation++;
     if (version != HEADER_VERSION)
     {
@@ -102,9 +207,9 @@ int dash_cam_read_indicators()
         return operation;
     }
     operation++;
-    if (frame_size != 8)
+    if (frame_size != value_size)
     {
-        printf("frame size is not uint64_t size (%d:%ld)\n", frame_size, sizeof(uint64_t));
+        printf("frame size is not expected size (%d:%u)\n", frame_size, value_size);
         return operation;
     }
     operation++;
@@ -134,12 +239,39 @@ int dash_cam_read_indicators()
         printf("Error reading data from stdin\n");
         return operation;
     }
+    fout = (header.type == MESSAGE_TYPE_INTERIM) ? stderr : stdout;
+    if (header.type == MESSAGE_TYPE_INTERIM)
+    {
+        fprintf(fout, "interim %u: ", ntohl(header.offset));
+    }
     for (i = 0; i < indicators_count; i++)
 
     {
-        printf("%" PRIu64 " ", be64toh(payload_ptr[i]));
+        fprintf(fout, "%" PRIu64 " ", be64toh(payload_ptr[i * value_size / sizeof(uint64_t)]));
+    }
+    if (header.type == MESSAGE_TYPE_RESULT && header.sampling > 1)
+    {
+        fprintf(stderr, "results for every %u block of frames\n", header.sampling);
+    }
+    if (header.type == MESSAGE_TYPE_RESULT && header.library_id != 0)
+    {
+        fprintf(stderr, "results of indicators library 0x%08x\n", ntohl(header.library_id));
+    }
+    if (header.status == MESSAGE_STATUS_PARTIAL)
+    {
+        fprintf(stderr, "partial results for %u bytes, processed bytes:", ntohl(header.offset));
+        for (i = 0; i < indicators_count; i++)
+        {
+            fprintf(stderr, " %" PRIu64, be64toh(payload_ptr[2 * i + 1]));
+        }
+        fprintf(stderr, "\n");
     }
     free(payload_ptr);
+    if (header.type == MESSAGE_TYPE_INTERIM)
+    {
+        fprintf(fout, "\n");
+        goto next_message;
+    }
     return 0;
 }
 
@@ -149,9 +281,29 @@ int main(int argc, char **argv)
     struct arguments arguments = {
         .size = 512,
         .frame_size = 32,
-        .read = false
+        .read = false,
+        .progressive = false,
+        .async = false,
+        .fetch = false,
+        .job_id = 0,
+        .load = false,
+        .load_options = {
+            .ip = "127.0.0.1",
+            .port = 5000,
+            .connections = 1,
+            .sessions = 0,
+            .size_max = 0,
+            .frame_size_max = 0,
+            .rate = 0,
+            .timeout = 40,
+            .async = false,
+            .check_value = false,
+            .expected_value = 0,
+            .replay = NULL,
+            .speed = 1
+        },
+        .replay = {NULL, 0}
     };
-    size_t i;
     int ret = parse_parameters(&arguments, argc, argv);
     if(ret != 0)
     {
@@ -164,13 +316,57 @@ int main(int argc, char **argv)
         return dash_cam_read_indicators();
     }
 
-    data_to_send = calloc(sizeof(data_to_send->header) + arguments.size, 1);
-    fill_header(&data_to_send->header, arguments.size, arguments.frame_size);
+    if (arguments.replay.count != 0)
+    {
+        load_options_t *load = &arguments.load_options;
+        arguments.load = true;
+        load->replay   = &arguments.replay;
+        load->sessions = (load->sessions != 0) ? load->sessions : arguments.replay.count;
+    }
+
+    if (arguments.load)
+    {
+        load_options_t *load = &arguments.load_options;
+        load->size_min       = arguments.size;
+        load->size_max       = (load->size_max > arguments.size) ? load->size_max : arguments.size;
+        load->frame_size_min = arguments.frame_size;
+        load->frame_size_max = (load->frame_size_max > arguments.frame_size) ? load->frame_size_max : arguments.frame_size;
+        load->sessions       = (load->sessions != 0) ? load->sessions : load->connections;
+        load->progressive    = arguments.progressive;
+        load->async          = arguments.async;
+        if (load->connections == 0 || load->frame_size_min == 0)
+        {
+            printf("Connections count and frame size must not be zero\n");
+            return -1;
+        }
+        ret = load_run(load);
+        replay_free(&arguments.replay);
+        return ret;
+    }
 
-    srand((unsigned int)time(NULL));
-    for(i = 0; i < arguments.size/4; i++)
+    if (arguments.fetch)
+    {
+        messageHeader_t header;
+        fill_header(&header, 0, 0, 0);
+        header.type   = MESSAGE_TYPE_FETCH;
+        header.job_id = htobe64(arguments.job_id);
+        fwrite(&header, sizeof(header), 1, stdout);
+        fflush(stdout);
+        return 0;
+    }
+
+    data_to_send = calloc(sizeof(data_to_send->header) + arguments.size, 1);
+    if (data_to_send == NULL)
+    {
+        printf("Can not allocate memory\n");
+        return -1;
+    }
+    fill_header(&data_to_send->header, arguments.size, arguments.frame_size,
+                (arguments.progressive ? MESSAGE_FLAG_PROGRESSIVE : 0) | (arguments.async ? MESSAGE_FLAG_ASYNC : 0));
+    fill_payload(data_to_send->payload, arguments.size, (uint64_t)time(NULL));
+    if (arguments.async)
     {
-        ((uint32_t *)data_to_send->payload)[i] = htonl((uint32_t)rand());
+        data_to_send->header.crc32 = htonl(crc32_update(0, data_to_send->payload, arguments.size));
     }
 
     fwrite(data_to_send, sizeof(data_to_send->header) + arguments.size, 1, stdout);
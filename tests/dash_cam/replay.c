@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dash_cam.h"
+#include "replay.h"
+
+size_t replay_next_chunk(const replay_recording_t *recording, size_t *offset, uint32_t *delay_us, const uint8_t **data)
+{
+    recordChunk_t chunk;
+    size_t size;
+
+    if (*offset == 0)
+    {
+        *offset = sizeof(recordHeader_t);
+    }
+    if (recording->size - *offset < sizeof(chunk))
+    {
+        return 0;
+    }
+    memcpy(&chunk, recording->data + *offset, sizeof(chunk));
+    size = ntohl(chunk.size);
+    if (recording->size - *offset - sizeof(chunk) < size)
+    {
+        return 0;
+    }
+    *delay_us = ntohl(chunk.delay_us);
+    *data     = recording->data + *offset + sizeof(chunk);
+    *offset  += sizeof(chunk) + size;
+    return size;
+}
+
+/* Recording must start with record header and message header in the first read */
+static int check_recording(replay_recording_t *recording)
+{
+    recordHeader_t header;
+    messageHeader_t message_header;
+    size_t offset = 0;
+    uint32_t delay_us;
+    const uint8_t *data;
+
+    if (recording->size < sizeof(header))
+    {
+        return -1;
+    }
+    memcpy(&header, recording->data, sizeof(header));
+    if (ntohl(header.magic) != RECORD_MAGIC || ntohl(header.version) != RECORD_VERSION)
+    {
+        return -1;
+    }
+    if (replay_next_chunk(recording, &offset, &delay_us, &data) != sizeof(message_header))
+    {
+        return -1;
+    }
+    memcpy(&message_header, data, sizeof(message_header));
+    recording->file_size = ntohl(message_header.size);
+    return 0;
+}
+
+static int add_recording(replay_set_t *set, const char *path)
+{
+    struct stat st;
+    void *data;
+    replay_recording_t *recording;
+    replay_recording_t *recordings;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1 || fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        fprintf(stderr, "Can not open recording %s\n", path);
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Can not map recording %s (%d:%s)\n", path, errno, strerror(errno));
+        return -1;
+    }
+
+    recordings = realloc(set->recordings, sizeof(*recordings) * (set->count + 1));
+    if (recordings == NULL)
+    {
+        munmap(data, (size_t)st.st_size);
+        return -1;
+    }
+    set->recordings = recordings;
+    recording = &set->recordings[set->count];
+    recording->data = data;
+    recording->size = (size_t)st.st_size;
+    recording->path = strdup(path);
+    if (recording->path == NULL || check_recording(recording) != 0)
+    {
+        fprintf(stderr, "Wrong recording %s\n", path);
+        munmap(data, (size_t)st.st_size);
+        free(recording->path);
+        return -1;
+    }
+    set->count++;
+    return 0;
+}
+
+static int has_suffix(const char *name, const char *suffix)
+{
+    size_t name_len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return name_len > suffix_len && strcmp(name + name_len - suffix_len, suffix) == 0;
+}
+
+static int compare_names(const struct dirent **a, const struct dirent **b)
+{
+    return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+int replay_load(replay_set_t *set, const char *path)
+{
+    int i, count;
+    int ret = 0;
+    struct stat st;
+    struct dirent **entries;
+
+    if (stat(path, &st) != 0)
+    {
+        fprintf(stderr, "Can not find %s (%d:%s)\n", path, errno, strerror(errno));
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        return add_recording(set, path);
+    }
+
+    /* sorted names keep the same order of sessions in every run */
+    count = scandir(path, &entries, NULL, compare_names);
+    if (count < 0)
+    {
+        fprintf(stderr, "Can not read directory %s (%d:%s)\n", path, errno, strerror(errno));
+        return -1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        char file_path[PATH_MAX];
+        if (ret == 0 && has_suffix(entries[i]->d_name, RECORD_FILE_SUFFIX))
+        {
+            snprintf(file_path, sizeof(file_path), "%s/%s", path, entries[i]->d_name);
+            ret = add_recording(set, file_path);
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return ret;
+}
+
+void replay_free(replay_set_t *set)
+{
+    size_t i;
+    for (i = 0; i < set->count; i++)
+    {
+        munmap((void *)set->recordings[i].data, set->recordings[i].size);
+        free(set->recordings[i].path);
+    }
+    free(set->recordings);
+    set->recordings = NULL;
+    set->count = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "record.h"
+
+typedef struct replay_recording_s {
+    char          *path;
+    const uint8_t *data;       /* mapped file */
+    size_t         size;
+    uint32_t       file_size;  /* size from recorded message header */
+} replay_recording_t;
+
+typedef struct replay_set_s {
+    replay_recording_t *recordings;
+    size_t              count;
+} replay_set_t;
+
+/**
+ * Map recorded sessions
+ *
+ * @param[in,out]   set     recordings are appended to set.
+ * @param[in]       path    recording or directory, all *.rec files of directory are added.
+ * @returns     Zero if all recordings are valid
+ */
+int replay_load(replay_set_t *set, const char *path);
+void replay_free(replay_set_t *set);
+
+/**
+ * Get next read of recording
+ *
+ * @param[in]       recording   valid recording.
+ * @param[in,out]   offset      position in recording, 0 - the first read.
+ * @param[out]      delay_us    time since previous read.
+ * @param[out]      data        data of read.
+ * @returns     Size of data, 0 after the last read
+ */
+size_t replay_next_chunk(const replay_recording_t *recording, size_t *offset, uint32_t *delay_us, const uint8_t **data);
+
+#endif /* REPLAY_H_ */
@@ -0,0 +1,70 @@
+#!/bin/bash
+# Async sessions: crc32 in acknowledgement, fetch of job and its resume from journal after restart
+
+source $(dirname $0)/common.sh
+
+PORT=5001
+SIZE=8000000
+EXPECTED="$SIZE $SIZE $SIZE "
+WORK_DIR=$(mktemp -d)
+trap "rm -rf $WORK_DIR" EXIT
+mkdir $WORK_DIR/jobs
+
+# Submit async file, job id is printed
+submit() {
+    local ack
+    $DASH_CAM -A -s $SIZE -f 10000 > $WORK_DIR/file
+    ack=$(exchange $PORT < $WORK_DIR/file | $DASH_CAM -r) || fail "no acknowledgement: $ack"
+    # crc32 of payload which follows 52 bytes of header
+    crc=$(python3 -c 'import sys, zlib; print("0x%08x" % zlib.crc32(open(sys.argv[1], "rb").read()[52:]))' $WORK_DIR/file)
+    [[ "$ack" =~ ^job\ ([0-9]+)\ crc32\ $crc$ ]] || fail "bad acknowledgement: $ack, crc32 $crc expected"
+    echo ${BASH_REMATCH[1]}
+}
+
+# Fetch results of job, values or status are printed
+fetch() {
+    $DASH_CAM -j $1 | exchange $PORT | $DASH_CAM -r 2>&1 | grep -v "^results of indicators library"
+}
+
+# Fetch till job is computed
+fetch_done() {
+    local i output
+    for i in $(seq 50); do
+        output=$(fetch $1)
+        if [[ "$output" != *"is pending"* ]]; then
+            echo "$output"
+            return
+        fi
+        sleep 0.2
+    done
+    echo "$output"
+}
+
+start_server $WORK_DIR/log -p $PORT --jobs-dir=$WORK_DIR/jobs || fail "server is not started"
+SYNC=$($DASH_CAM -s $SIZE -f 10000 | exchange $PORT | $DASH_CAM -r)
+[ "$SYNC" == "$EXPECTED" ] || fail "sync results: $SYNC"
+
+JOB=$(submit) || fail "$JOB"
+OUTPUT=$(fetch_done $JOB)
+[ "$OUTPUT" == "$SYNC" ] || fail "results of job $JOB: $OUTPUT"
+OUTPUT=$(fetch 12345)
+[[ "$OUTPUT" == *"job 12345 is not found"* ]] || fail "unknown job: $OUTPUT"
+stop_server $cs_pid || fail "server exit"
+
+# slow job is still computed when server is killed, journal keeps it
+FUNCTIONAL_TEST_DELAY_MS=3000 start_server $WORK_DIR/log -p $PORT --jobs-dir=$WORK_DIR/jobs || fail "server is not started"
+JOB=$(submit) || fail "$JOB"
+OUTPUT=$(fetch $JOB)
+[[ "$OUTPUT" == *"job $JOB is pending"* ]] || fail "job in progress: $OUTPUT"
+kill -9 $cs_pid
+wait $cs_pid
+[ -f $WORK_DIR/jobs/$JOB.job ] || fail "job $JOB is not in journal"
+
+start_server $WORK_DIR/log -p $PORT --jobs-dir=$WORK_DIR/jobs || fail "server is not started"
+grep -q "1 jobs are resumed from journal" $WORK_DIR/log || fail "job $JOB is not resumed"
+OUTPUT=$(fetch_done $JOB)
+[ "$OUTPUT" == "$SYNC" ] || fail "results of resumed job $JOB: $OUTPUT"
+[ ! -f $WORK_DIR/jobs/$JOB.job ] || fail "job $JOB stays in journal"
+stop_server $cs_pid || fail "server exit"
+
+echo "All good"
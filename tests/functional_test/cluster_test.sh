@@ -0,0 +1,64 @@
+#!/bin/bash
+# Cluster: coordinator passes connections to workers, answers busy without healthy worker and restarts killed worker
+
+source $(dirname $0)/common.sh
+
+PORT=5003
+WORK_DIR=$(mktemp -d)
+trap "rm -rf $WORK_DIR" EXIT
+LOG=$WORK_DIR/log
+
+# Print pid of the last start of worker
+# Usage: worker_pid <worker id>
+worker_pid() {
+    grep -o "Worker $1 is started (pid [0-9]*)" $LOG | tail -1 | grep -o "[0-9]*)" | tr -d ")"
+}
+
+# Wait till count of lines matching pattern reaches value
+# Usage: wait_count <pattern> <count>
+wait_count() {
+    local i
+    for i in $(seq 100); do
+        [ $(grep -c "$1" $LOG) -ge $2 ] && return 0
+        sleep 0.1
+    done
+    echo "\"$1\" is not found $2 times in $LOG"
+    return 1
+}
+
+# Sessions from concurrent connections, all of them must get full results
+sessions() {
+    $DASH_CAM --load -p $PORT -n 2 -N 6 -s 800000 -f 10000 --expect 800000 > /dev/null 2> $WORK_DIR/load ||
+        fail "sessions failed: $(cat $WORK_DIR/load)"
+}
+
+start_server $LOG -p $PORT --workers 2 --max-sessions=2 || fail "coordinator is not started"
+wait_count "Server prepared for" 2 || fail "workers are not started"
+sessions
+wait_count "Processing finished. Success" 6 || fail "workers did not serve sessions"
+
+# stopped workers do not report, coordinator answers busy
+WORKER0=$(worker_pid 0)
+WORKER1=$(worker_pid 1)
+kill -STOP $WORKER0 $WORKER1
+sleep 3.5
+OUTPUT=$($DASH_CAM -s 80000 -f 10000 | exchange $PORT | $DASH_CAM -r 2>&1)
+kill -CONT $WORKER0 $WORKER1
+[[ "$OUTPUT" == *"server is busy"* ]] || fail "no busy answer without healthy worker: $OUTPUT"
+wait_log $LOG "No healthy worker" || fail "coordinator did not answer busy"
+# workers report on the next ping
+sleep 2
+sessions
+
+# killed worker is restarted, sessions are served meanwhile by the other one
+kill -9 $WORKER0
+wait_log $LOG "Control channel of worker 0 is closed" || fail "killed worker is not noticed"
+sessions
+wait_count "Worker 0 is started" 2 || fail "killed worker is not restarted"
+wait_count "Server prepared for" 3 || fail "restarted worker is not ready"
+[ "$(worker_pid 0)" != "$WORKER0" ] || fail "worker 0 has old pid"
+sessions
+
+stop_server $cs_pid || fail "coordinator exit"
+kill -0 $WORKER1 $(worker_pid 0) 2> /dev/null && fail "workers did not exit with coordinator"
+echo "All good"
@@ -0,0 +1,85 @@
+#!/bin/bash
+# Helpers of functional tests, scripts are run from build directory of functional tests
+
+SERVER=../../computation-server
+DASH_CAM=../dash_cam
+LIBRARY=./libfunctional_test_lib.so
+
+# Wait till file has line matching pattern, up to 10 seconds
+# Usage: wait_log <file> <pattern>
+wait_log() {
+    local i
+    for i in $(seq 100); do
+        if grep -q "$2" "$1" 2> /dev/null; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    echo "\"$2\" is not found in $1"
+    return 1
+}
+
+# Start server with functional test library, its output goes to log file
+# Usage: start_server <log file> <options...>, pid is in $cs_pid
+start_server() {
+    local log=$1
+    shift
+    LD_PRELOAD=$LIBRARY $SERVER "$@" > $log 2>&1 &
+    cs_pid=$!
+    wait_log $log "start to polling"
+}
+
+# Stop server and check that it exits without error
+# Usage: stop_server <pid>
+stop_server() {
+    kill $1 2> /dev/null
+    wait $1
+    local status=$?
+    if [ $status != 0 ]; then
+        echo "Server $1 finished with error code $status"
+        return 1
+    fi
+}
+
+# Send stdin to server and print its answer, nc is used when it is installed
+# Usage: exchange <port>
+exchange() {
+    if command -v nc > /dev/null; then
+        nc -q 2 localhost $1
+        return
+    fi
+    exec 3<> /dev/tcp/127.0.0.1/$1 || return 1
+    cat >&3
+    cat <&3
+    exec 3<&-
+}
+
+# Send commands from stdin to control socket and print answers
+# Usage: control <socket path>
+control() {
+    if command -v socat > /dev/null; then
+        socat -t 2 - UNIX-CONNECT:$1
+    elif command -v nc > /dev/null && nc -h 2>&1 | grep -q -- "-U"; then
+        nc -q 2 -U $1
+    else
+        python3 -c '
+import socket, sys
+s = socket.socket(socket.AF_UNIX)
+s.connect(sys.argv[1])
+s.sendall(sys.stdin.buffer.read())
+s.shutdown(socket.SHUT_WR)
+while True:
+    data = s.recv(65536)
+    if not data:
+        break
+    sys.stdout.buffer.write(data)' $1
+    fi
+}
+
+# Fail test with message
+# Usage: fail <message>
+fail() {
+    echo "FAIL: $*"
+    [ -n "$cs_pid" ] && kill -9 $cs_pid 2> /dev/null
+    exit 1
+}
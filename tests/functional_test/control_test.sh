@@ -0,0 +1,69 @@
+#!/bin/bash
+# Control socket: list, get, set with bounds checks, stats, reload and too long command
+
+source $(dirname $0)/common.sh
+
+PORT=5004
+WORK_DIR=$(mktemp -d)
+trap "rm -rf $WORK_DIR" EXIT
+SOCKET=$WORK_DIR/control
+
+# Check answer of control socket
+# Usage: expect <commands> <expected answer>
+expect() {
+    local output
+    output=$(printf "$1" | control $SOCKET)
+    [ "$output" == "$2" ] || fail "answer to \"$1\": \"$output\", expected \"$2\""
+}
+
+# library is loaded by server, so it could be reloaded
+LIBRARY= start_server $WORK_DIR/log -p $PORT --deadline=35 --indicators-lib=$PWD/libfunctional_test_lib.so \
+    --control-socket=$SOCKET || fail "server is not started"
+
+OUTPUT=$(echo list | control $SOCKET)
+[[ "$OUTPUT" == *"deadline 35"* ]] || fail "list: $OUTPUT"
+[ $(echo "$OUTPUT" | wc -l) == 12 ] || fail "list has not all tunables: $OUTPUT"
+[ "$(echo "$OUTPUT" | tail -1)" == "ok" ] || fail "list: $OUTPUT"
+
+expect "get deadline\n" "deadline 35
+ok"
+expect "set deadline 10\nget deadline\n" "ok
+deadline 10
+ok"
+wait_log $WORK_DIR/log "Tunable deadline is set to 10 by control socket" || fail "set is not logged"
+
+# rejected values keep the previous one
+expect "set deadline 0\nset deadline 3601\nset deadline -5\nset deadline 10s\nget deadline\n" \
+"error deadline must be in [1, 3600]
+error deadline must be in [1, 3600]
+error -5 is not a number
+error 10s is not a number
+deadline 10
+ok"
+expect "set log-level debug\nget log-level\nset log-level loud\n" "ok
+log-level debug
+ok
+error loud is not a number"
+expect "get unknown\nset unknown 1\nget\nhelp\n\n" "error unknown tunable unknown
+error unknown tunable unknown
+error unknown command get, commands: list, get <name>, set <name> <value>, stats, reload
+error unknown command help, commands: list, get <name>, set <name> <value>, stats, reload
+error empty command"
+
+# server works with changed tunables
+OUTPUT=$($DASH_CAM -s 80000 -f 10000 | exchange $PORT | $DASH_CAM -r 2> /dev/null)
+[ "$OUTPUT" == "80000 80000 80000 " ] || fail "session after set: $OUTPUT"
+
+OUTPUT=$(echo stats | control $SOCKET)
+[ $(echo "$OUTPUT" | wc -l) -gt 1 ] && [ "$(echo "$OUTPUT" | tail -1)" == "ok" ] || fail "stats: $OUTPUT"
+expect "reload\n" "ok"
+wait_log $WORK_DIR/log "is not changed" || fail "library is not checked by reload"
+
+# command without new line fills buffer of 256 bytes
+expect "get $(head -c 300 /dev/zero | tr '\0' x)" "error command is too long"
+expect "get deadline\n" "deadline 10
+ok"
+
+stop_server $cs_pid || fail "server exit"
+[ ! -e $SOCKET ] || fail "control socket is not removed"
+echo "All good"
@@ -0,0 +1,41 @@
+#!/bin/bash
+# Upgrade: new server takes listening socket, old one finishes its session and exits
+
+source $(dirname $0)/common.sh
+
+PORT=5002
+WORK_DIR=$(mktemp -d)
+trap "rm -rf $WORK_DIR" EXIT
+OPTIONS="-p $PORT --max-sessions=2 --upgrade-socket=$WORK_DIR/upgrade"
+
+start_server $WORK_DIR/a.log $OPTIONS || fail "server A is not started"
+A_PID=$cs_pid
+
+# upload takes about 2 seconds, it is in flight during handoff
+$DASH_CAM --load -p $PORT -s 4000000 -f 10000 -R 2000 --expect 4000000 > $WORK_DIR/upload 2> /dev/null &
+UPLOAD_PID=$!
+wait_log $WORK_DIR/a.log "Process incoming data" || fail "upload is not started"
+
+start_server $WORK_DIR/b.log $OPTIONS || fail "server B is not started"
+B_PID=$cs_pid
+grep -q "Listening socket is taken from running server" $WORK_DIR/b.log || fail "B did not take over"
+wait_log $WORK_DIR/a.log "Listening socket is passed to new server" || fail "A did not pass listening socket"
+
+OUTPUT=$($DASH_CAM -s 80000 -f 10000 | exchange $PORT | $DASH_CAM -r)
+[ "$OUTPUT" == "80000 80000 80000 " ] || fail "new session: $OUTPUT"
+wait_log $WORK_DIR/b.log "Processing finished. Success" || fail "B did not serve new session"
+
+wait $UPLOAD_PID || fail "in-flight upload failed"
+[ "$(cat $WORK_DIR/upload)" == "4000000 4000000 4000000 " ] || fail "in-flight upload: $(cat $WORK_DIR/upload)"
+[ $(grep -c "Process incoming data" $WORK_DIR/a.log) == 1 ] || fail "A accepted new sessions"
+wait_log $WORK_DIR/a.log "Processing finished. Success" || fail "A did not finish in-flight session"
+
+for i in $(seq 100); do
+    kill -0 $A_PID 2> /dev/null || break
+    sleep 0.1
+done
+kill -0 $A_PID 2> /dev/null && fail "A did not exit after draining"
+wait $A_PID || fail "A finished with error"
+
+stop_server $B_PID || fail "server B exit"
+echo "All good"
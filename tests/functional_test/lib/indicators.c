@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <pthread.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "indicators.h"
 
@@ -18,9 +19,34 @@ struct indicator_ctx {
     uint64_t value;
 };
 
+/* FUNCTIONAL_TEST_DELAY_MS makes every call slow, so tests could catch a job or session in progress */
+static unsigned int delay_us;
+
+__attribute__((constructor)) static void read_delay(void)
+{
+    const char *delay = getenv("FUNCTIONAL_TEST_DELAY_MS");
+
+    if (delay != NULL)
+    {
+        delay_us = (unsigned int)strtoul(delay, NULL, 10) * 1000;
+    }
+}
+
+/* Size of data is taken from preprocessor output, so it must belong to the same data */
 void indicator(__attribute__((unused))indicator_arg_t *arg)
 {
-    arg->ctx->value += arg->size;
+    uint64_t size = arg->size;
+
+    if (arg->derived != NULL)
+    {
+        assert(arg->derived_size == sizeof(size));
+        memcpy(&size, arg->derived, sizeof(size));
+    }
+    arg->ctx->value += size;
+    if (delay_us != 0)
+    {
+        usleep(delay_us);
+    }
     return;
 }
 
@@ -54,7 +80,6 @@ static indicators_handlers_t indicators_handlers[] =
     {&indicator_alloc, &indicator_init, &indicator_free, &indicator, &indicator_extract},
 };
 
-
 indicators_handlers_t *get_indicators_handlers(void)
 {
     return indicators_handlers;
@@ -64,3 +89,39 @@ size_t get_indicators_count(void)
 {
     return sizeof(indicators_handlers)/sizeof(indicators_handlers[0]);
 }
+
+/* Variant without optional functions checks that server works with raw data and own contexts of library */
+#ifndef FUNCTIONAL_TEST_RAW
+static size_t preprocess_size(__attribute__((unused))size_t size)
+{
+    return sizeof(uint64_t);
+}
+
+static size_t preprocess(__attribute__((unused))const uint8_t *data, size_t size, uint8_t *derived,
+                         __attribute__((unused))indicator_scratch_t *scratch)
+{
+    uint64_t value = size;
+    memcpy(derived, &value, sizeof(value));
+    return sizeof(value);
+}
+
+static const indicators_preprocessor_t preprocessor = {&preprocess_size, &preprocess};
+
+/* Contexts are allocated by the server, allocator is kept for tools which do not support layouts */
+static const indicator_ctx_layout_t ctx_layouts[] =
+{
+    {sizeof(indicator_ctx_t), 0},
+    {sizeof(indicator_ctx_t), 0},
+    {sizeof(indicator_ctx_t), 0},
+};
+
+const indicator_ctx_layout_t *get_indicators_ctx_layouts(void)
+{
+    return ctx_layouts;
+}
+
+const indicators_preprocessor_t *get_indicators_preprocessor(void)
+{
+    return &preprocessor;
+}
+#endif /* FUNCTIONAL_TEST_RAW */
@@ -0,0 +1,59 @@
+#!/bin/bash
+# Spool: files bigger than --max-file-size are received to spool files, policy decides which files remain
+
+source $(dirname $0)/common.sh
+
+PORT=5005
+SIZE=3000000
+EXPECTED="$SIZE $SIZE $SIZE "
+WORK_DIR=$(mktemp -d)
+trap "rm -rf $WORK_DIR" EXIT
+mkdir $WORK_DIR/delete $WORK_DIR/retain $WORK_DIR/retain-failed
+
+# Wait till directory has count of spool files, they are released after results are sent
+# Usage: wait_files <directory> <count>
+wait_files() {
+    local i
+    for i in $(seq 50); do
+        [ $(ls $1 | wc -l) == $2 ] && return 0
+        sleep 0.1
+    done
+    echo "$1 has files: $(ls $1)"
+    return 1
+}
+
+$DASH_CAM -s $SIZE -f 10000 > $WORK_DIR/file
+
+# file is bigger than 1 MB, it is rejected without spool
+start_server $WORK_DIR/log -p $PORT --max-file-size=1 || fail "server is not started"
+OUTPUT=$(exchange $PORT < $WORK_DIR/file | $DASH_CAM -r 2>&1)
+[[ "$OUTPUT" == *"file is too large"* ]] || fail "big file without spool: $OUTPUT"
+stop_server $cs_pid || fail "server exit"
+
+start_server $WORK_DIR/log -p $PORT --max-file-size=1 --spool-dir=$WORK_DIR/delete || fail "server is not started"
+OUTPUT=$(exchange $PORT < $WORK_DIR/file | $DASH_CAM -r 2> /dev/null)
+[ "$OUTPUT" == "$EXPECTED" ] || fail "spooled file with delete policy: $OUTPUT"
+wait_files $WORK_DIR/delete 0 || fail "spool file is not deleted"
+stop_server $cs_pid || fail "server exit"
+
+start_server $WORK_DIR/log -p $PORT --max-file-size=1 --spool-dir=$WORK_DIR/retain --spool-policy=retain ||
+    fail "server is not started"
+OUTPUT=$(exchange $PORT < $WORK_DIR/file | $DASH_CAM -r 2> /dev/null)
+[ "$OUTPUT" == "$EXPECTED" ] || fail "spooled file with retain policy: $OUTPUT"
+wait_log $WORK_DIR/log "is retained" || fail "spool file is not retained"
+wait_files $WORK_DIR/retain 1 || fail "spool file is not retained"
+cmp $WORK_DIR/file $WORK_DIR/retain/spool-$cs_pid-*.msg || fail "retained file differs from sent one"
+stop_server $cs_pid || fail "server exit"
+
+# only file of session which failed by deadline remains
+start_server $WORK_DIR/log -p $PORT --max-file-size=1 --spool-dir=$WORK_DIR/retain-failed \
+    --spool-policy=retain-failed --deadline=1 || fail "server is not started"
+OUTPUT=$(exchange $PORT < $WORK_DIR/file | $DASH_CAM -r 2> /dev/null)
+[ "$OUTPUT" == "$EXPECTED" ] || fail "spooled file with retain-failed policy: $OUTPUT"
+wait_files $WORK_DIR/retain-failed 0 || fail "spool file of successful session is retained"
+head -c $((SIZE / 2)) $WORK_DIR/file | exchange $PORT > /dev/null
+wait_log $WORK_DIR/log "is retained" || fail "spool file of failed session is not retained"
+wait_files $WORK_DIR/retain-failed 1 || fail "spool file of failed session is not retained"
+stop_server $cs_pid || fail "server exit"
+
+echo "All good"
@@ -1,15 +1,27 @@
 #!/bin/bash
+# Usage: test.sh [indicators library]
 
-LD_PRELOAD=./libfunctional_test_lib.so ../../computation-server &
+source $(dirname $0)/common.sh
+
+LD_PRELOAD=${1:-$LIBRARY} $SERVER &
 cs_pid=$!
 
 sleep 1
-OUTPUT=$(../dash_cam -s 80000000 -f 10000 | nc -v -q 2 localhost 5000 | ../dash_cam -r)
+OUTPUT=$($DASH_CAM -s 80000000 -f 10000 | exchange 5000 | $DASH_CAM -r)
 if [ $? != 0 ]; then
     echo "Error, killing server pid $cs_pid"
     kill -9 $cs_pid
     exit 1;
 fi
+echo $OUTPUT
+
+LOAD_OUTPUT=$($DASH_CAM --load -s 80000000 -f 10000 --expect 80000000)
+if [ $? != 0 ]; then
+    echo "Load error, killing server pid $cs_pid"
+    kill -9 $cs_pid
+    exit 1;
+fi
+echo $LOAD_OUTPUT
 
 kill $cs_pid
 wait %1
@@ -18,9 +30,8 @@ if [ $cs_status != 0 ]; then
     echo "Server finished with error code $cs_status"
     exit 2
 fi
-echo $OUTPUT
 
-if [ "$OUTPUT" == "80000000 80000000 80000000 " ]; then
+if [ "$OUTPUT" == "80000000 80000000 80000000 " ] && [ "$LOAD_OUTPUT" == "$OUTPUT" ]; then
     echo "All good"
     exit 0
 fi
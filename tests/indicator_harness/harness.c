@@ -0,0 +1,388 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "indicators.h"
+#include "harness.h"
+
+typedef indicators_handlers_t *(*get_handlers_t)(void);
+typedef size_t (*get_count_t)(void);
+typedef const indicator_ctx_layout_t *(*get_layouts_t)(void);
+
+#define SCRATCH_SIZE ((size_t) (1024 * 1024))
+
+typedef struct run_result_s {
+    double   seconds;
+    uint64_t calls;   /* by all threads */
+    bool     stable;  /* all values are equal to reference */
+} run_result_t;
+
+typedef struct worker_s {
+    pthread_t                thread;
+    const harness_options_t *options;
+    indicators_handlers_t   *handler;
+    size_t                   chunk;    /* 0 - whole file in one call */
+    const indicator_ctx_layout_t *layout;  /* NULL - ctx is allocated by library */
+    indicator_ctx_t         *ctx;
+    indicator_scratch_t      scratch;
+    uint64_t                *values;   /* value of every file */
+    uint64_t                 calls;
+    uint64_t                 start_ns;
+    uint64_t                 end_ns;
+    pthread_barrier_t       *start;
+} worker_t;
+
+static uint64_t get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+int harness_map_files(harness_options_t *options)
+{
+    size_t i;
+    for (i = 0; i < options->files_count; i++)
+    {
+        struct stat st;
+        void *data;
+        harness_file_t *file = &options->files[i];
+        int fd = open(file->path, O_RDONLY);
+
+        if (fd == -1 || fstat(fd, &st) != 0)
+        {
+            fprintf(stderr, "Can not open %s (%d:%s)\n", file->path, errno, strerror(errno));
+            if (fd != -1)
+            {
+                close(fd);
+            }
+            return -1;
+        }
+        if (st.st_size == 0)
+        {
+            fprintf(stderr, "File %s is empty\n", file->path);
+            close(fd);
+            return -1;
+        }
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+        {
+            fprintf(stderr, "Can not map %s (%d:%s)\n", file->path, errno, strerror(errno));
+            return -1;
+        }
+        file->data = data;
+        file->size = (size_t)st.st_size;
+    }
+    return 0;
+}
+
+void harness_unmap_files(harness_options_t *options)
+{
+    size_t i;
+    for (i = 0; i < options->files_count; i++)
+    {
+        if (options->files[i].data != NULL)
+        {
+            munmap((void *)options->files[i].data, options->files[i].size);
+            options->files[i].data = NULL;
+        }
+    }
+}
+
+static void *worker_handler(void *arg)
+{
+    size_t r, i, offset;
+    worker_t *worker = arg;
+    const harness_options_t *options = worker->options;
+
+    pthread_barrier_wait(worker->start);
+    worker->start_ns = get_time_ns();
+    for (r = 0; r < options->repeat; r++)
+    {
+        for (i = 0; i < options->files_count; i++)
+        {
+            const harness_file_t *file = &options->files[i];
+            size_t chunk = (worker->chunk == 0) ? file->size : worker->chunk;
+
+            /* the server resets arena for every session */
+            worker->scratch.used = 0;
+            worker->handler->ctx_initializer(worker->ctx);
+            for (offset = 0; offset < file->size; offset += chunk)
+            {
+                indicator_arg_t indicator_arg = {
+                    .ctx  = worker->ctx,
+                    .data = file->data + offset,
+                    .size = (file->size - offset < chunk) ? file->size - offset : chunk,
+                    .scratch = &worker->scratch,
+                };
+                worker->handler->indicator(&indicator_arg);
+                worker->calls++;
+            }
+            worker->values[i] = worker->handler->extract(worker->ctx);
+        }
+    }
+    worker->end_ns = get_time_ns();
+    return NULL;
+}
+
+/* The same way as the server does: aligned and padded to cache lines */
+static indicator_ctx_t *alloc_ctx(worker_t *worker)
+{
+    size_t alignment, size;
+    void *ctx;
+
+    if (worker->layout == NULL)
+    {
+        return worker->handler->ctx_allocator();
+    }
+    alignment = (worker->layout->alignment > INDICATOR_CACHE_LINE_SIZE) ? worker->layout->alignment :
+                INDICATOR_CACHE_LINE_SIZE;
+    size = (worker->layout->size + INDICATOR_CACHE_LINE_SIZE - 1) & ~((size_t)INDICATOR_CACHE_LINE_SIZE - 1);
+    if (posix_memalign(&ctx, alignment, size) != 0)
+    {
+        return NULL;
+    }
+    memset(ctx, 0x00, size);
+    return ctx;
+}
+
+static void free_ctx(worker_t *worker)
+{
+    if (worker->layout == NULL)
+    {
+        worker->handler->ctx_free(worker->ctx);
+    }
+    else
+    {
+        free(worker->ctx);
+    }
+}
+
+/*
+ * Run one indicator by all threads with chunk size. If reference is NULL, values
+ * of the first thread are stored to reference_out, otherwise they are compared.
+ */
+static int run_indicator(const harness_options_t *options, indicators_handlers_t *handler,
+                         const indicator_ctx_layout_t *layout, size_t chunk, const uint64_t *reference,
+                         uint64_t *reference_out, run_result_t *result)
+{
+    int ret = -1;
+    size_t i, k;
+    size_t started = 0;
+    uint64_t start_ns = UINT64_MAX, end_ns = 0;
+    pthread_barrier_t start;
+    worker_t *workers = calloc(sizeof(*workers), options->threads);
+
+    if (workers == NULL || pthread_barrier_init(&start, NULL, (unsigned)options->threads + 1) != 0)
+    {
+        fprintf(stderr, "Can not allocate memory\n");
+        free(workers);
+        return -1;
+    }
+    for (i = 0; i < options->threads; i++)
+    {
+        workers[i].options = options;
+        workers[i].handler = handler;
+        workers[i].chunk   = chunk;
+        workers[i].start   = &start;
+        workers[i].layout  = layout;
+        workers[i].ctx     = alloc_ctx(&workers[i]);
+        workers[i].values  = calloc(sizeof(*workers[i].values), options->files_count);
+        workers[i].scratch.base = malloc(SCRATCH_SIZE);
+        workers[i].scratch.size = SCRATCH_SIZE;
+        if (workers[i].ctx == NULL || workers[i].values == NULL || workers[i].scratch.base == NULL)
+        {
+            fprintf(stderr, "Can not allocate memory\n");
+            goto exit;
+        }
+    }
+    for (i = 0; i < options->threads; i++)
+    {
+        if (pthread_create(&workers[i].thread, NULL, worker_handler, &workers[i]) != 0)
+        {
+            fprintf(stderr, "Can not create thread\n");
+            /* started threads are waiting on barrier, so they can not be released */
+            exit(EXIT_FAILURE);
+        }
+        started++;
+    }
+
+    pthread_barrier_wait(&start);
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        /* workers measure time, short runs could finish before main thread is scheduled */
+        start_ns = (workers[i].start_ns < start_ns) ? workers[i].start_ns : start_ns;
+        end_ns   = (workers[i].end_ns > end_ns) ? workers[i].end_ns : end_ns;
+    }
+    result->seconds = (double)(end_ns - start_ns) / 1000000000.0;
+
+    result->calls  = 0;
+    result->stable = true;
+    for (i = 0; i < options->threads; i++)
+    {
+        result->calls += workers[i].calls;
+        for (k = 0; k < options->files_count; k++)
+        {
+            const uint64_t *expected = (reference != NULL) ? reference : workers[0].values;
+            if (workers[i].values[k] != expected[k])
+            {
+                result->stable = false;
+                fprintf(stderr, "%s: value %" PRIu64 " with chunk %zu is not %" PRIu64 "\n",
+                        options->files[k].path, workers[i].values[k], chunk, expected[k]);
+            }
+        }
+    }
+    if (reference_out != NULL)
+    {
+        memcpy(reference_out, workers[0].values, sizeof(*reference_out) * options->files_count);
+    }
+    ret = 0;
+
+exit:
+    for (i = 0; i < options->threads; i++)
+    {
+        if (workers[i].ctx != NULL)
+        {
+            free_ctx(&workers[i]);
+        }
+        free(workers[i].values);
+        free(workers[i].scratch.base);
+    }
+    pthread_barrier_destroy(&start);
+    free(workers);
+    return ret;
+}
+
+static void print_result(const harness_options_t *options, size_t chunk, size_t total_size,
+                         const run_result_t *result)
+{
+    char chunk_str[32];
+    double bytes = (double)total_size * (double)options->repeat * (double)options->threads;
+
+    if (chunk == 0)
+    {
+        snprintf(chunk_str, sizeof(chunk_str), "whole");
+    }
+    else
+    {
+        snprintf(chunk_str, sizeof(chunk_str), "%zu", chunk);
+    }
+    /* time of one thread per call, it includes work on data */
+    printf("%10s %12.2f %12" PRIu64 " %12.1f %8s\n", chunk_str, bytes / result->seconds / 1000000.0,
+           result->calls, result->seconds * (double)options->threads * 1000000000.0 / (double)result->calls,
+           result->stable ? "yes" : "NO");
+}
+
+/*
+ * Work on data is the same for every chunk size, so difference of time is
+ * spent in additional calls
+ */
+static void print_overhead(const harness_options_t *options, const run_result_t *small, const run_result_t *whole)
+{
+    double calls = (double)(small->calls - whole->calls) / (double)options->threads;
+    double overhead_ns = (small->seconds - whole->seconds) * 1000000000.0 / calls;
+
+    printf("per-call overhead: %.1f ns\n", (overhead_ns > 0) ? overhead_ns : 0.0);
+}
+
+int harness_run(const harness_options_t *options)
+{
+    int ret = -1;
+    size_t i, k;
+    size_t count, total_size = 0;
+    get_handlers_t get_handlers;
+    get_count_t get_count;
+    get_layouts_t get_layouts;
+    indicators_handlers_t *handlers;
+    const indicator_ctx_layout_t *layouts;
+    uint64_t *reference = NULL;
+    run_result_t *results = NULL;
+    bool stable = true;
+    void *library = dlopen(options->library, RTLD_NOW | RTLD_LOCAL);
+
+    if (library == NULL)
+    {
+        fprintf(stderr, "Can not load library: %s\n", dlerror());
+        return -1;
+    }
+    get_handlers = (get_handlers_t)(uintptr_t)dlsym(library, "get_indicators_handlers");
+    get_count    = (get_count_t)(uintptr_t)dlsym(library, "get_indicators_count");
+    if (get_handlers == NULL || get_count == NULL)
+    {
+        fprintf(stderr, "Library does not export indicators API: %s\n", dlerror());
+        goto exit;
+    }
+    get_layouts  = (get_layouts_t)(uintptr_t)dlsym(library, "get_indicators_ctx_layouts");
+    handlers = get_handlers();
+    count    = get_count();
+    layouts  = (get_layouts != NULL) ? get_layouts() : NULL;
+    if (handlers == NULL || count == 0)
+    {
+        fprintf(stderr, "Library has no indicators\n");
+        goto exit;
+    }
+
+    reference = calloc(sizeof(*reference), options->files_count);
+    results   = calloc(sizeof(*results), options->chunks_count);
+    if (reference == NULL || results == NULL)
+    {
+        fprintf(stderr, "Can not allocate memory\n");
+        goto exit;
+    }
+    for (i = 0; i < options->files_count; i++)
+    {
+        total_size += options->files[i].size;
+    }
+    printf("%zu indicators, %zu files, %zu bytes, %zu threads, %zu repeats\n", count, options->files_count,
+           total_size, options->threads, options->repeat);
+
+    for (i = 0; i < count; i++)
+    {
+        run_result_t whole;
+        size_t smallest = 0;
+        const indicator_ctx_layout_t *layout = (layouts != NULL) ? &layouts[i] : NULL;
+
+        printf("\nindicator %zu\n", i);
+        printf("%10s %12s %12s %12s %8s\n", "chunk", "MB/s", "calls", "ns/call", "stable");
+        if (run_indicator(options, &handlers[i], layout, 0, NULL, reference, &whole) != 0)
+        {
+            goto exit;
+        }
+        print_result(options, 0, total_size, &whole);
+        stable = stable && whole.stable;
+        for (k = 0; k < options->chunks_count; k++)
+        {
+            if (run_indicator(options, &handlers[i], layout, options->chunks[k], reference, NULL, &results[k]) != 0)
+            {
+                goto exit;
+            }
+            print_result(options, options->chunks[k], total_size, &results[k]);
+            stable = stable && results[k].stable;
+            smallest = (results[k].calls > results[smallest].calls) ? k : smallest;
+        }
+        if (results[smallest].calls > whole.calls)
+        {
+            print_overhead(options, &results[smallest], &whole);
+        }
+    }
+    printf("\nresults are %s\n", stable ? "stable" : "NOT stable across chunk sizes");
+    ret = stable ? 0 : -1;
+
+exit:
+    free(reference);
+    free(results);
+    dlclose(library);
+    return ret;
+}
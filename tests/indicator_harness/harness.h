@@ -0,0 +1,44 @@
+#ifndef HARNESS_H_
+#define HARNESS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HARNESS_MAX_CHUNKS 16
+
+typedef struct harness_file_s {
+    const char    *path;
+    const uint8_t *data;
+    size_t         size;
+} harness_file_t;
+
+typedef struct harness_options_s {
+    const char     *library;
+    harness_file_t *files;
+    size_t          files_count;
+    size_t          chunks[HARNESS_MAX_CHUNKS];  /* sizes of data passed to one indicator call */
+    size_t          chunks_count;
+    size_t          threads;                     /* threads run the same indicator on own ctx */
+    size_t          repeat;                      /* every thread processes all files repeat times */
+} harness_options_t;
+
+/**
+ * Map footage files to memory
+ *
+ * @param[in,out]   options     files paths, data and size are filled.
+ * @returns     Zero if all files are mapped
+ */
+int harness_map_files(harness_options_t *options);
+void harness_unmap_files(harness_options_t *options);
+
+/**
+ * Run every indicator of library with every chunk size
+ *
+ * Values of every file are compared with values computed from the whole file
+ * in one call, so results that depend on chunking are reported.
+ *
+ * @returns     Zero if library is loaded and all results are stable
+ */
+int harness_run(const harness_options_t *options);
+
+#endif /* HARNESS_H_ */
@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <argp.h>
+
+#include "harness.h"
+
+const char *argp_program_version = "1.0";
+const char *argp_program_bug_address = "<alexeyfonlapshin@gmail.com>";
+
+/* Size with optional K or M suffix, 0 if it is wrong */
+static size_t parse_size(const char *arg)
+{
+    char *end;
+    size_t size = (size_t) strtoull(arg, &end, 10);
+    switch (*end)
+    {
+    case 'K':
+    case 'k':
+        size *= 1024;
+        end++;
+        break;
+    case 'M':
+    case 'm':
+        size *= 1024 * 1024;
+        end++;
+        break;
+    default:
+        break;
+    }
+    return (*end == '\0') ? size : 0;
+}
+
+static int parse_chunks(harness_options_t *options, char *arg)
+{
+    char *saveptr = NULL;
+    char *token = strtok_r(arg, ",", &saveptr);
+
+    options->chunks_count = 0;
+    while (token != NULL)
+    {
+        if (options->chunks_count == HARNESS_MAX_CHUNKS)
+        {
+            return -1;
+        }
+        options->chunks[options->chunks_count] = parse_size(token);
+        if (options->chunks[options->chunks_count] == 0)
+        {
+            return -1;
+        }
+        options->chunks_count++;
+        token = strtok_r(NULL, ",", &saveptr);
+    }
+    return (options->chunks_count != 0) ? 0 : -1;
+}
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state)
+{
+    harness_options_t *options = state->input;
+
+    switch(key)
+    {
+    case 'c':
+        if (parse_chunks(options, arg) != 0)
+        {
+            argp_error(state, "wrong chunk sizes '%s'", arg);
+        }
+        break;
+    case 'j':
+        options->threads = (size_t) atoll(arg);
+        break;
+    case 'r':
+        options->repeat = (size_t) atoll(arg);
+        break;
+    case ARGP_KEY_ARG:
+        if (options->library == NULL)
+        {
+            options->library = arg;
+            break;
+        }
+        options->files = realloc(options->files, sizeof(*options->files) * (options->files_count + 1));
+        if (options->files == NULL)
+        {
+            argp_failure(state, 1, 0, "Can not allocate memory");
+        }
+        memset(&options->files[options->files_count], 0x00, sizeof(*options->files));
+        options->files[options->files_count++].path = arg;
+        break;
+    case ARGP_KEY_END:
+        if (options->files_count == 0)
+        {
+            argp_usage(state);
+        }
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static int parse_arguments(int argc, char **argv, harness_options_t *options)
+{
+    struct argp_option argp_options[] = {
+        {"chunks", 'c', "sizes", 0, "comma separated sizes of data for one indicator call, "
+                                    "K and M suffixes are supported (default: 4K,64K,1M)", 0},
+        {"threads", 'j', "count", 0, "threads run every indicator in parallel, "
+                                     "each with own ctx (default: 1)", 0},
+        {"repeat", 'r', "count", 0, "every thread processes all files this count of times (default: 1)", 0},
+        { 0 }
+    };
+
+    char *doc = "Measure indicators library without server. Every indicator processes "
+                "footage files with every chunk size, results are compared with values "
+                "computed from the whole file in one call.";
+
+    struct argp argp = {argp_options, parse_opt, "LIBRARY FILE...", doc, NULL, NULL, NULL};
+
+    return argp_parse(&argp, argc, argv, 0, 0, options);
+}
+
+int main(int argc, char **argv)
+{
+    int ret = EXIT_FAILURE;
+    harness_options_t options = {
+        .library      = NULL,
+        .files        = NULL,
+        .files_count  = 0,
+        .chunks       = {4 * 1024, 64 * 1024, 1024 * 1024},
+        .chunks_count = 3,
+        .threads      = 1,
+        .repeat       = 1,
+    };
+
+    if (parse_arguments(argc, argv, &options) != 0 || options.threads == 0 || options.repeat == 0)
+    {
+        fprintf(stderr, "Wrong arguments\n");
+        goto exit;
+    }
+    if (harness_map_files(&options) != 0)
+    {
+        goto exit;
+    }
+    if (harness_run(&options) == 0)
+    {
+        ret = EXIT_SUCCESS;
+    }
+
+exit:
+    harness_unmap_files(&options);
+    free(options.files);
+    return ret;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "kernels.h"
+
+#define MAX_SIZE 1000
+#define MAX_OFFSET 3    /* vector loads must work with unaligned data */
+#define LARGE_SIZE ((size_t) (3 * 1024 * 1024 + 7))
+
+/* Results of all kernels for one buffer */
+typedef struct results_s {
+    uint64_t hist[256];
+    uint64_t sum;
+    uint8_t  min;
+    uint8_t  max;
+    uint8_t  diff[MAX_SIZE];
+    uint64_t diff_sum;
+    uint64_t popcount;
+    uint64_t above[3];
+} results_t;
+
+static const uint8_t thresholds[3] = {0, 127, 254};
+
+static void run_kernels(const uint8_t *a, const uint8_t *b, size_t size, results_t *results)
+{
+    size_t i;
+    memset(results, 0x00, sizeof(*results));
+    kernels_histogram(a, size, results->hist);
+    results->sum = kernels_sum(a, size);
+    kernels_min_max(a, size, &results->min, &results->max);
+    if (size <= MAX_SIZE)
+    {
+        kernels_abs_diff(a, b, results->diff, size);
+    }
+    results->diff_sum = kernels_abs_diff_sum(a, b, size);
+    results->popcount = kernels_popcount(a, size);
+    for (i = 0; i < sizeof(thresholds); i++)
+    {
+        results->above[i] = kernels_count_above(a, size, thresholds[i]);
+    }
+}
+
+/* Every supported implementation must give the same results as scalar one */
+static int check(const uint8_t *a, const uint8_t *b, size_t size, const char *data_name)
+{
+    int isa, failed = 0;
+    static results_t expected, actual;
+
+    kernels_set_isa(KERNELS_ISA_SCALAR);
+    run_kernels(a, b, size, &expected);
+    for (isa = KERNELS_ISA_SCALAR + 1; isa < KERNELS_ISA_COUNT; isa++)
+    {
+        if (kernels_set_isa((kernels_isa_t)isa) != 0)
+        {
+            continue;
+        }
+        run_kernels(a, b, size, &actual);
+        if (memcmp(&expected, &actual, sizeof(expected)) != 0)
+        {
+            printf("%s: %s data of size %zu differs from scalar (sum %" PRIu64 "/%" PRIu64 ", diff %" PRIu64
+                   "/%" PRIu64 ", popcount %" PRIu64 "/%" PRIu64 ")\n", kernels_isa_name((kernels_isa_t)isa),
+                   data_name, size, actual.sum, expected.sum, actual.diff_sum, expected.diff_sum,
+                   actual.popcount, expected.popcount);
+            failed = 1;
+        }
+    }
+    return failed;
+}
+
+/* Scalar kernels against plain loops */
+static int check_scalar(const uint8_t *a, const uint8_t *b, size_t size)
+{
+    size_t i;
+    uint64_t sum = 0, diff_sum = 0, popcount = 0, above = 0;
+    uint8_t min = UINT8_MAX, max = 0;
+    static results_t results;
+
+    kernels_set_isa(KERNELS_ISA_SCALAR);
+    run_kernels(a, b, size, &results);
+    for (i = 0; i < size; i++)
+    {
+        sum      += a[i];
+        diff_sum += (uint64_t)abs((int)a[i] - (int)b[i]);
+        popcount += (uint64_t)__builtin_popcount(a[i]);
+        above    += (a[i] > thresholds[1]);
+        min = (a[i] < min) ? a[i] : min;
+        max = (a[i] > max) ? a[i] : max;
+        if (results.hist[a[i]] == 0)
+        {
+            printf("scalar: histogram of size %zu has no value %u\n", size, a[i]);
+            return 1;
+        }
+    }
+    if (results.sum != sum || results.diff_sum != diff_sum || results.popcount != popcount ||
+        results.above[1] != above || results.above[0] + results.hist[0] != size ||
+        results.min != min || results.max != max)
+    {
+        printf("scalar: results of size %zu are wrong\n", size);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+    size_t i, size, offset;
+    uint8_t *a = malloc(LARGE_SIZE + MAX_OFFSET);
+    uint8_t *b = malloc(LARGE_SIZE + MAX_OFFSET);
+    kernels_isa_t best = kernels_get_isa();
+
+    if (a == NULL || b == NULL)
+    {
+        printf("Can not allocate memory\n");
+        return 1;
+    }
+    printf("selected implementation: %s\n", kernels_isa_name(best));
+    srand(1);
+    for (i = 0; i < LARGE_SIZE + MAX_OFFSET; i++)
+    {
+        a[i] = (uint8_t)rand();
+        b[i] = (uint8_t)rand();
+    }
+
+    for (size = 0; size <= MAX_SIZE; size++)
+    {
+        for (offset = 0; offset <= MAX_OFFSET; offset++)
+        {
+            failed |= check(a + offset, b + MAX_OFFSET - offset, size, "random");
+        }
+        failed |= check_scalar(a, b, size);
+    }
+    failed |= check(a + 1, b, LARGE_SIZE, "random");
+    failed |= check_scalar(a + 1, b, LARGE_SIZE);
+
+    /* saturated values */
+    memset(a, 0xff, MAX_SIZE);
+    memset(b, 0x00, MAX_SIZE);
+    failed |= check(a, b, MAX_SIZE, "max");
+    failed |= check(b, a, MAX_SIZE, "zero");
+    failed |= check_scalar(a, b, MAX_SIZE);
+
+    kernels_set_isa(best);
+    free(a);
+    free(b);
+    printf("kernels %s\n", failed ? "FAILED" : "passed");
+    return failed;
+}